@@ -1,9 +1,27 @@
+// POSIX and BSD interfaces (madvise, clock_gettime, fdopen) stay declared under -std=c11
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // Cache configuration
 #define L1_SIZE 16
@@ -17,6 +35,15 @@
 #define L2_ACCESS_COST 10
 #define MEMORY_ACCESS_COST 100
 #define MAIN_MEMORY_BLOCKS (MAIN_MEMORY_SIZE / BLOCK_SIZE)
+#define MAX_CACHE_LEVELS 4  // Batch hierarchies: L1 to L4, main memory follows the last level
+#define L1I_LEVEL (MAX_CACHE_LEVELS + 1)  // Slot of a split L1's instruction cache in per-level arrays
+#define MAX_CORES 64  // Cores of a multi-core batch hierarchy, as many as trace records can name
+#define MAX_MSHRS 64  // Miss status holding registers per core
+
+// Addresses are decoded with shifts and masks, so the geometry must be powers of two
+#define IS_POWER_OF_TWO(x) ((x) > 0 && ((x) & ((x) - 1)) == 0)
+#define BLOCK_OFFSET_BITS __builtin_ctz(BLOCK_SIZE)
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
 
 // Additional definitions for fully associative cache
@@ -29,50 +56,172 @@
 #define L1_SETS (L1_SIZE / L1_ASSOCIATIVITY)  // Number of sets in L1
 #define L2_SETS (L2_SIZE / L2_ASSOCIATIVITY)  // Number of sets in L2
 
+_Static_assert(IS_POWER_OF_TWO(BLOCK_SIZE) && IS_POWER_OF_TWO(L1_SIZE) && IS_POWER_OF_TWO(L2_SIZE) &&
+               IS_POWER_OF_TWO(L1_SETS) && IS_POWER_OF_TWO(L2_SETS), "cache geometry must be powers of two");
+
+
+
+#define ARENA_ALIGN 64             // Arena allocations start on a cache line
+#define ARENA_MIN_BLOCK (1 << 20)  // Bytes of an arena's first block
+
+// One block of an arena, its data follows the header
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+// Bump allocator owning the state of one simulation run at a time. Allocations are never
+// freed one by one: resetArena hands all of them back between runs and keeps the memory
+typedef struct {
+    ArenaBlock *blocks;  // Newest first, allocations come from the head
+    size_t reserved;     // Data bytes over all blocks
+} Arena;
 
 
 // Cache line structure
 typedef struct {
-    int tag;
+    uint64_t tag;
     bool valid;
-    unsigned int address;
+    bool dirty;  // Written since it was filled (write-back caches only)
+    uint64_t address;
 } CacheLine;
 
 
 // fully associative cache line structure
 typedef struct {
-    int tag;
+    uint64_t tag;
     bool valid;
-    unsigned int address;
+    bool dirty;
+    uint64_t address;
     int lru_counter;
 } FullyAssociativeCacheLine;
 
 
+#define POLICY_TAG_INVALID UINT64_MAX  // Tag of an invalid line in the batch caches, real tags leave the top bits clear
+
+// fully associative cache line with an intrusive LRU list (O(1) LRU cache). The tag is the
+// block number, so the line's address is tag * line size
+typedef struct {
+    uint64_t tag;  // POLICY_TAG_INVALID while the line is invalid
+    int prev;      // More recently used line, -1 at the head
+    int next;      // Less recently used line, -1 at the tail
+} LRUCacheNode;
+
+
+// O(1) LRU fully associative cache: tag hash table plus recency list
+typedef struct {
+    LRUCacheNode *lines;
+    uint64_t *dirty;  // Per line, packed 64 lines to a word
+    int *buckets;     // Line index per hash bucket (linear probing), -1 when empty
+    int bucketMask;
+    int bucketShift;  // Multiplicative hash keeps the top bits
+    int size;
+    int used;         // Lines filled so far, invalid lines are filled in index order
+    int head;         // Most recently used line
+    int tail;         // Least recently used line
+    Arena *arena;     // Owner of the arrays, NULL for the heap
+} LRUFullyAssociativeCache;
+
+
 // set associative cache line structure
 typedef struct {
-    int tag;
+    uint64_t tag;
     bool valid;
-    unsigned int address;
+    bool dirty;
+    uint64_t address;
     int lru_counter;
 } AssociativeCacheLine;
 
 
+// Traffic of one level of a batch hierarchy
+typedef struct {
+    long hits;                // Accesses served by this level
+    long writebacks;          // Dirty lines evicted from this level
+    long read_bytes;          // Line fills read from this level by the level above
+    long write_bytes;         // Writebacks and stores written into this level
+    long inclusion_victims;   // Lines back-invalidated by evictions below (inclusive hierarchies)
+    long prefetches;          // Lines the level's prefetcher brought in
+    long useful_prefetches;   // Prefetched lines hit by a demand access before their eviction
+    long prefetch_pollution;  // Demand misses on lines a prefetch fill had evicted
+} LevelStats;
+
 // cache stat structure
 typedef struct {
-    int l1_hits;
-    int l2_hits;
-    int memory_accesses;
+    long l1_hits;
+    long l2_hits;
+    long memory_accesses;
     long total_cost;
+    LevelStats levels[MAX_CACHE_LEVELS + 2];  // Batch hierarchies: main memory after the last level, L1I at L1I_LEVEL
+    long write_cost;          // Cycles of writeback and write-through traffic, part of total_cost
+    long resident_lines;      // Distinct lines held by all levels together at the end of the run
+    long coherence_misses;    // Private misses on lines another core's write invalidated (multi-core)
+    long false_sharing_misses;  // ... where the access touched another word than that write
+    long invalidations;       // Private copies invalidated by another core's write
+    long upgrades;            // Writes to a shared line, which invalidate the other copies (S -> M)
+    long interventions;       // Modified copies written back because another core missed on them
+    long victim_hits;         // L1 misses served by the victim cache
+    long mshr_merges;         // Misses to a block already outstanding, folded into its MSHR
+    long mshr_stall_cycles;   // Cycles a core waited for a free MSHR
+    long elapsed_cycles;      // Cycles with misses overlapped through the MSHRs (summed over cores)
+    long port_wait_cycles;    // Timing mode: cycles lookups waited for a free port
+    long bank_conflict_cycles;  // Timing mode: cycles lookups waited for a busy cache or DRAM bank
+    long dram_row_hits;       // Timing mode: memory accesses to the open row of their bank
+    long dram_row_empty;      // ... to a bank with no open row
+    long dram_row_conflicts;  // ... to a bank with another row open
     float hit_rate;
     float avg_access_time;
+    float blocking_access_time;  // AMAT without the MSHRs, misses served one at a time
+    float timed_access_time;  // Timing mode: mean latency of the accesses plus the write traffic, like the AMAT
 } CacheStats;
 
 
-// Structure to store hit address information
+#define HOT_BLOCKS 8  // Counters of a space-saving sketch of the hottest blocks
+
+// One block monitored by a space-saving sketch
+typedef struct {
+    uint64_t block;
+    long count;  // Overestimates the block's true count by at most 'error'
+    long error;
+} HotBlock;
+
+// Space-saving sketch (Metwally et al.): the blocks seen most often in a stream, kept in
+// HOT_BLOCKS counters. Every block seen more than 1/HOT_BLOCKS of the time is among them
+typedef struct {
+    HotBlock blocks[HOT_BLOCKS];
+    int used;
+} HotBlockSketch;
+
+// Hits and misses of every set of one cache level
+typedef struct {
+    int sets;
+    long *hits;
+    long *misses;
+} SetCounters;
+
+// Hits of a two-level interactive simulation, aggregated as the accesses stream by
 typedef struct {
-    unsigned int address;
-    int cache_level;  // 1 for L1 hit, 2 for L2 hit
-} HitInfo;
+    SetCounters levels[2];
+    HotBlockSketch hot[2];  // The blocks each level served most often
+    long accesses;
+    long hits;
+} HitStats;
+
+
+// Mapping schemes, numbered like the main menu
+typedef enum {
+    MAPPING_ALL = 0,
+    MAPPING_DIRECT = 1,
+    MAPPING_FULLY_ASSOCIATIVE = 2,
+    MAPPING_SET_ASSOCIATIVE = 3
+} MappingType;
+
+// Synthetic address patterns
+typedef enum {
+    PATTERN_RANDOM,
+    PATTERN_SEQUENTIAL,
+    PATTERN_REPEATED
+} AddressPattern;
 
 
 
@@ -110,711 +259,1246 @@ void animateCheckMM() {
     printf("\n\n");
 }
 
-// Introduce a small delay for visual effect
-void simulateDelay() {
-    usleep(500000); // 500ms delay
+
+//-- arena allocation--
+
+
+static inline char *arenaBlockData(ArenaBlock *block) {
+    return (char *)(((uintptr_t)(block + 1) + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
 }
 
+static ArenaBlock *newArenaBlock(size_t size) {
+    ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + ARENA_ALIGN + size);
+    if (block == NULL) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
 
-//-- functions for direct mapping--
+// 'size' bytes from the arena, or from the heap when 'arena' is NULL; NULL when out of memory
+void *arenaAlloc(Arena *arena, size_t size) {
+    if (arena == NULL) return malloc(size);
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        // A new block at least doubles the arena, so a run spills over few of them
+        size_t blockSize = (arena->reserved > ARENA_MIN_BLOCK) ? arena->reserved : ARENA_MIN_BLOCK;
+        if (blockSize < size) blockSize = size;
+        block = newArenaBlock(blockSize);
+        if (block == NULL) return NULL;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->reserved += blockSize;
+    }
+    void *p = arenaBlockData(block) + block->used;
+    block->used += size;
+    return p;
+}
 
+// Zeroed 'count' * 'size' bytes, as calloc
+void *arenaCalloc(Arena *arena, size_t count, size_t size) {
+    if (arena == NULL) return calloc(count, size);
+    void *p = arenaAlloc(arena, count * size);
+    if (p != NULL) memset(p, 0, count * size);
+    return p;
+}
 
-// Display summary of all hit addresses
-void displayHitSummary(HitInfo *hitInfoArray, int hitCount) {
-    int displayCount =  hitCount;
+// Free one allocation; arena memory only goes back with resetArena
+void arenaFree(Arena *arena, void *p) {
+    if (arena == NULL) free(p);
+}
 
-    printf("Summary of Cache Hits (showing first %d out of %d hits)\n", displayCount, hitCount);
-    printf("---------------------------------------------------\n");
-    printf("Address  | Cache | TAG  | SET  | WORD | BYTE\n");
-    printf("-------- | ----- | ---- | ---- | ---- | ----\n");
+void freeArena(Arena *arena) {
+    while (arena->blocks != NULL) {
+        ArenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->reserved = 0;
+}
 
-    for (int i = 0; i < displayCount; i++) {
-        unsigned int address = hitInfoArray[i].address;
-        int cache_level = hitInfoArray[i].cache_level;
+// Hand back everything allocated since the last reset. A run that spilled over several
+// blocks leaves a single block as large as all of them, so the next run of that size
+// allocates nothing
+void resetArena(Arena *arena) {
+    if (arena->blocks != NULL && arena->blocks->next != NULL) {
+        size_t size = arena->reserved;
+        freeArena(arena);
+        arena->blocks = newArenaBlock(size);
+        if (arena->blocks != NULL) arena->reserved = size;
+    }
+    if (arena->blocks != NULL) arena->blocks->used = 0;
+}
 
+// State of the interactive simulations, reset as each one starts
+static Arena interactiveArena;
 
-        unsigned int tag, set;
 
-        if (cache_level == 1) {
-            // L1 cache hit
-            tag = address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE);
-            set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE;
-        } else {
-            // L2 cache hit
-            tag = address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE);
-            set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE;
-        }
+//-- random numbers--
 
-        unsigned int word = (address / WORD_SIZE) % WORDS_PER_LINE;
-        unsigned int byte = address % WORD_SIZE;
 
-        printf("0x%04X   | L%d    | 0x%02X | 0x%01X  | 0x%01X  | 0x%01X\n",
-               address, cache_level, tag, set, word, byte);
-    }
+// xoshiro256** (Blackman and Vigna): 256 bits of state, all 64 output bits usable, and jumps
+// of 2^128 and 2^192 outputs that split one seed into streams that never overlap
+typedef struct {
+    uint64_t s[4];
+} Xoshiro256;
 
-    if (hitCount > displayCount) {
-        printf("... and %d more hits (not shown)\n", hitCount - displayCount);
-    }
-    printf("\n");
+static inline uint64_t rotateLeft(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
 }
 
-// Initialize cache with invalid lines
-void initializeCache(CacheLine *cache, int size) {
-    for (int i = 0; i < size; i++) {
-        cache[i].valid = false;
-        cache[i].tag = -1;
-        cache[i].address = 0;
+// Expand a seed into a full state with splitmix64, so nearby seeds give unrelated streams
+void seedXoshiro(Xoshiro256 *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->s[i] = z ^ (z >> 31);
     }
 }
 
-// Generate random memory addresses
-void generateAddresses(unsigned int *addresses, int numAccesses) {
-    for (int i = 0; i < numAccesses; i++) {
-        addresses[i] = (rand() % (ADDRESS_SPACE / WORD_SIZE)) * WORD_SIZE;
-    }
+static inline uint64_t nextXoshiro(Xoshiro256 *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
+    return result;
 }
 
-// Check if an address is in the cache
-bool checkCache(CacheLine *cache, int cacheSize, unsigned int address, int *tag, int *index) {
-    *index = (address / (WORDS_PER_LINE * WORD_SIZE)) % cacheSize;
-    *tag = address / (cacheSize * WORDS_PER_LINE * WORD_SIZE);
+// Advance the generator as if 'polynomial' calls of nextXoshiro had been made
+static void jumpXoshiro(Xoshiro256 *rng, const uint64_t polynomial[4]) {
+    uint64_t s[4] = { 0, 0, 0, 0 };
 
-    return (cache[*index].valid && cache[*index].tag == *tag);
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (polynomial[i] & (1ULL << b)) {
+                for (int k = 0; k < 4; k++) s[k] ^= rng->s[k];
+            }
+            nextXoshiro(rng);
+        }
+    }
+    memcpy(rng->s, s, sizeof(s));
 }
 
-// Update cache with new address
-void updateCache(CacheLine *cache, int index, int tag, unsigned int address) {
-    cache[index].valid = true;
-    cache[index].tag = tag;
-    cache[index].address = address;
+// 2^128 outputs ahead
+void jumpXoshiro128(Xoshiro256 *rng) {
+    static const uint64_t jump[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                      0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+    jumpXoshiro(rng, jump);
 }
 
+// 2^192 outputs ahead
+void jumpXoshiro192(Xoshiro256 *rng) {
+    static const uint64_t longJump[4] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL,
+                                          0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+    jumpXoshiro(rng, longJump);
+}
 
-// Display  cache content
-void displayCacheContents(CacheLine *cache, int size, const char *cacheName) {
-    int displayLimit = size;
+// Parse a seed, decimal or 0x-prefixed hex, that fits an unsigned int; returns 0 on success
+int parseSeed(const char *text, unsigned int *seed) {
+    char *end;
 
-printf("%s Contents (showing first %d lines):\n", cacheName, displayLimit);
-    printf("SET(idx) | Valid | TAG  | Address  | Word Offset\n");
-    printf("-------- | ----- | ---- | -------- | -----------\n");
-    for (int i = 0; i < displayLimit; i++) {
-        if (cache[i].valid) {
-            printf("   0x%01X   |   %d   | 0x%02X | 0x%04X   | 0x%01X\n",
-                i, cache[i].valid, cache[i].tag, cache[i].address,
-                (cache[i].address / WORD_SIZE) % WORDS_PER_LINE);
-        } else {
-            printf("   0x%01X   |   %d   | ---  | -------- | ---\n", i, cache[i].valid);
-        }
-    }
+    // strtoull would accept leading blanks and negate a leading minus sign
+    if (!isdigit((unsigned char)text[0])) return 1;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 0);
+    if (*end != '\0' || errno != 0 || value > UINT_MAX) return 1;
+    *seed = (unsigned int)value;
+    return 0;
+}
 
-    if (size > displayLimit) {
-        printf("... and %d more sets (not shown)\n", size - displayLimit);
-    }
-    printf("\n");
+// Seed of an interactive simulation: SIM_SEED when set, so a run can be repeated, else the time.
+// main refuses to start the menu with an invalid SIM_SEED
+unsigned int interactiveSeed(void) {
+    const char *text = getenv("SIM_SEED");
+    unsigned int seed;
+    if (text != NULL && *text != '\0' && parseSeed(text, &seed) == 0) return seed;
+    return (unsigned int)time(NULL);
 }
 
 
-// Print detailed address breakdown with TAG, SET, WORD
-void printAddressBreakdown(unsigned int address) {
-    unsigned int l1_tag = address/(L1_SIZE * WORDS_PER_LINE * WORD_SIZE);
-    unsigned int l1_set = (address/(WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE;
-    unsigned int l2_tag = address/(L2_SIZE * WORDS_PER_LINE * WORD_SIZE);
-    unsigned int l2_set = (address/(WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE;
-    unsigned int word_offset = (address/WORD_SIZE) % WORDS_PER_LINE;
-    unsigned int byte_offset = address % WORD_SIZE;
+//-- address generation and traces--
 
-    printf("Address Breakdown (0x%04X):\n", address);
-    printf("----------------------------------------\n");
-    printf("Memory Architecture:\n");
-    printf("- Word Size: %d bytes\n", WORD_SIZE);
-    printf("- Words per Cache Line: %d words\n", WORDS_PER_LINE);
-    printf("- Cache Line Size: %d bytes\n\n", WORD_SIZE * WORDS_PER_LINE);
 
-    printf("Binary breakdown: ");
-    for (int i = 15; i >= 0; i--) {
-        int bit = (address >> i) & 1;
-        if (i == 7) printf(" | ");
-        if (i == 4) printf(" | ");
-        if (i == 2) printf(" | ");
-        printf("%d", bit);
-    }
-    printf("\n                  TAG | SET | WORD | BYTE\n\n");
+// Binary trace file: a 16-byte header followed by one 64-bit record per access
+// Record bits 0-55 hold the byte address, bits 56-61 the core that issued the access,
+// bit 63 is set for writes (stores) and bit 62 for instruction fetches, a record with
+// neither is a load (host byte order)
+#define TRACE_MAGIC "CTRACE01"
+#define TRACE_ADDRESS_MASK 0x00FFFFFFFFFFFFFFULL
+#define TRACE_CORE_SHIFT 56
+#define TRACE_CORE_MASK 0x3FULL
+#define TRACE_WRITE_FLAG (1ULL << 63)
+#define TRACE_FETCH_FLAG (1ULL << 62)
+#define TRACE_CHUNK_RECORDS 65536  // Records simulated per chunk
 
-    printf("L1 Cache Mapping:\n");
-    printf("  TAG: 0x%02X  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
-           l1_tag, l1_set, word_offset, byte_offset);
+typedef uint64_t TraceRecord;
 
-    printf("L2 Cache Mapping:\n");
-    printf("  TAG: 0x%01X  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
-           l2_tag, l2_set, word_offset, byte_offset);
+typedef struct {
+    char magic[8];
+    uint64_t count;
+} TraceHeader;
+
+// Binary trace mapped read-only into memory
+typedef struct {
+    int fd;
+    void *map;
+    size_t mapSize;
+    const TraceRecord *records;
+    uint64_t count;
+    size_t released;  // Bytes already handed back to the kernel
+} MappedTrace;
+
+#define SYNTHETIC_LANES 4             // Interleaved generators of the random pattern
+#define SYNTHETIC_SEGMENT (1L << 16)  // Records per segment, each starts from a 2^192 jump
+
+// Synthetic address stream, generated chunk by chunk. The random pattern is cut into segments
+// that can be generated independently: segment k starts from the seeded state jumped k times
+// by 2^192, and its record j comes from lane j % SYNTHETIC_LANES, that start jumped by 2^128
+// once per lane
+typedef struct {
+    AddressPattern pattern;
+    long position;
+    uint64_t addressSpace;  // Bytes, a power of two; addresses fall in [0, addressSpace)
+    int wordShift;          // Right shift of a 64-bit random number to a word index
+    uint64_t uniqueAddresses[20];
+    Xoshiro256 origin;      // Seeded state, segment 0 starts here
+    Xoshiro256 segmentStart;
+    long segment;
+    Xoshiro256 lanes[SYNTHETIC_LANES];
+} SyntheticTrace;
+
+static inline uint64_t traceAddress(TraceRecord record) {
+    return record & TRACE_ADDRESS_MASK;
 }
 
+static inline bool traceIsWrite(TraceRecord record) {
+    return (record & TRACE_WRITE_FLAG) != 0;
+}
 
-// Clear the console screen
-void clearScreen() {
-    #ifdef _WIN32
-        system("cls");
-    #else
-        system("clear");
-    #endif
+static inline bool traceIsFetch(TraceRecord record) {
+    return (record & TRACE_FETCH_FLAG) != 0;
 }
 
+static inline TraceRecord makeTraceRecord(uint64_t address, bool write) {
+    return (address & TRACE_ADDRESS_MASK) | (write ? TRACE_WRITE_FLAG : 0);
+}
 
-int cacheSimulation(int t){
-   // Seed random number generator
-    srand(time(NULL));
+static inline int traceCore(TraceRecord record) {
+    return (int)((record >> TRACE_CORE_SHIFT) & TRACE_CORE_MASK);
+}
 
-    int numAccesses;
-    int i;
+void closeMappedTrace(MappedTrace *trace) {
+    if (trace->map && trace->map != MAP_FAILED) munmap(trace->map, trace->mapSize);
+    if (trace->fd >= 0) close(trace->fd);
+    trace->map = NULL;
+    trace->fd = -1;
+}
 
-    // Statistics variables
-    int l1Hits = 0, l1Misses = 0;
-    int l2Hits = 0, l2Misses = 0;
-    long totalCycles = 0;  // Use long for potential large values
+// Map a binary trace file, the records are paged in on demand
+int openMappedTrace(const char *path, MappedTrace *trace) {
+    struct stat st;
 
-    // Create cache structures
-    CacheLine l1Cache[L1_SIZE];
-    CacheLine l2Cache[L2_SIZE];
+    memset(trace, 0, sizeof(*trace));
+    trace->fd = open(path, O_RDONLY);
+    if (trace->fd < 0) {
+        fprintf(stderr, "Cannot open trace '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
 
-    // Initialize caches
-    initializeCache(l1Cache, L1_SIZE);
-    initializeCache(l2Cache, L2_SIZE);
+    if (fstat(trace->fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "Trace '%s' is too short\n", path);
+        close(trace->fd);
+        return 1;
+    }
 
- // User input
-    printf("Memory Hierarchy Simulator (Direct Mapping) with TAG/SET/WORD Breakdown\n");
-    printf("-------------------------------------------------------------------\n");
-    printf("Enter the number of memory access attempts to simulate: ");
-    scanf("%d", &numAccesses);
-    // Allocate memory for addresses
-    unsigned int *addresses = (unsigned int *)malloc(numAccesses * sizeof(unsigned int));
-    if (addresses == NULL) {
-        printf("Memory allocation failed. Exiting...\n");
+    trace->mapSize = (size_t)st.st_size;
+    trace->map = mmap(NULL, trace->mapSize, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+    if (trace->map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map trace '%s': %s\n", path, strerror(errno));
+        close(trace->fd);
         return 1;
     }
+    madvise(trace->map, trace->mapSize, MADV_SEQUENTIAL);
 
-    // Create array to store hit information
-    HitInfo *hitInfoArray = (HitInfo *)malloc(numAccesses * sizeof(HitInfo));
-    if (hitInfoArray == NULL) {
-        printf("Memory allocation failed. Exiting...\n");
-        free(addresses);
+    const TraceHeader *header = (const TraceHeader *)trace->map;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "'%s' is not a binary trace (bad magic)\n", path);
+        closeMappedTrace(trace);
         return 1;
     }
-    int hitCount = 0;
 
-    // Generate random addresses
-    generateAddresses(addresses, numAccesses);
-    // Simulate memory accesses
-    for (i = 0; i < numAccesses; i++) {
-        unsigned int address = addresses[i];
-        int tag, index;
-        bool l1Hit, l2Hit;
+    // Trust the file size over the header if the trace was cut short
+    uint64_t available = (trace->mapSize - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    trace->count = (header->count < available) ? header->count : available;
+    trace->records = (const TraceRecord *)((const char *)trace->map + sizeof(TraceHeader));
+    return 0;
+}
 
+// Drop the pages of records before 'consumed' so long traces keep a small resident set
+void releaseMappedTrace(MappedTrace *trace, uint64_t consumed) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = sizeof(TraceHeader) + consumed * sizeof(TraceRecord);
+    end -= end % pageSize;
 
-        if(t==1){
-            clearScreen();
+    if (end > trace->released) {
+        madvise((char *)trace->map + trace->released, end - trace->released, MADV_DONTNEED);
+        trace->released = end;
+    }
+}
 
-        printf("Memory Access #%d\n", i + 1);
-        printf("------------------\n");
-        printf("Accessing address: 0x%04X\n\n", address);
+// Random word-aligned address in the generator's address space, the top bits of a draw
+static inline uint64_t randomWordAddress(const SyntheticTrace *gen, uint64_t r) {
+    return (r >> gen->wordShift) * WORD_SIZE;
+}
 
-        // Print address breakdown with TAG/SET/WORD
-        printAddressBreakdown(address);
+// Set up the lanes of random segment 'segment'; jumps forward from the current segment when
+// it can, from the seeded state otherwise
+static void startSyntheticSegment(SyntheticTrace *gen, long segment) {
+    if (segment < gen->segment) {
+        gen->segmentStart = gen->origin;
+        gen->segment = 0;
+    }
+    for (; gen->segment < segment; gen->segment++) jumpXoshiro192(&gen->segmentStart);
 
+    gen->lanes[0] = gen->segmentStart;
+    for (int l = 1; l < SYNTHETIC_LANES; l++) {
+        gen->lanes[l] = gen->lanes[l - 1];
+        jumpXoshiro128(&gen->lanes[l]);
+    }
+}
+
+// Seed the synthetic address generator
+void initSyntheticTrace(SyntheticTrace *gen, AddressPattern pattern, unsigned int seed, uint64_t addressSpace) {
+    gen->pattern = pattern;
+    gen->position = 0;
+    gen->addressSpace = addressSpace;
+    gen->wordShift = 64 - __builtin_ctzll(addressSpace / WORD_SIZE);
+    seedXoshiro(&gen->origin, seed);
+    gen->segmentStart = gen->origin;
+    gen->segment = 0;
+    startSyntheticSegment(gen, 0);
+    if (pattern == PATTERN_REPEATED) {
+        // Drawn from the seeded state, which no random segment of this pattern uses
+        Xoshiro256 rng = gen->origin;
+        for (int i = 0; i < 20; i++) {
+            gen->uniqueAddresses[i] = randomWordAddress(gen, nextXoshiro(&rng));
         }
+    }
+}
 
-        // Check L1 Cache
-        l1Hit = checkCache(l1Cache, L1_SIZE, address, &tag, &index);
-      if(t==1)  animateCheckL1();
-        if (l1Hit) {
-            // L1 Cache hit
-            l1Hits++;
-            totalCycles += L1_ACCESS_COST;
+// Move the stream to record 'position', the random pattern jumps to its segment
+void seekSyntheticTrace(SyntheticTrace *gen, long position) {
+    gen->position = position;
+    if (gen->pattern == PATTERN_RANDOM) {
+        startSyntheticSegment(gen, position / SYNTHETIC_SEGMENT);
+        // Each lane drew one number per SYNTHETIC_LANES records of the segment so far
+        for (long i = position / SYNTHETIC_SEGMENT * SYNTHETIC_SEGMENT; i < position; i++) {
+            nextXoshiro(&gen->lanes[i % SYNTHETIC_LANES]);
+        }
+    }
+}
 
-            // Record hit information
-            hitInfoArray[hitCount].address = address;
-            hitInfoArray[hitCount].cache_level = 1;  // L1 hit
-            hitCount++;
+// Next address of the synthetic stream
+static inline uint64_t nextSyntheticAddress(SyntheticTrace *gen) {
+    long position = gen->position++;
 
-            if(t==1){
-                printf("L1 CACHE HIT!\n");
-            printf("  TAG: 0x%02X  SET: 0x%01X  WORD: 0x%01X\n",
-                   address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE),
-                   (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
-                   (address / WORD_SIZE) % WORDS_PER_LINE);
-            printf("Access cost: %d cycles\n\n", L1_ACCESS_COST);
+    if (gen->pattern == PATTERN_SEQUENTIAL) {
+        // Consecutive words, good spatial locality
+        return ((uint64_t)position * WORD_SIZE) % gen->addressSpace;
+    } else if (gen->pattern == PATTERN_REPEATED) {
+        // Cycle through a small set of unique addresses, tests temporal locality
+        return gen->uniqueAddresses[position % 20];
+    }
+    if (position / SYNTHETIC_SEGMENT != gen->segment) startSyntheticSegment(gen, position / SYNTHETIC_SEGMENT);
+    return randomWordAddress(gen, nextXoshiro(&gen->lanes[position % SYNTHETIC_LANES]));
+}
 
-            displayCacheContents(l1Cache, L1_SIZE, "L1 Cache");
-            if (hitCount > 0) {
-                displayHitSummary(hitInfoArray, hitCount);
-            } else {
-                printf("No cache hits recorded during this simulation.\n");
-            }
+// Random records from 'gen->position' up to the end of its segment at most. Builds for AVX2
+// step the four lanes in one vector, plain x86-64 steps them one after another: SSE2 has no
+// 64-bit rotate, and its two-lane vectors lose to four independent scalar chains
+static size_t fillRandomSegment(SyntheticTrace *gen, TraceRecord *records, size_t count) {
+    long segmentEnd = (gen->position / SYNTHETIC_SEGMENT + 1) * SYNTHETIC_SEGMENT;
+    size_t n = ((size_t)(segmentEnd - gen->position) < count) ? (size_t)(segmentEnd - gen->position) : count;
+    size_t i = 0;
+
+    if (gen->position / SYNTHETIC_SEGMENT != gen->segment) startSyntheticSegment(gen, gen->position / SYNTHETIC_SEGMENT);
+    for (; i < n && (gen->position + (long)i) % SYNTHETIC_LANES != 0; i++) {
+        int lane = (int)((gen->position + (long)i) % SYNTHETIC_LANES);
+        records[i] = makeTraceRecord(randomWordAddress(gen, nextXoshiro(&gen->lanes[lane])), false);
+    }
 
-            printf("\nPress Enter to continue to next memory access...");
-            while (getchar() != '\n'); // Clear input buffer
-            getchar();
-            } // Wait for user input
-        } else {
-            // L1 Cache miss
-            l1Misses++;
+#if defined(__AVX2__) && SYNTHETIC_LANES == 4
+    // Vector k holds state word k of every lane. The addresses fit TRACE_ADDRESS_MASK since
+    // the address space is at most 2^56 bytes, so they are stored as records directly
+    const Xoshiro256 *lanes = gen->lanes;
+    __m256i s0 = _mm256_set_epi64x(lanes[3].s[0], lanes[2].s[0], lanes[1].s[0], lanes[0].s[0]);
+    __m256i s1 = _mm256_set_epi64x(lanes[3].s[1], lanes[2].s[1], lanes[1].s[1], lanes[0].s[1]);
+    __m256i s2 = _mm256_set_epi64x(lanes[3].s[2], lanes[2].s[2], lanes[1].s[2], lanes[0].s[2]);
+    __m256i s3 = _mm256_set_epi64x(lanes[3].s[3], lanes[2].s[3], lanes[1].s[3], lanes[0].s[3]);
+    const __m128i shift = _mm_cvtsi32_si128(gen->wordShift);
+    const __m128i wordBits = _mm_cvtsi32_si128(__builtin_ctz(WORD_SIZE));
+    for (; i + SYNTHETIC_LANES <= n; i += SYNTHETIC_LANES) {
+        // rotl(s1 * 5, 7) * 9, the multiplies as shifts and adds
+        __m256i x = _mm256_add_epi64(s1, _mm256_slli_epi64(s1, 2));
+        x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+        __m256i result = _mm256_add_epi64(x, _mm256_slli_epi64(x, 3));
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+        __m256i addresses = _mm256_sll_epi64(_mm256_srl_epi64(result, shift), wordBits);
+        _mm256_storeu_si256((__m256i *)(records + i), addresses);
+    }
+    uint64_t words[4][4];
+    _mm256_storeu_si256((__m256i *)words[0], s0);
+    _mm256_storeu_si256((__m256i *)words[1], s1);
+    _mm256_storeu_si256((__m256i *)words[2], s2);
+    _mm256_storeu_si256((__m256i *)words[3], s3);
+    for (int l = 0; l < SYNTHETIC_LANES; l++) {
+        for (int k = 0; k < 4; k++) gen->lanes[l].s[k] = words[k][l];
+    }
+#else
+    // The lanes are copied out so the compiler knows the records never alias them
+    Xoshiro256 lanes[SYNTHETIC_LANES];
+    memcpy(lanes, gen->lanes, sizeof(lanes));
+    for (; i + SYNTHETIC_LANES <= n; i += SYNTHETIC_LANES) {
+        for (int l = 0; l < SYNTHETIC_LANES; l++) {
+            records[i + l] = makeTraceRecord(randomWordAddress(gen, nextXoshiro(&lanes[l])), false);
+        }
+    }
+    memcpy(gen->lanes, lanes, sizeof(lanes));
+#endif
 
+    for (; i < n; i++) {
+        int lane = (int)((gen->position + (long)i) % SYNTHETIC_LANES);
+        records[i] = makeTraceRecord(randomWordAddress(gen, nextXoshiro(&gen->lanes[lane])), false);
+    }
+    gen->position += n;
+    return n;
+}
 
-            if(t==1){
-                printf("L1 CACHE MISS!\n");
+// Produce the next 'count' records of the synthetic stream (all reads)
+void fillSyntheticTrace(SyntheticTrace *gen, TraceRecord *records, size_t count) {
+    if (gen->pattern == PATTERN_RANDOM) {
+        for (size_t done = 0; done < count; ) done += fillRandomSegment(gen, records + done, count - done);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        records[i] = makeTraceRecord(nextSyntheticAddress(gen), false);
+    }
+}
 
-           printf("  Attempted to find TAG: 0x%02X in SET: 0x%01X\n",
-                   address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE),
-                   (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE);
+// One thread's share of a parallel fill
+typedef struct {
+    SyntheticTrace gen;
+    TraceRecord *records;
+    size_t count;
+    pthread_t thread;
+    bool threaded;  // Filled by 'thread' rather than the caller
+} SyntheticFill;
+
+static void *syntheticFillWorker(void *arg) {
+    SyntheticFill *fill = (SyntheticFill *)arg;
+    fillSyntheticTrace(&fill->gen, fill->records, fill->count);
+    return NULL;
+}
 
-            // Check L2 Cache
-          usleep(500000);
-            }
+// fillSyntheticTrace on up to 'jobs' threads: each takes whole segments and seeks a copy of the
+// generator to its first record, so the records match a sequential fill
+void fillSyntheticTraceParallel(SyntheticTrace *gen, TraceRecord *records, size_t count, int jobs) {
+    long segments = (long)((count + SYNTHETIC_SEGMENT - 1) / SYNTHETIC_SEGMENT);
+    if (jobs > segments) jobs = (int)segments;
+    if (jobs <= 1) {
+        fillSyntheticTrace(gen, records, count);
+        return;
+    }
 
+    SyntheticFill *fills = (SyntheticFill *)malloc(jobs * sizeof(SyntheticFill));
+    if (fills == NULL) {
+        fillSyntheticTrace(gen, records, count);
+        return;
+    }
 
-            l2Hit = checkCache(l2Cache, L2_SIZE, address, &tag, &index);
-         if(t==1)   animateCheckL2();
-            if (l2Hit) {
-                // L2 Cache hit
-                l2Hits++;
-                totalCycles += L2_ACCESS_COST;
+    long start = gen->position;
+    size_t begin = 0;
+    for (int t = 0; t < jobs; t++) {
+        size_t end = (t == jobs - 1) ? count : (size_t)(segments * (t + 1) / jobs) * SYNTHETIC_SEGMENT;
+        fills[t].gen = *gen;
+        seekSyntheticTrace(&fills[t].gen, start + (long)begin);
+        fills[t].records = records + begin;
+        fills[t].count = end - begin;
+        // The caller fills the first share, and those of threads that cannot start
+        fills[t].threaded = t > 0 && pthread_create(&fills[t].thread, NULL, syntheticFillWorker, &fills[t]) == 0;
+        begin = end;
+    }
+    for (int t = 0; t < jobs; t++) {
+        if (fills[t].threaded) pthread_join(fills[t].thread, NULL);
+        else fillSyntheticTrace(&fills[t].gen, fills[t].records, fills[t].count);
+    }
+    free(fills);
+    seekSyntheticTrace(gen, start + (long)count);
+}
 
-                // Record hit information
-                hitInfoArray[hitCount].address = address;
-                hitInfoArray[hitCount].cache_level = 2;  // L2 hit
-                hitCount++;
+// Write a synthetic pattern as a binary trace file
+int writeTraceFile(const char *path, AddressPattern pattern, unsigned int seed, uint64_t addressSpace, long numAccesses) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot create trace '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
 
+    TraceRecord *chunk = (TraceRecord *)malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    if (chunk == NULL) {
+        fprintf(stderr, "Memory allocation failed for trace chunk\n");
+        fclose(file);
+        return 1;
+    }
 
-                if(t==1){
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.count = (uint64_t)numAccesses;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    SyntheticTrace gen;
+    initSyntheticTrace(&gen, pattern, seed, addressSpace);
+    for (long done = 0; ok && done < numAccesses; ) {
+        size_t n = (numAccesses - done < TRACE_CHUNK_RECORDS) ? (size_t)(numAccesses - done) : TRACE_CHUNK_RECORDS;
+        fillSyntheticTrace(&gen, chunk, n);
+        ok = fwrite(chunk, sizeof(TraceRecord), n, file) == n;
+        done += n;
+    }
 
-                printf("\nL2 CACHE HIT!\n");
-                printf("  TAG: 0x%02X  SET: 0x%01X  WORD: 0x%01X\n",
-                       address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE),
-                       (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE,
-                       (address / WORD_SIZE) % WORDS_PER_LINE);
-                printf("Access cost: %d cycles\n", L2_ACCESS_COST);
+    free(chunk);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Failed writing trace '%s'\n", path);
+        return 1;
+    }
+    return 0;
+}
+// Text traces: one hex address per line, optionally followed by R/W (or L/S) and I
+// (or F) for instruction fetches and a decimal core id, separated by whitespace or a comma. Lines starting
+// with '#' are ignored, and any other trailing text makes the line malformed.
+// Files starting with a gzip or zstd magic number are decompressed on the fly.
+#define TRACE_RING_SLOTS 8      // Chunks buffered between the reader thread and the simulation
+#define TRACE_LINE_LENGTH 256   // Longer lines are skipped as malformed
+
+// Bounded pipeline: a reader thread parses chunks into ring slots, the simulation consumes them
+typedef struct {
+    FILE *input;
+    pid_t decompressor;       // Child process for compressed traces, -1 otherwise
+    const char *decompressorName;
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    TraceRecord *buffer;      // TRACE_RING_SLOTS chunks of TRACE_CHUNK_RECORDS records
+    size_t slotCount[TRACE_RING_SLOTS];
+    int head;                 // Next slot to consume
+    int tail;                 // Next slot to fill
+    int filled;
+    bool held;                // Consumer still reads the head slot
+    bool finished;            // Reader reached the end of the input
+    bool stop;                // Consumer asked the reader to stop
+    bool readError;           // Reading the input failed before its end
+    long badLines;
+} TraceStream;
+
+// Parse one text trace line, returns false for blank, comment or malformed lines
+static bool parseTraceLine(const char *line, TraceRecord *record, bool *malformed) {
+    const char *p = line;
+    char *end;
+
+    *malformed = false;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') return false;
+
+    // Addresses past TRACE_ADDRESS_MASK would alias once packed into a record
+    errno = 0;
+    unsigned long long address = strtoull(p, &end, 16);
+    if (end == p || errno == ERANGE || address > TRACE_ADDRESS_MASK) {
+        *malformed = true;
+        return false;
+    }
 
-                // Update L1 Cache
-                updateCache(l1Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
-                           address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
-                printf("Data loaded from L2 to L1\n\n");
+    // Each field ends at a separator, so "0x40junk" is not read as 0x40
+    p = end;
+    if (*p != ' ' && *p != '\t' && *p != ',' && *p != '#' && *p != '\n' && *p != '\r' && *p != '\0') {
+        *malformed = true;
+        return false;
+    }
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+
+    // The access type is a single R/W/L/S/I/F letter
+    bool write = false;
+    bool fetch = false;
+    if (isalpha((unsigned char)*p)) {
+        switch (toupper((unsigned char)*p)) {
+            case 'R': case 'L': break;
+            case 'W': case 'S': write = true; break;
+            case 'I': case 'F': fetch = true; break;
+            default:
+                *malformed = true;
+                return false;
+        }
+        p++;
+        if (*p != ' ' && *p != '\t' && *p != ',' && *p != '#' && *p != '\n' && *p != '\r' && *p != '\0') {
+            *malformed = true;
+            return false;
+        }
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    }
 
-                displayCacheContents(l2Cache, L2_SIZE, "L2 Cache");
-                if (hitCount > 0) {
-                    displayHitSummary(hitInfoArray, hitCount);
-                } else {
-                    printf("No cache hits recorded during this simulation.\n");
-                }
+    // An optional decimal core id follows the access type of multi-threaded traces
+    unsigned long core = 0;
+    if (isdigit((unsigned char)*p)) {
+        errno = 0;
+        core = strtoul(p, &end, 10);
+        if (errno == ERANGE || core > TRACE_CORE_MASK) {
+            *malformed = true;
+            return false;
+        }
+        p = end;
+        while (*p == ' ' || *p == '\t') p++;
+    }
 
-                printf("\nPress Enter to continue to next memory access...");
-               while (getchar() != '\n'); // Clear input buffer
-                getchar(); // Wait for user input
-                }
+    // Only a comment may follow the last field
+    if (*p != '#' && *p != '\n' && *p != '\r' && *p != '\0') {
+        *malformed = true;
+        return false;
+    }
 
-            } else {
-                // L2 Cache miss
-                l2Misses++;
-                totalCycles += MEMORY_ACCESS_COST;
+    *record = makeTraceRecord(address, write) | (fetch ? TRACE_FETCH_FLAG : 0) |
+              ((TraceRecord)core << TRACE_CORE_SHIFT);
+    return true;
+}
 
+static void *traceReaderThread(void *arg) {
+    TraceStream *stream = (TraceStream *)arg;
+    char line[TRACE_LINE_LENGTH];
+    bool eof = false;
 
-                if(t==1){
-                      printf("L2 CACHE MISS!\n");
+    while (!eof) {
+        pthread_mutex_lock(&stream->lock);
+        while (stream->filled == TRACE_RING_SLOTS && !stream->stop) {
+            pthread_cond_wait(&stream->notFull, &stream->lock);
+        }
+        bool stop = stream->stop;
+        int slot = stream->tail;
+        pthread_mutex_unlock(&stream->lock);
+        if (stop) break;
+
+        // The tail slot is not visible to the consumer until it is published below
+        TraceRecord *records = stream->buffer + (size_t)slot * TRACE_CHUNK_RECORDS;
+        size_t n = 0;
+        long badLines = 0;
+        bool readError = false;
+        while (n < TRACE_CHUNK_RECORDS) {
+            bool malformed;
+            if (fgets(line, sizeof(line), stream->input) == NULL) {
+                eof = true;
+                readError = ferror(stream->input) != 0;
+                break;
+            }
+            // A line that does not fit is dropped whole rather than split into several accesses
+            size_t length = strlen(line);
+            if (length == sizeof(line) - 1 && line[length - 1] != '\n') {
+                int c;
+                while ((c = getc(stream->input)) != '\n' && c != EOF) {}
+                badLines++;
+                continue;
+            }
+            if (parseTraceLine(line, &records[n], &malformed)) n++;
+            else if (malformed) badLines++;
+        }
 
-                printf("  Attempted to find TAG: 0x%02X in SET: 0x%01X\n",
-                       address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE),
-                       (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE);
+        pthread_mutex_lock(&stream->lock);
+        stream->badLines += badLines;
+        stream->readError = stream->readError || readError;
+        if (n > 0) {
+            stream->slotCount[slot] = n;
+            stream->tail = (stream->tail + 1) % TRACE_RING_SLOTS;
+            stream->filled++;
+            pthread_cond_signal(&stream->notEmpty);
+        }
+        pthread_mutex_unlock(&stream->lock);
+    }
 
+    pthread_mutex_lock(&stream->lock);
+    stream->finished = true;
+    pthread_cond_broadcast(&stream->notEmpty);
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
 
-                animateCheckMM();
+// Start a decompressor writing the trace to a pipe
+static FILE *openDecompressor(const char *program, const char *path, pid_t *child) {
+    int fds[2];
+    if (pipe(fds) != 0) return NULL;
 
+    *child = fork();
+    if (*child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (*child == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp(program, program, "-dc", "--", path, (char *)NULL);
+        _exit(127);
+    }
 
-                printf("Access cost: %d cycles\n", MEMORY_ACCESS_COST);
+    close(fds[1]);
+    return fdopen(fds[0], "r");
+}
 
-                }
-                // Update L1 and L2 Caches (inclusive cache policy)
-                updateCache(l1Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
-                           address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
-                updateCache(l2Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE,
-                           address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
-                           if(t==1){
-                printf("Data loaded from Main Memory to L1 and L2.\n\n");
+// Wait for the decompressor of a stream to exit, returns 0 if it decompressed the whole file
+static int reapDecompressor(TraceStream *stream, const char *path) {
+    int status;
 
-                // Display cache contents after update
-                displayCacheContents(l1Cache, L1_SIZE, "L1 Cache");
-                displayCacheContents(l2Cache, L2_SIZE, "L2 Cache");
+    if (stream->decompressor <= 0) return 0;
+    while (waitpid(stream->decompressor, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    stream->decompressor = -1;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) return 0;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "Cannot run '%s' to decompress '%s'\n", stream->decompressorName, path);
+    } else if (WIFEXITED(status)) {
+        fprintf(stderr, "'%s' failed on '%s' (exit status %d), the trace is truncated or corrupt\n",
+                stream->decompressorName, path, WEXITSTATUS(status));
+    } else {
+        fprintf(stderr, "'%s' was killed by signal %d while decompressing '%s'\n",
+                stream->decompressorName, WTERMSIG(status), path);
+    }
+    return 1;
+}
 
-                printf("\nPress Enter to continue to next memory access...");
-                while (getchar() != '\n'); // Clear input buffer
-                getchar(); // Wait for user input
+// Open a text trace (plain, gzip or zstd) and start its reader thread
+int openTraceStream(const char *path, TraceStream *stream) {
+    unsigned char magic[4] = { 0 };
 
-                }
+    memset(stream, 0, sizeof(*stream));
+    stream->decompressor = -1;
 
-            }
-        }
+    FILE *probe = fopen(path, "rb");
+    if (probe == NULL) {
+        fprintf(stderr, "Cannot open trace '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    size_t magicLength = fread(magic, 1, sizeof(magic), probe);
+
+    if (magicLength >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+        fclose(probe);
+        stream->decompressorName = "gzip";
+        stream->input = openDecompressor("gzip", path, &stream->decompressor);
+    } else if (magicLength == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+        fclose(probe);
+        stream->decompressorName = "zstd";
+        stream->input = openDecompressor("zstd", path, &stream->decompressor);
+    } else {
+        rewind(probe);
+        stream->input = probe;
+    }
+    if (stream->input == NULL) {
+        fprintf(stderr, "Cannot start decompressor for '%s'\n", path);
+        if (stream->decompressor > 0) waitpid(stream->decompressor, NULL, 0);
+        return 1;
     }
 
-    // Calculate final statistics
-    float l1HitRatio = (float)l1Hits / numAccesses;
-    float l2HitRatio = (l1Misses > 0) ? (float)l2Hits / l1Misses : 0;
-    float amat = L1_ACCESS_COST + (1 - l1HitRatio) * (L2_ACCESS_COST + (1 - l2HitRatio) * MEMORY_ACCESS_COST);
+    stream->buffer = (TraceRecord *)malloc((size_t)TRACE_RING_SLOTS * TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    if (stream->buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed for trace ring buffer\n");
+        goto fail;
+    }
 
-    // Display final statistics
-    clearScreen();
-    printf("Memory Hierarchy Simulation Complete\n");
-    printf("------------------------------------\n\n");
-    printf("Cache Architecture:\n");
-    printf("------------------\n");
-    printf("  Cache Policy: Inclusive (L2 contains all entries in L1)\n");
-    printf("  L1 Cache: %d sets, %d-byte lines (%d words per line)\n", L1_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
-    printf("  L2 Cache: %d sets, %d-byte lines (%d words per line)\n\n", L2_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->notEmpty, NULL);
+    pthread_cond_init(&stream->notFull, NULL);
+    if (pthread_create(&stream->reader, NULL, traceReaderThread, stream) != 0) {
+        fprintf(stderr, "Cannot start trace reader thread\n");
+        pthread_mutex_destroy(&stream->lock);
+        pthread_cond_destroy(&stream->notEmpty);
+        pthread_cond_destroy(&stream->notFull);
+        goto fail;
+    }
+    return 0;
 
-    printf("Simulation Results:\n");
-    printf("------------------\n");
-    printf("Total memory accesses: %d\n\n", numAccesses);
+fail:
+    // Closing the pipe ends the decompressor, which must still be reaped
+    free(stream->buffer);
+    fclose(stream->input);
+    if (stream->decompressor > 0) waitpid(stream->decompressor, NULL, 0);
+    return 1;
+}
 
-    printf("L1 Cache Statistics:\n");
-    printf("  Hits: %d (%.2f%%)\n", l1Hits, l1HitRatio * 100);
-    printf("  Misses: %d (%.2f%%)\n\n", l1Misses, (1 - l1HitRatio) * 100);
+// Hand back the previous chunk and wait for the next one, returns 0 at the end of the trace
+size_t nextTraceStreamChunk(TraceStream *stream, const TraceRecord **records) {
+    size_t n = 0;
 
-    printf("L2 Cache Statistics:\n");
-    printf("  Hits: %d (%.2f%%)\n", l2Hits, l2HitRatio * 100);
-    printf("  Misses: %d (%.2f%%)\n\n", l2Misses, (1 - l2HitRatio) * 100);
+    pthread_mutex_lock(&stream->lock);
+    if (stream->held) {
+        stream->head = (stream->head + 1) % TRACE_RING_SLOTS;
+        stream->filled--;
+        stream->held = false;
+        pthread_cond_signal(&stream->notFull);
+    }
+    while (stream->filled == 0 && !stream->finished) {
+        pthread_cond_wait(&stream->notEmpty, &stream->lock);
+    }
+    if (stream->filled > 0) {
+        stream->held = true;
+        *records = stream->buffer + (size_t)stream->head * TRACE_CHUNK_RECORDS;
+        n = stream->slotCount[stream->head];
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return n;
+}
 
-    printf("Performance Metrics:\n");
-    printf("  Total Cycle Cost: %ld cycles\n", totalCycles);
-    printf("  Average Memory Access Time (AMAT): %.2f cycles\n\n", amat);
+// Stop the reader and release the stream. Returns 0 if the whole trace was read: a read
+// error or a decompressor that failed (missing, or on a truncated or corrupt file) returns 1
+int closeTraceStream(TraceStream *stream, const char *path) {
+    pthread_mutex_lock(&stream->lock);
+    // A consumer that stops before the end closes the pipe under a still running decompressor
+    bool complete = stream->finished && stream->filled == 0;
+    stream->stop = true;
+    pthread_cond_broadcast(&stream->notFull);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+
+    int status = 0;
+    fclose(stream->input);
+    if (complete) {
+        status = reapDecompressor(stream, path);
+    } else if (stream->decompressor > 0) {
+        waitpid(stream->decompressor, NULL, 0);
+    }
+    if (stream->readError) {
+        fprintf(stderr, "Failed reading trace '%s'\n", path);
+        status = 1;
+    }
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->notEmpty);
+    pthread_cond_destroy(&stream->notFull);
+    free(stream->buffer);
 
-    // Display hit address summary
-    if (hitCount > 0) {
-        displayHitSummary(hitInfoArray, hitCount);
-    } else {
-        printf("No cache hits recorded during this simulation.\n");
+    if (stream->badLines > 0) {
+        fprintf(stderr, "Skipped %ld malformed trace lines\n", stream->badLines);
     }
+    return status;
+}
 
-    // Free allocated memory
-    free(addresses);
-    free(hitInfoArray);
-     printf("\n===============================================\n");
-    printf("Direct Mapping analysis complete.\n");
-    printf("Press Enter to return to main menu...");
-    getchar();
-    getchar();
+// True if the file starts with the binary trace magic
+bool isBinaryTrace(const char *path) {
+    char magic[8];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    bool binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                  memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return binary;
 }
 
 
-//-- functions for fully associative mapping--
 
 
-// Function to initialize fully associative cache
-void initializeFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size) {
-    for (int i = 0; i < size; i++) {
-        cache[i].valid = false;
-        cache[i].tag = -1;
-        cache[i].address = 0;
-        cache[i].lru_counter = 0;
-    }
-}
 
-// Check if address is in fully associative cache
-bool checkFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size, unsigned int address, int *tag, int *way) {
-    *tag = address / (WORDS_PER_LINE * WORD_SIZE);
-    for (int i = 0; i < size; i++) {
-        if (cache[i].valid && cache[i].tag == *tag) {
-            *way = i;
-            return true;
+//-- functions for direct mapping--
+
+
+// Count one occurrence of 'block': a monitored block gains one, otherwise it replaces the
+// least counted block and inherits its count as the error bound
+void addHotBlock(HotBlockSketch *sketch, uint64_t block) {
+    int least = 0;
+    for (int i = 0; i < sketch->used; i++) {
+        if (sketch->blocks[i].block == block) {
+            sketch->blocks[i].count++;
+            return;
         }
+        if (sketch->blocks[i].count < sketch->blocks[least].count) least = i;
     }
+    if (sketch->used < HOT_BLOCKS) {
+        sketch->blocks[sketch->used++] = (HotBlock){ block, 1, 0 };
+    } else {
+        long floor = sketch->blocks[least].count;
+        sketch->blocks[least] = (HotBlock){ block, floor + 1, floor };
+    }
+}
 
-    return false;
+static int compareHotBlocks(const void *a, const void *b) {
+    long x = ((const HotBlock *)a)->count, y = ((const HotBlock *)b)->count;
+    return (x < y) - (x > y);
 }
 
-// Update LRU counters for fully associative cache
-void updateFullyAssociativeLRU(FullyAssociativeCacheLine *cache, int size, int accessedWay) {
+// The monitored blocks of a sketch, hottest first; returns how many there are
+int sortHotBlocks(const HotBlockSketch *sketch, HotBlock *sorted) {
+    memcpy(sorted, sketch->blocks, sketch->used * sizeof(HotBlock));
+    qsort(sorted, sketch->used, sizeof(HotBlock), compareHotBlocks);
+    return sketch->used;
+}
 
-    for (int i = 0; i < size; i++) {
-        if (cache[i].valid) {
-            cache[i].lru_counter++;
-        }
-    }
+// Returns 0 on success
+int initSetCounters(SetCounters *counters, Arena *arena, int sets) {
+    counters->sets = sets;
+    counters->hits = (long *)arenaCalloc(arena, sets, sizeof(long));
+    counters->misses = (long *)arenaCalloc(arena, sets, sizeof(long));
+    return counters->hits == NULL || counters->misses == NULL;
+}
 
-    // Reset counter
-    cache[accessedWay].lru_counter = 0;
+static inline void countSetAccess(SetCounters *counters, uint64_t block, bool hit) {
+    int set = (int)(block % (uint64_t)counters->sets);
+    if (hit) counters->hits[set]++;
+    else counters->misses[set]++;
 }
 
-// Find the least recently used way in fully associative cache
-int findFullyAssociativeLRU(FullyAssociativeCacheLine *cache, int size) {
-    int lruWay = 0;
-    int maxCounter = -1;
+// Per set counters for an L1 and an L2 with the given numbers of sets, returns 0 on success
+int initHitStats(HitStats *stats, Arena *arena, int l1Sets, int l2Sets) {
+    memset(stats, 0, sizeof(*stats));
+    return initSetCounters(&stats->levels[0], arena, l1Sets) != 0 ||
+           initSetCounters(&stats->levels[1], arena, l2Sets) != 0;
+}
 
-    for (int i = 0; i < size; i++) {
+// Count one access served by 'level': 1 for L1, 2 for L2, 0 for main memory
+static inline void recordAccess(HitStats *stats, uint64_t address, int level) {
+    uint64_t block = address / BLOCK_SIZE;
 
-        if (!cache[i].valid) {
-            return i;
+    stats->accesses++;
+    countSetAccess(&stats->levels[0], block, level == 1);
+    if (level != 1) countSetAccess(&stats->levels[1], block, level == 2);
+    if (level > 0) {
+        stats->hits++;
+        addHotBlock(&stats->hot[level - 1], block);
+    }
+}
+
+// The blocks each level of an interactive simulation served most often
+void displayHotBlocks(const HitStats *stats) {
+    printf("Hottest blocks (space-saving estimate, %d counters per level):\n", HOT_BLOCKS);
+    printf("Address  | Cache | TAG  | SET  | Hits\n");
+    printf("-------- | ----- | ---- | ---- | ----\n");
+    for (int level = 0; level < 2; level++) {
+        HotBlock sorted[HOT_BLOCKS];
+        int count = sortHotBlocks(&stats->hot[level], sorted);
+        int sets = stats->levels[level].sets;
+        for (int i = 0; i < count; i++) {
+            uint64_t block = sorted[i].block;
+            printf("0x%04" PRIX64 "   | L%d    | 0x%02" PRIX64 " | 0x%02X | %ld", block * BLOCK_SIZE, level + 1,
+                   block / sets, (unsigned int)(block % sets), sorted[i].count);
+            if (sorted[i].error > 0) printf(" (at least %ld)", sorted[i].count - sorted[i].error);
+            printf("\n");
         }
+    }
+}
 
-        if (cache[i].lru_counter > maxCounter) {
-            maxCounter = cache[i].lru_counter;
-            lruWay = i;
+// Display summary of the hits: per set of each level, and the hottest blocks
+void displayHitSummary(const HitStats *stats) {
+    printf("Summary of Cache Hits (%ld hits in %ld accesses)\n", stats->hits, stats->accesses);
+    printf("---------------------------------------------------\n");
+    for (int level = 0; level < 2; level++) {
+        const SetCounters *counters = &stats->levels[level];
+        printf("L%d hits/misses per set:\n", level + 1);
+        for (int set = 0; set < counters->sets; set++) {
+            printf("  0x%02X %4ld/%-4ld", set, counters->hits[set], counters->misses[set]);
+            if (set % 6 == 5 || set == counters->sets - 1) printf("\n");
         }
     }
+    printf("\n");
+    displayHotBlocks(stats);
+    printf("\n");
+}
 
-    return lruWay;
+// Initialize cache with invalid lines
+void initializeCache(CacheLine *cache, int size) {
+    for (int i = 0; i < size; i++) {
+        cache[i].valid = false;
+        cache[i].dirty = false;
+        cache[i].tag = 0;
+        cache[i].address = 0;
+    }
 }
 
-// Update fully associative cache with new address
-void updateFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size, int way, int tag, unsigned int address) {
-    cache[way].valid = true;
-    cache[way].tag = tag;
-    cache[way].address = address;
-    updateFullyAssociativeLRU(cache, size, way);
+// Check if an address is in the cache
+// cacheSize must be a power of two
+bool checkCache(CacheLine *cache, int cacheSize, uint64_t address, uint64_t *tag, int *index) {
+    uint64_t block = address >> BLOCK_OFFSET_BITS;
+    *index = (int)(block & (uint64_t)(cacheSize - 1));
+    *tag = block >> __builtin_ctz(cacheSize);
+
+    return (cache[*index].valid && cache[*index].tag == *tag);
 }
 
-// Display the contents of the fully associative cache
-void displayFullyAssociativeCacheContents(FullyAssociativeCacheLine *cache, int size, const char *cacheName) {
-    int displayLimit = size;
+// Update cache with new address
+void updateCache(CacheLine *cache, int index, uint64_t tag, uint64_t address) {
+    cache[index].valid = true;
+    cache[index].tag = tag;
+    cache[index].address = address;
+}
 
-    printf("%s Contents (showing first %d entries):\n", cacheName, displayLimit);
-    printf("ENTRY | Valid | TAG  | Address  | LRU | Word Offset\n");
-    printf("----- | ----- | ---- | -------- | --- | -----------\n");
 
+// Display  cache content
+void displayCacheContents(CacheLine *cache, int size, const char *cacheName) {
+    int displayLimit = size;
+
+printf("%s Contents (showing first %d lines):\n", cacheName, displayLimit);
+    printf("SET(idx) | Valid | TAG  | Address  | Word Offset\n");
+    printf("-------- | ----- | ---- | -------- | -----------\n");
     for (int i = 0; i < displayLimit; i++) {
         if (cache[i].valid) {
-            printf("0x%02X |   %d   | 0x%02X | 0x%04X   | %3d | 0x%01X\n",
+            printf("   0x%01X   |   %d   | 0x%02" PRIX64 " | 0x%04" PRIX64 "   | 0x%01X\n",
                 i, cache[i].valid, cache[i].tag, cache[i].address,
-                cache[i].lru_counter, (cache[i].address / WORD_SIZE) % WORDS_PER_LINE);
+                (unsigned int)((cache[i].address / WORD_SIZE) % WORDS_PER_LINE));
         } else {
-            printf("0x%02X |   %d   | ---  | -------- | --- | ---\n", i, cache[i].valid);
+            printf("   0x%01X   |   %d   | ---  | -------- | ---\n", i, cache[i].valid);
         }
     }
 
     if (size > displayLimit) {
-        printf("... and %d more entries (not shown)\n", size - displayLimit);
+        printf("... and %d more sets (not shown)\n", size - displayLimit);
     }
     printf("\n");
 }
 
-// Print address breakdown for fully associative cache
-void printFullyAssociativeAddressBreakdown(unsigned int address) {
-    unsigned int tag = address / (WORDS_PER_LINE * WORD_SIZE);
-    unsigned int word_offset = (address / WORD_SIZE) % WORDS_PER_LINE;
+
+// Print detailed address breakdown with TAG, SET, WORD
+void printAddressBreakdown(uint64_t address) {
+    uint64_t l1_tag = address/(L1_SIZE * WORDS_PER_LINE * WORD_SIZE);
+    unsigned int l1_set = (address/(WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE;
+    uint64_t l2_tag = address/(L2_SIZE * WORDS_PER_LINE * WORD_SIZE);
+    unsigned int l2_set = (address/(WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE;
+    unsigned int word_offset = (address/WORD_SIZE) % WORDS_PER_LINE;
     unsigned int byte_offset = address % WORD_SIZE;
 
-    printf("Address Breakdown (0x%04X):\n", address);
+    printf("Address Breakdown (0x%04" PRIX64 "):\n", address);
     printf("----------------------------------------\n");
-    printf("Memory Architecture (Fully Associative):\n");
+    printf("Memory Architecture:\n");
     printf("- Word Size: %d bytes\n", WORD_SIZE);
     printf("- Words per Cache Line: %d words\n", WORDS_PER_LINE);
-    printf("- Cache Line Size: %d bytes\n", WORD_SIZE * WORDS_PER_LINE);
-    printf("- L1: Fully associative (%d entries)\n", L1_SIZE);
-    printf("- L2: Fully associative (%d entries)\n\n", L2_SIZE);
+    printf("- Cache Line Size: %d bytes\n\n", WORD_SIZE * WORDS_PER_LINE);
 
     printf("Binary breakdown: ");
-
     for (int i = 15; i >= 0; i--) {
         int bit = (address >> i) & 1;
-
+        if (i == 7) printf(" | ");
         if (i == 4) printf(" | ");
         if (i == 2) printf(" | ");
-
         printf("%d", bit);
     }
-    printf("\n                        TAG       │  WORD  │  BYTE \n\n");
+    printf("\n                  TAG | SET | WORD | BYTE\n\n");
 
-    printf("L1 & L2 Cache Mapping (Fully Associative):\n");
-    printf("  TAG: 0x%03X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
-           tag, word_offset, byte_offset);
+    printf("L1 Cache Mapping:\n");
+    printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
+           l1_tag, l1_set, word_offset, byte_offset);
+
+    printf("L2 Cache Mapping:\n");
+    printf("  TAG: 0x%01" PRIX64 "  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
+           l2_tag, l2_set, word_offset, byte_offset);
 }
 
-// Main function for fully associative cache simulation
-int cacheSimulationFullyAssociative(int t) {
-    srand(time(NULL));
+
+// Clear the console screen
+void clearScreen() {
+    #ifdef _WIN32
+        system("cls");
+    #else
+        system("clear");
+    #endif
+}
+
+
+int cacheSimulation(int t){
 
     int numAccesses;
     int i;
+
+    // Statistics variables
     int l1Hits = 0, l1Misses = 0;
     int l2Hits = 0, l2Misses = 0;
-    long totalCycles = 0;
+    long totalCycles = 0;  // Use long for potential large values
 
-    // Create cache structures for fully associative caches
-    FullyAssociativeCacheLine l1Cache[L1_SIZE];
-    FullyAssociativeCacheLine l2Cache[L2_SIZE];
+    // Create cache structures
+    CacheLine l1Cache[L1_SIZE];
+    CacheLine l2Cache[L2_SIZE];
 
     // Initialize caches
-    initializeFullyAssociativeCache(l1Cache, L1_SIZE);
-    initializeFullyAssociativeCache(l2Cache, L2_SIZE);
+    initializeCache(l1Cache, L1_SIZE);
+    initializeCache(l2Cache, L2_SIZE);
 
-    // User input
-    printf("Memory Hierarchy Simulator (Fully Associative) with TAG/OFFSET Breakdown\n");
+ // User input
+    printf("Memory Hierarchy Simulator (Direct Mapping) with TAG/SET/WORD Breakdown\n");
     printf("-------------------------------------------------------------------\n");
-    printf("L1 Cache: Fully associative with %d entries\n", L1_SIZE);
-    printf("L2 Cache: Fully associative with %d entries\n", L2_SIZE);
     printf("Enter the number of memory access attempts to simulate: ");
     scanf("%d", &numAccesses);
 
-    // Allocate memory for addresses
-    unsigned int *addresses = (unsigned int *)malloc(numAccesses * sizeof(unsigned int));
-    if (addresses == NULL) {
-        printf("Memory allocation failed. Exiting...\n");
-        return 1;
-    }
-
-    // Create array to store hit information
-    HitInfo *hitInfoArray = (HitInfo *)malloc(numAccesses * sizeof(HitInfo));
-    if (hitInfoArray == NULL) {
+    // Hits and misses per set, aggregated as the accesses stream by
+    HitStats hits;
+    resetArena(&interactiveArena);
+    if (initHitStats(&hits, &interactiveArena, L1_SIZE, L2_SIZE) != 0) {
         printf("Memory allocation failed. Exiting...\n");
-        free(addresses);
         return 1;
     }
-    int hitCount = 0;
-
-    // Generate random addresses
-    generateAddresses(addresses, numAccesses);
 
+    // Random addresses are generated one access at a time
+    SyntheticTrace gen;
+    unsigned int seed = interactiveSeed();
+    initSyntheticTrace(&gen, PATTERN_RANDOM, seed, ADDRESS_SPACE);
     // Simulate memory accesses
     for (i = 0; i < numAccesses; i++) {
-        unsigned int address = addresses[i];
-        int tag, way;
+        uint64_t address = nextSyntheticAddress(&gen);
+        uint64_t tag;
+        int index;
         bool l1Hit, l2Hit;
 
-        if(t==1){
-             clearScreen();
 
-        printf("Memory Access #%d (Fully Associative)\n", i + 1);
-        printf("----------------------------------\n");
-        printf("Accessing address: 0x%04X\n\n", address);
+        if(t==1){
+            clearScreen();
 
-        // Print address breakdown
-        printFullyAssociativeAddressBreakdown(address);
+        printf("Memory Access #%d\n", i + 1);
+        printf("------------------\n");
+        printf("Accessing address: 0x%04" PRIX64 "\n\n", address);
+
+        // Print address breakdown with TAG/SET/WORD
+        printAddressBreakdown(address);
 
         }
 
-        // Check L1 Cache - in fully associative, we search all entries
-        l1Hit = checkFullyAssociativeCache(l1Cache, L1_SIZE, address, &tag, &way);
-if(t==1)  animateCheckL1();
+        // Check L1 Cache
+        l1Hit = checkCache(l1Cache, L1_SIZE, address, &tag, &index);
+      if(t==1)  animateCheckL1();
         if (l1Hit) {
             // L1 Cache hit
             l1Hits++;
             totalCycles += L1_ACCESS_COST;
 
             // Record hit information
-            hitInfoArray[hitCount].address = address;
-            hitInfoArray[hitCount].cache_level = 1;  // L1 hit
-            hitCount++;
-
+            recordAccess(&hits, address, 1);
 
             if(t==1){
-                 printf("L1 CACHE HIT!\n");
-            printf("  TAG: 0x%03X  ENTRY: 0x%02X  WORD: 0x%01X\n",
-                   tag, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+                printf("L1 CACHE HIT!\n");
+            printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01" PRIX64 "  WORD: 0x%01" PRIX64 "\n",
+                   address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE),
+                   (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
+                   (address / WORD_SIZE) % WORDS_PER_LINE);
             printf("Access cost: %d cycles\n\n", L1_ACCESS_COST);
 
-            }
-
-            // Update LRU counters
-            updateFullyAssociativeLRU(l1Cache, L1_SIZE, way);
-
-            if(t==1){
-
-                displayFullyAssociativeCacheContents(l1Cache, L1_SIZE, "L1 Cache");
-            if (hitCount > 0) {
-                displayHitSummary(hitInfoArray, hitCount);
+            displayCacheContents(l1Cache, L1_SIZE, "L1 Cache");
+            if (hits.hits > 0) {
+                displayHitSummary(&hits);
             } else {
                 printf("No cache hits recorded during this simulation.\n");
             }
 
             printf("\nPress Enter to continue to next memory access...");
             while (getchar() != '\n'); // Clear input buffer
-            getchar(); // Wait for user input
-
-            }
-
+            getchar();
+            } // Wait for user input
         } else {
             // L1 Cache miss
             l1Misses++;
+
+
             if(t==1){
-                 printf("L1 CACHE MISS!\n");
-            printf("  Attempted to find TAG: 0x%03X in fully associative L1\n", tag);
-           usleep(500000);
+                printf("L1 CACHE MISS!\n");
 
+           printf("  Attempted to find TAG: 0x%02" PRIX64 " in SET: 0x%01" PRIX64 "\n",
+                   address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE),
+                   (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE);
+
+            // Check L2 Cache
+          usleep(500000);
             }
 
 
-            // Check L2 Cache - search all entries
-            l2Hit = checkFullyAssociativeCache(l2Cache, L2_SIZE, address, &tag, &way);
-if(t==1)  animateCheckL2();
+            l2Hit = checkCache(l2Cache, L2_SIZE, address, &tag, &index);
+         if(t==1)   animateCheckL2();
             if (l2Hit) {
                 // L2 Cache hit
                 l2Hits++;
                 totalCycles += L2_ACCESS_COST;
 
                 // Record hit information
-                hitInfoArray[hitCount].address = address;
-                hitInfoArray[hitCount].cache_level = 2;  // L2 hit
-                hitCount++;
+                recordAccess(&hits, address, 2);
+
 
                 if(t==1){
 
                 printf("\nL2 CACHE HIT!\n");
-                printf("  TAG: 0x%03X  ENTRY: 0x%02X  WORD: 0x%01X\n",
-                       tag, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+                printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01" PRIX64 "  WORD: 0x%01" PRIX64 "\n",
+                       address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE),
+                       (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE,
+                       (address / WORD_SIZE) % WORDS_PER_LINE);
                 printf("Access cost: %d cycles\n", L2_ACCESS_COST);
 
-                }
-                // Update LRU counters for L2
-                updateFullyAssociativeLRU(l2Cache, L2_SIZE, way);
-
-                // Find location in L1 to place this data
-                int l1Way = findFullyAssociativeLRU(l1Cache, L1_SIZE);
-
-                // Update L1 Cache (tag is the same for fully associative)
-                updateFullyAssociativeCache(l1Cache, L1_SIZE, l1Way, tag, address);
-
-               if(t==1){
-                 printf("Data loaded from L2 to L1 (placed in entry 0x%02X)\n\n", l1Way);
+                // Update L1 Cache
+                updateCache(l1Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
+                           address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
+                printf("Data loaded from L2 to L1\n\n");
 
-                displayFullyAssociativeCacheContents(l2Cache, L2_SIZE, "L2 Cache");
-                if (hitCount > 0) {
-                    displayHitSummary(hitInfoArray, hitCount);
+                displayCacheContents(l2Cache, L2_SIZE, "L2 Cache");
+                if (hits.hits > 0) {
+                    displayHitSummary(&hits);
                 } else {
                     printf("No cache hits recorded during this simulation.\n");
                 }
 
                 printf("\nPress Enter to continue to next memory access...");
-                while (getchar() != '\n'); // Clear input buffer
+               while (getchar() != '\n'); // Clear input buffer
                 getchar(); // Wait for user input
-               }
+                }
+
             } else {
                 // L2 Cache miss
                 l2Misses++;
+                recordAccess(&hits, address, 0);
                 totalCycles += MEMORY_ACCESS_COST;
+
+
                 if(t==1){
+                      printf("L2 CACHE MISS!\n");
 
-                printf("\nL2 CACHE MISS!\n");
-                printf("  Attempted to find TAG: 0x%03X in fully associative L2\n", tag);
+                printf("  Attempted to find TAG: 0x%02" PRIX64 " in SET: 0x%01" PRIX64 "\n",
+                       address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE),
+                       (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE);
 
-                if(t==1)  animateCheckMM();
-                printf("Access cost: %d cycles\n", MEMORY_ACCESS_COST);
-                }
 
-                // Find locations in L1 and L2 to place this data
-                int l1Way = findFullyAssociativeLRU(l1Cache, L1_SIZE);
-                int l2Way = findFullyAssociativeLRU(l2Cache, L2_SIZE);
+                animateCheckMM();
 
-                // Update L1 and L2 Caches (inclusive cache policy)
-                updateFullyAssociativeCache(l1Cache, L1_SIZE, l1Way, tag, address);
-                updateFullyAssociativeCache(l2Cache, L2_SIZE, l2Way, tag, address);
 
-              if(t==1){
-                  printf("Data loaded from Main Memory to L1 (entry 0x%02X) and L2 (entry 0x%02X)\n\n",
-                       l1Way, l2Way);
+                printf("Access cost: %d cycles\n", MEMORY_ACCESS_COST);
+
+                }
+                // Update L1 and L2 Caches (non-inclusive: L2 evictions do not back-invalidate L1)
+                updateCache(l1Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE,
+                           address / (L1_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
+                updateCache(l2Cache, (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE,
+                           address / (L2_SIZE * WORDS_PER_LINE * WORD_SIZE), address);
+                           if(t==1){
+                printf("Data loaded from Main Memory to L1 and L2.\n\n");
 
                 // Display cache contents after update
-                displayFullyAssociativeCacheContents(l1Cache, L1_SIZE, "L1 Cache");
-                displayFullyAssociativeCacheContents(l2Cache, L2_SIZE, "L2 Cache");
+                displayCacheContents(l1Cache, L1_SIZE, "L1 Cache");
+                displayCacheContents(l2Cache, L2_SIZE, "L2 Cache");
 
                 printf("\nPress Enter to continue to next memory access...");
                 while (getchar() != '\n'); // Clear input buffer
                 getchar(); // Wait for user input
-              }
+
+                }
+
             }
         }
     }
@@ -826,17 +1510,15 @@ if(t==1)  animateCheckL2();
 
     // Display final statistics
     clearScreen();
-    printf("Memory Hierarchy Simulation Complete (Fully Associative)\n");
-    printf("----------------------------------------------------\n\n");
+    printf("Memory Hierarchy Simulation Complete\n");
+    printf("------------------------------------\n\n");
     printf("Cache Architecture:\n");
     printf("------------------\n");
-    printf("  Cache Policy: Inclusive (L2 contains all entries in L1)\n");
-    printf("  L1 Cache: Fully associative with %d entries, %d-byte lines (%d words per line)\n",
-           L1_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
-    printf("  L2 Cache: Fully associative with %d entries, %d-byte lines (%d words per line)\n\n",
-           L2_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+    printf("  Cache Policy: Non-inclusive (misses fill L1 and L2, L2 evictions leave L1 alone)\n");
+    printf("  L1 Cache: %d sets, %d-byte lines (%d words per line)\n", L1_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+    printf("  L2 Cache: %d sets, %d-byte lines (%d words per line)\n\n", L2_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
 
-    printf("Simulation Results:\n");
+    printf("Simulation Results (seed %u):\n", seed);
     printf("------------------\n");
     printf("Total memory accesses: %d\n\n", numAccesses);
 
@@ -853,53 +1535,40 @@ if(t==1)  animateCheckL2();
     printf("  Average Memory Access Time (AMAT): %.2f cycles\n\n", amat);
 
     // Display hit address summary
-    if (hitCount > 0) {
-        displayHitSummary(hitInfoArray, hitCount);
+    if (hits.hits > 0) {
+        displayHitSummary(&hits);
     } else {
         printf("No cache hits recorded during this simulation.\n");
     }
 
-    // Free allocated memory
-    free(addresses);
-    free(hitInfoArray);
-    printf("\n===============================================\n");
-    printf("Fully Associative Mapping analysis complete.\n");
+     printf("\n===============================================\n");
+    printf("Direct Mapping analysis complete.\n");
     printf("Press Enter to return to main menu...");
     getchar();
     getchar();
-    return 0;
 }
 
 
+//-- functions for fully associative mapping--
 
 
-//-- functions for set associative mapping--
-
-
-// Function to initialize associative cache
-void initializeAssociativeCache(AssociativeCacheLine *cache, int sets, int ways) {
-    for (int i = 0; i < sets; i++) {
-        for (int j = 0; j < ways; j++) {
-            int index = i * ways + j;
-            cache[index].valid = false;
-            cache[index].tag = -1;
-            cache[index].address = 0;
-            cache[index].lru_counter = 0;
-        }
+// Function to initialize fully associative cache
+void initializeFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size) {
+    for (int i = 0; i < size; i++) {
+        cache[i].valid = false;
+        cache[i].dirty = false;
+        cache[i].tag = 0;
+        cache[i].address = 0;
+        cache[i].lru_counter = 0;
     }
 }
 
-// Check if address is in associative cache
-bool checkAssociativeCache(AssociativeCacheLine *cache, int sets, int ways, unsigned int address, int *tag, int *set, int *way) {
-    // Calculate set and tag
-    *set = (address / (WORDS_PER_LINE * WORD_SIZE)) % sets;
-    *tag = address / (sets * WORDS_PER_LINE * WORD_SIZE);
-
-    // Check all ways in the set
-    for (int w = 0; w < ways; w++) {
-        int index = (*set) * ways + w;
-        if (cache[index].valid && cache[index].tag == *tag) {
-            *way = w;
+// Check if address is in fully associative cache
+bool checkFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size, uint64_t address, uint64_t *tag, int *way) {
+    *tag = address >> BLOCK_OFFSET_BITS;
+    for (int i = 0; i < size; i++) {
+        if (cache[i].valid && cache[i].tag == *tag) {
+            *way = i;
             return true;
         }
     }
@@ -907,218 +1576,190 @@ bool checkAssociativeCache(AssociativeCacheLine *cache, int sets, int ways, unsi
     return false;
 }
 
-// Update LRU counters for all ways in a set
-void updateLRUCounters(AssociativeCacheLine *cache, int set, int ways, int accessedWay) {
-    // Increment all counters in the set
-    for (int w = 0; w < ways; w++) {
-        int index = set * ways + w;
-        if (cache[index].valid) {
-            cache[index].lru_counter++;
+// Update LRU counters for fully associative cache
+void updateFullyAssociativeLRU(FullyAssociativeCacheLine *cache, int size, int accessedWay) {
+
+    for (int i = 0; i < size; i++) {
+        if (cache[i].valid) {
+            cache[i].lru_counter++;
         }
     }
 
-    // Reset counter for the accessed way
-    int accessedIndex = set * ways + accessedWay;
-    cache[accessedIndex].lru_counter = 0;
+    // Reset counter
+    cache[accessedWay].lru_counter = 0;
 }
 
-// Find the least recently used way in a set
-int findLRUWay(AssociativeCacheLine *cache, int set, int ways) {
+// Find the least recently used way in fully associative cache
+int findFullyAssociativeLRU(FullyAssociativeCacheLine *cache, int size) {
     int lruWay = 0;
     int maxCounter = -1;
 
-    for (int w = 0; w < ways; w++) {
-        int index = set * ways + w;
+    for (int i = 0; i < size; i++) {
 
-        // If way is invalid, use it immediately
-        if (!cache[index].valid) {
-            return w;
+        if (!cache[i].valid) {
+            return i;
         }
 
-        // Otherwise find the way with highest LRU counter
-        if (cache[index].lru_counter > maxCounter) {
-            maxCounter = cache[index].lru_counter;
-            lruWay = w;
+        if (cache[i].lru_counter > maxCounter) {
+            maxCounter = cache[i].lru_counter;
+            lruWay = i;
         }
     }
 
     return lruWay;
 }
 
-// Update associative cache with new address
-void updateAssociativeCache(AssociativeCacheLine *cache, int set, int way, int ways, int tag, unsigned int address) {
-    int index = set * ways + way;
-    cache[index].valid = true;
-    cache[index].tag = tag;
-    cache[index].address = address;
-
-    // Reset LRU counter for this way and update others
-    updateLRUCounters(cache, set, ways, way);
+// Update fully associative cache with new address
+void updateFullyAssociativeCache(FullyAssociativeCacheLine *cache, int size, int way, uint64_t tag, uint64_t address) {
+    cache[way].valid = true;
+    cache[way].tag = tag;
+    cache[way].address = address;
+    updateFullyAssociativeLRU(cache, size, way);
 }
 
-// Display the contents of the set associative cache
-void displayAssociativeCacheContents(AssociativeCacheLine *cache, int sets, int ways, const char *cacheName) {
-    int displayLimit =  sets ;
+// Display the contents of the fully associative cache
+void displayFullyAssociativeCacheContents(FullyAssociativeCacheLine *cache, int size, const char *cacheName) {
+    int displayLimit = size;
 
-    printf("%s Contents (showing first %d sets):\n", cacheName, displayLimit);
-    printf("SET  | WAY | Valid | TAG  | Address  | LRU | Word Offset\n");
-    printf("----- | --- | ----- | ---- | -------- | --- | -----------\n");
+    printf("%s Contents (showing first %d entries):\n", cacheName, displayLimit);
+    printf("ENTRY | Valid | TAG  | Address  | LRU | Word Offset\n");
+    printf("----- | ----- | ---- | -------- | --- | -----------\n");
 
     for (int i = 0; i < displayLimit; i++) {
-        for (int j = 0; j < ways; j++) {
-            int index = i * ways + j;
-            if (cache[index].valid) {
-                printf("0x%02X | %2d  |   %d   | 0x%02X | 0x%04X   | %3d | 0x%01X\n",
-                    i, j, cache[index].valid, cache[index].tag, cache[index].address,
-                    cache[index].lru_counter, (cache[index].address / WORD_SIZE) % WORDS_PER_LINE);
-            } else {
-                printf("0x%02X | %2d  |   %d   | ---  | -------- | --- | ---\n", i, j, cache[index].valid);
-            }
+        if (cache[i].valid) {
+            printf("0x%02X |   %d   | 0x%02" PRIX64 " | 0x%04" PRIX64 "   | %3d | 0x%01" PRIX64 "\n",
+                i, cache[i].valid, cache[i].tag, cache[i].address,
+                cache[i].lru_counter, (cache[i].address / WORD_SIZE) % WORDS_PER_LINE);
+        } else {
+            printf("0x%02X |   %d   | ---  | -------- | --- | ---\n", i, cache[i].valid);
         }
-        // Add a separator between sets
-        if (i < displayLimit - 1) printf("-----------------------------------------------------\n");
     }
 
-    if (sets > displayLimit) {
-        printf("... and %d more sets (not shown)\n", sets - displayLimit);
+    if (size > displayLimit) {
+        printf("... and %d more entries (not shown)\n", size - displayLimit);
     }
     printf("\n");
 }
 
-// Print address breakdown for set associative cache
-void printAssociativeAddressBreakdown(unsigned int address) {
-    unsigned int l1_tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
-    unsigned int l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-    unsigned int l2_tag = address / (L2_SETS * WORDS_PER_LINE * WORD_SIZE);
-    unsigned int l2_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
+// Print address breakdown for fully associative cache
+void printFullyAssociativeAddressBreakdown(uint64_t address) {
+    uint64_t tag = address / (WORDS_PER_LINE * WORD_SIZE);
     unsigned int word_offset = (address / WORD_SIZE) % WORDS_PER_LINE;
     unsigned int byte_offset = address % WORD_SIZE;
 
-    printf("Address Breakdown (0x%04X):\n", address);
+    printf("Address Breakdown (0x%04" PRIX64 "):\n", address);
     printf("----------------------------------------\n");
-    printf("Memory Architecture (Set Associative):\n");
+    printf("Memory Architecture (Fully Associative):\n");
     printf("- Word Size: %d bytes\n", WORD_SIZE);
     printf("- Words per Cache Line: %d words\n", WORDS_PER_LINE);
     printf("- Cache Line Size: %d bytes\n", WORD_SIZE * WORDS_PER_LINE);
-    printf("- L1: %d-way set associative (%d sets)\n", L1_ASSOCIATIVITY, L1_SETS);
-    printf("- L2: %d-way set associative (%d sets)\n\n", L2_ASSOCIATIVITY, L2_SETS);
+    printf("- L1: Fully associative (%d entries)\n", L1_SIZE);
+    printf("- L2: Fully associative (%d entries)\n\n", L2_SIZE);
 
     printf("Binary breakdown: ");
-    // Show in binary with clear separations between TAG, SET, WORD parts
+
     for (int i = 15; i >= 0; i--) {
         int bit = (address >> i) & 1;
 
-        // Add visual separators based on L1 cache
-        if (i == 8) printf(" | "); // Between tag and set (adjusted for set associative)
-        if (i == 4) printf(" | "); // Between set and word
-        if (i == 2) printf(" | "); // Between word and byte
+        if (i == 4) printf(" | ");
+        if (i == 2) printf(" | ");
 
         printf("%d", bit);
     }
-    printf("\n                  TAG | SET | WORD | BYTE\n\n");
-
-    printf("L1 Cache Mapping (%d-way):\n", L1_ASSOCIATIVITY);
-    printf("  TAG: 0x%02X  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
-           l1_tag, l1_set, word_offset, byte_offset);
+    printf("\n                        TAG       │  WORD  │  BYTE \n\n");
 
-    printf("L2 Cache Mapping (%d-way):\n", L2_ASSOCIATIVITY);
-    printf("  TAG: 0x%01X  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
-           l2_tag, l2_set, word_offset, byte_offset);
+    printf("L1 & L2 Cache Mapping (Fully Associative):\n");
+    printf("  TAG: 0x%03" PRIX64 "  WORD: 0x%01X  BYTE: 0x%01X\n\n",
+           tag, word_offset, byte_offset);
 }
 
-// Main function for set associative cache simulation
-int cacheSimulationSetAssociative(int t) {
-    // Seed random number generator
-    srand(time(NULL));
-
+// Main function for fully associative cache simulation. It steps through the LRU state of
+// each access as it is generated; OPT, which needs the whole pattern ahead, runs in the
+// pattern comparison and in batch mode
+int cacheSimulationFullyAssociative(int t) {
     int numAccesses;
     int i;
-
-    // Statistics variables
     int l1Hits = 0, l1Misses = 0;
     int l2Hits = 0, l2Misses = 0;
-    long totalCycles = 0;  // Use long for potential large values
+    long totalCycles = 0;
 
-    // Create cache structures for set associative caches
-    AssociativeCacheLine l1Cache[L1_SETS * L1_ASSOCIATIVITY];
-    AssociativeCacheLine l2Cache[L2_SETS * L2_ASSOCIATIVITY];
+    // Create cache structures for fully associative caches
+    FullyAssociativeCacheLine l1Cache[L1_SIZE];
+    FullyAssociativeCacheLine l2Cache[L2_SIZE];
 
     // Initialize caches
-    initializeAssociativeCache(l1Cache, L1_SETS, L1_ASSOCIATIVITY);
-    initializeAssociativeCache(l2Cache, L2_SETS, L2_ASSOCIATIVITY);
+    initializeFullyAssociativeCache(l1Cache, L1_SIZE);
+    initializeFullyAssociativeCache(l2Cache, L2_SIZE);
 
     // User input
-    printf("Memory Hierarchy Simulator (Set Associative) with TAG/SET/WORD Breakdown\n");
+    printf("Memory Hierarchy Simulator (Fully Associative) with TAG/OFFSET Breakdown\n");
     printf("-------------------------------------------------------------------\n");
-    printf("L1 Cache: %d-way set associative with %d sets\n", L1_ASSOCIATIVITY, L1_SETS);
-    printf("L2 Cache: %d-way set associative with %d sets\n", L2_ASSOCIATIVITY, L2_SETS);
+    printf("L1 Cache: Fully associative with %d entries\n", L1_SIZE);
+    printf("L2 Cache: Fully associative with %d entries\n", L2_SIZE);
     printf("Enter the number of memory access attempts to simulate: ");
     scanf("%d", &numAccesses);
 
-    // Allocate memory for addresses
-    unsigned int *addresses = (unsigned int *)malloc(numAccesses * sizeof(unsigned int));
-    if (addresses == NULL) {
-        printf("Memory allocation failed. Exiting...\n");
-        return 1;
-    }
 
-    // Create array to store hit information
-    HitInfo *hitInfoArray = (HitInfo *)malloc(numAccesses * sizeof(HitInfo));
-    if (hitInfoArray == NULL) {
+    // Hits and misses per set, aggregated as the accesses stream by
+    HitStats hits;
+    resetArena(&interactiveArena);
+    if (initHitStats(&hits, &interactiveArena, 1, 1) != 0) {
         printf("Memory allocation failed. Exiting...\n");
-        free(addresses);
         return 1;
     }
-    int hitCount = 0;
 
-    // Generate random addresses
-    generateAddresses(addresses, numAccesses);
+    // Random addresses are generated one access at a time
+    SyntheticTrace gen;
+    unsigned int seed = interactiveSeed();
+    initSyntheticTrace(&gen, PATTERN_RANDOM, seed, ADDRESS_SPACE);
 
     // Simulate memory accesses
     for (i = 0; i < numAccesses; i++) {
-        unsigned int address = addresses[i];
-        int tag, set, way;
+        uint64_t address = nextSyntheticAddress(&gen);
+        uint64_t tag;
+        int way;
         bool l1Hit, l2Hit;
 
         if(t==1){
-            clearScreen();
+             clearScreen();
 
-        printf("Memory Access #%d (Set Associative)\n", i + 1);
+        printf("Memory Access #%d (Fully Associative)\n", i + 1);
         printf("----------------------------------\n");
-        printf("Accessing address: 0x%04X\n\n", address);
+        printf("Accessing address: 0x%04" PRIX64 "\n\n", address);
 
-        // Print address breakdown with TAG/SET/WORD
-        printAssociativeAddressBreakdown(address);
+        // Print address breakdown
+        printFullyAssociativeAddressBreakdown(address);
 
         }
 
-        // Check L1 Cache
-        l1Hit = checkAssociativeCache(l1Cache, L1_SETS, L1_ASSOCIATIVITY, address, &tag, &set, &way);
-        if(t==1) animateCheckL1();
+        // Check L1 Cache - in fully associative, we search all entries
+        l1Hit = checkFullyAssociativeCache(l1Cache, L1_SIZE, address, &tag, &way);
+if(t==1)  animateCheckL1();
         if (l1Hit) {
             // L1 Cache hit
             l1Hits++;
             totalCycles += L1_ACCESS_COST;
 
             // Record hit information
-            hitInfoArray[hitCount].address = address;
-            hitInfoArray[hitCount].cache_level = 1;  // L1 hit
-            hitCount++;
+            recordAccess(&hits, address, 1);
 
-           if(t==1){
-             printf("L1 CACHE HIT!\n");
-            printf("  TAG: 0x%02X  SET: 0x%01X  WAY: %d  WORD: 0x%01X\n",
-                   tag, set, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+
+            if(t==1){
+                 printf("L1 CACHE HIT!\n");
+            printf("  TAG: 0x%03" PRIX64 "  ENTRY: 0x%02X  WORD: 0x%01" PRIX64 "\n",
+                   tag, way, (address / WORD_SIZE) % WORDS_PER_LINE);
             printf("Access cost: %d cycles\n\n", L1_ACCESS_COST);
 
-           }
+            }
+
             // Update LRU counters
-            updateLRUCounters(l1Cache, set, L1_ASSOCIATIVITY, way);
+            updateFullyAssociativeLRU(l1Cache, L1_SIZE, way);
 
             if(t==1){
-                displayAssociativeCacheContents(l1Cache, L1_SETS, L1_ASSOCIATIVITY, "L1 Cache");
-            if (hitCount > 0) {
-                displayHitSummary(hitInfoArray, hitCount);
+
+                displayFullyAssociativeCacheContents(l1Cache, L1_SIZE, "L1 Cache");
+            if (hits.hits > 0) {
+                displayHitSummary(&hits);
             } else {
                 printf("No cache hits recorded during this simulation.\n");
             }
@@ -1126,53 +1767,54 @@ int cacheSimulationSetAssociative(int t) {
             printf("\nPress Enter to continue to next memory access...");
             while (getchar() != '\n'); // Clear input buffer
             getchar(); // Wait for user input
+
             }
+
         } else {
             // L1 Cache miss
             l1Misses++;
-
             if(t==1){
-                printf("L1 CACHE MISS!\n");
-            printf("  Attempted to find TAG: 0x%02X in SET: 0x%01X\n",
-                   tag, set);
+                 printf("L1 CACHE MISS!\n");
+            printf("  Attempted to find TAG: 0x%03" PRIX64 " in fully associative L1\n", tag);
+           usleep(500000);
 
             }
-            // Check L2 Cache
-            l2Hit = checkAssociativeCache(l2Cache, L2_SETS, L2_ASSOCIATIVITY, address, &tag, &set, &way);
-            if(t==1) animateCheckL2();
+
+
+            // Check L2 Cache - search all entries
+            l2Hit = checkFullyAssociativeCache(l2Cache, L2_SIZE, address, &tag, &way);
+if(t==1)  animateCheckL2();
             if (l2Hit) {
                 // L2 Cache hit
                 l2Hits++;
                 totalCycles += L2_ACCESS_COST;
 
                 // Record hit information
-                hitInfoArray[hitCount].address = address;
-                hitInfoArray[hitCount].cache_level = 2;  // L2 hit
-                hitCount++;
+                recordAccess(&hits, address, 2);
 
-              if(t==1){
-                  printf("\nL2 CACHE HIT!\n");
-                printf("  TAG: 0x%02X  SET: 0x%01X  WAY: %d  WORD: 0x%01X\n",
-                       tag, set, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+                if(t==1){
+
+                printf("\nL2 CACHE HIT!\n");
+                printf("  TAG: 0x%03" PRIX64 "  ENTRY: 0x%02X  WORD: 0x%01" PRIX64 "\n",
+                       tag, way, (address / WORD_SIZE) % WORDS_PER_LINE);
                 printf("Access cost: %d cycles\n", L2_ACCESS_COST);
-              }
 
+                }
                 // Update LRU counters for L2
-                updateLRUCounters(l2Cache, set, L2_ASSOCIATIVITY, way);
+                updateFullyAssociativeLRU(l2Cache, L2_SIZE, way);
 
-                // Calculate L1 parameters for update
-                int l1Tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l1Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                int l1Way = findLRUWay(l1Cache, l1Set, L1_ASSOCIATIVITY);
+                // Find location in L1 to place this data
+                int l1Way = findFullyAssociativeLRU(l1Cache, L1_SIZE);
+
+                // Update L1 Cache (tag is the same for fully associative)
+                updateFullyAssociativeCache(l1Cache, L1_SIZE, l1Way, tag, address);
 
-                // Update L1 Cache
-                updateAssociativeCache(l1Cache, l1Set, l1Way, L1_ASSOCIATIVITY, l1Tag, address);
                if(t==1){
-                 printf("Data loaded from L2 to L1 (placed in set 0x%01X, way %d)\n\n", l1Set, l1Way);
+                 printf("Data loaded from L2 to L1 (placed in entry 0x%02X)\n\n", l1Way);
 
-                displayAssociativeCacheContents(l2Cache, L2_SETS, L2_ASSOCIATIVITY, "L2 Cache");
-                if (hitCount > 0) {
-                    displayHitSummary(hitInfoArray, hitCount);
+                displayFullyAssociativeCacheContents(l2Cache, L2_SIZE, "L2 Cache");
+                if (hits.hits > 0) {
+                    displayHitSummary(&hits);
                 } else {
                     printf("No cache hits recorded during this simulation.\n");
                 }
@@ -1184,388 +1826,5001 @@ int cacheSimulationSetAssociative(int t) {
             } else {
                 // L2 Cache miss
                 l2Misses++;
+                recordAccess(&hits, address, 0);
                 totalCycles += MEMORY_ACCESS_COST;
+                if(t==1){
 
-             if(t==1){
-                   printf("\nL2 CACHE MISS!\n");
-                printf("  Attempted to find TAG: 0x%02X in SET: 0x%01X\n",
-                       tag, set);
-                printf("ACCESSING MAIN MEMORY...\n");
+                printf("\nL2 CACHE MISS!\n");
+                printf("  Attempted to find TAG: 0x%03" PRIX64 " in fully associative L2\n", tag);
+
+                if(t==1)  animateCheckMM();
                 printf("Access cost: %d cycles\n", MEMORY_ACCESS_COST);
-             }
+                }
 
-                // Calculate L1 parameters for update
-                int l1Tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l1Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                int l1Way = findLRUWay(l1Cache, l1Set, L1_ASSOCIATIVITY);
+                // Find locations in L1 and L2 to place this data
+                int l1Way = findFullyAssociativeLRU(l1Cache, L1_SIZE);
+                int l2Way = findFullyAssociativeLRU(l2Cache, L2_SIZE);
 
-                // Calculate L2 parameters for update
-                int l2Tag = address / (L2_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l2Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
-                int l2Way = findLRUWay(l2Cache, l2Set, L2_ASSOCIATIVITY);
+                // Update L1 and L2 Caches (non-inclusive: L2 evictions do not back-invalidate L1)
+                updateFullyAssociativeCache(l1Cache, L1_SIZE, l1Way, tag, address);
+                updateFullyAssociativeCache(l2Cache, L2_SIZE, l2Way, tag, address);
 
-                // Update L1 and L2 Caches (inclusive cache policy)
-                updateAssociativeCache(l1Cache, l1Set, l1Way, L1_ASSOCIATIVITY, l1Tag, address);
-                updateAssociativeCache(l2Cache, l2Set, l2Way, L2_ASSOCIATIVITY, l2Tag, address);
-                if(t==1){
+              if(t==1){
+                  printf("Data loaded from Main Memory to L1 (entry 0x%02X) and L2 (entry 0x%02X)\n\n",
+                       l1Way, l2Way);
+
+                // Display cache contents after update
+                displayFullyAssociativeCacheContents(l1Cache, L1_SIZE, "L1 Cache");
+                displayFullyAssociativeCacheContents(l2Cache, L2_SIZE, "L2 Cache");
+
+                printf("\nPress Enter to continue to next memory access...");
+                while (getchar() != '\n'); // Clear input buffer
+                getchar(); // Wait for user input
+              }
+            }
+        }
+    }
+
+    // Calculate final statistics
+    float l1HitRatio = (float)l1Hits / numAccesses;
+    float l2HitRatio = (l1Misses > 0) ? (float)l2Hits / l1Misses : 0;
+    float amat = L1_ACCESS_COST + (1 - l1HitRatio) * (L2_ACCESS_COST + (1 - l2HitRatio) * MEMORY_ACCESS_COST);
+
+    // Display final statistics
+    clearScreen();
+    printf("Memory Hierarchy Simulation Complete (Fully Associative)\n");
+    printf("----------------------------------------------------\n\n");
+    printf("Cache Architecture:\n");
+    printf("------------------\n");
+    printf("  Cache Policy: Non-inclusive (misses fill L1 and L2, L2 evictions leave L1 alone)\n");
+    printf("  L1 Cache: Fully associative with %d entries, %d-byte lines (%d words per line)\n",
+           L1_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+    printf("  L2 Cache: Fully associative with %d entries, %d-byte lines (%d words per line)\n\n",
+           L2_SIZE, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+
+    printf("Simulation Results (seed %u):\n", seed);
+    printf("------------------\n");
+    printf("Total memory accesses: %d\n\n", numAccesses);
+
+    printf("L1 Cache Statistics:\n");
+    printf("  Hits: %d (%.2f%%)\n", l1Hits, l1HitRatio * 100);
+    printf("  Misses: %d (%.2f%%)\n\n", l1Misses, (1 - l1HitRatio) * 100);
+
+    printf("L2 Cache Statistics:\n");
+    printf("  Hits: %d (%.2f%%)\n", l2Hits, l2HitRatio * 100);
+    printf("  Misses: %d (%.2f%%)\n\n", l2Misses, (1 - l2HitRatio) * 100);
+
+    printf("Performance Metrics:\n");
+    printf("  Total Cycle Cost: %ld cycles\n", totalCycles);
+    printf("  Average Memory Access Time (AMAT): %.2f cycles\n\n", amat);
+
+    // Display hit address summary
+    if (hits.hits > 0) {
+        displayHitSummary(&hits);
+    } else {
+        printf("No cache hits recorded during this simulation.\n");
+    }
+
+    printf("\n===============================================\n");
+    printf("Fully Associative Mapping analysis complete.\n");
+    printf("Press Enter to return to main menu...");
+    getchar();
+    getchar();
+    return 0;
+}
+
+
+
+
+// O(1) LRU fully associative cache, same hits and misses as the LRU counter version
+
+// Per-line flags of the batch caches, packed 64 lines to a word
+static inline size_t lineBitWords(size_t lines) {
+    return (lines + 63) / 64;
+}
+
+static inline bool lineBit(const uint64_t *bits, size_t line) {
+    return (bits[line >> 6] >> (line & 63)) & 1;
+}
+
+static inline void assignLineBit(uint64_t *bits, size_t line, bool value) {
+    uint64_t mask = 1ULL << (line & 63);
+    bits[line >> 6] = value ? (bits[line >> 6] | mask) : (bits[line >> 6] & ~mask);
+}
+
+void freeLRUCache(LRUFullyAssociativeCache *cache) {
+    arenaFree(cache->arena, cache->lines);
+    arenaFree(cache->arena, cache->dirty);
+    arenaFree(cache->arena, cache->buckets);
+    cache->lines = NULL;
+    cache->dirty = NULL;
+    cache->buckets = NULL;
+}
+
+// Allocate an empty cache with 'size' lines, returns 0 on success
+int initializeLRUCache(LRUFullyAssociativeCache *cache, int size, Arena *arena) {
+    int buckets = 2, bucketBits = 1;
+    while (buckets < 4 * size) {  // Load factor at most 1/4 keeps probe chains short
+        buckets <<= 1;
+        bucketBits++;
+    }
+
+    cache->arena = arena;
+    cache->lines = (LRUCacheNode *)arenaAlloc(arena, (size_t)size * sizeof(LRUCacheNode));
+    cache->dirty = (uint64_t *)arenaCalloc(arena, lineBitWords(size), sizeof(uint64_t));
+    cache->buckets = (int *)arenaAlloc(arena, (size_t)buckets * sizeof(int));
+    if (cache->lines == NULL || cache->dirty == NULL || cache->buckets == NULL) {
+        freeLRUCache(cache);
+        return 1;
+    }
+
+    for (int i = 0; i < size; i++) {
+        cache->lines[i].tag = POLICY_TAG_INVALID;
+        cache->lines[i].prev = cache->lines[i].next = -1;
+    }
+    for (int b = 0; b < buckets; b++) {
+        cache->buckets[b] = -1;
+    }
+    cache->bucketMask = buckets - 1;
+    cache->bucketShift = 64 - bucketBits;
+    cache->size = size;
+    cache->used = 0;
+    cache->head = cache->tail = -1;
+    return 0;
+}
+
+static inline int lruHomeBucket(const LRUFullyAssociativeCache *cache, uint64_t tag) {
+    return (int)((tag * 0x9E3779B97F4A7C15ULL) >> cache->bucketShift);
+}
+
+// Find the line holding 'tag', -1 if it is not cached
+static inline int lookupLRUCache(const LRUFullyAssociativeCache *cache, uint64_t tag) {
+    for (int b = lruHomeBucket(cache, tag); cache->buckets[b] >= 0; b = (b + 1) & cache->bucketMask) {
+        if (cache->lines[cache->buckets[b]].tag == tag) {
+            return cache->buckets[b];
+        }
+    }
+    return -1;
+}
+
+// Remove 'tag' from the hash table, shifting later entries back so no tombstones are needed
+static void removeLRUCacheTag(LRUFullyAssociativeCache *cache, uint64_t tag) {
+    int mask = cache->bucketMask;
+    int hole = lruHomeBucket(cache, tag);
+
+    while (cache->lines[cache->buckets[hole]].tag != tag) {
+        hole = (hole + 1) & mask;
+    }
+
+    for (int b = (hole + 1) & mask; cache->buckets[b] >= 0; b = (b + 1) & mask) {
+        int home = lruHomeBucket(cache, cache->lines[cache->buckets[b]].tag);
+        // Move the entry into the hole unless its home lies cyclically in (hole, b]
+        bool stays = (hole <= b) ? (home > hole && home <= b) : (home > hole || home <= b);
+        if (!stays) {
+            cache->buckets[hole] = cache->buckets[b];
+            hole = b;
+        }
+    }
+    cache->buckets[hole] = -1;
+}
+
+static inline void unlinkLRUCacheLine(LRUFullyAssociativeCache *cache, int line) {
+    LRUCacheNode *node = &cache->lines[line];
+    if (node->prev >= 0) cache->lines[node->prev].next = node->next;
+    else cache->head = node->next;
+    if (node->next >= 0) cache->lines[node->next].prev = node->prev;
+    else cache->tail = node->prev;
+}
+
+static inline void pushLRUCacheHead(LRUFullyAssociativeCache *cache, int line) {
+    LRUCacheNode *node = &cache->lines[line];
+    node->prev = -1;
+    node->next = cache->head;
+    if (cache->head >= 0) cache->lines[cache->head].prev = line;
+    cache->head = line;
+    if (cache->tail < 0) cache->tail = line;
+}
+
+// Mark a line as most recently used
+static inline void touchLRUCache(LRUFullyAssociativeCache *cache, int line) {
+    if (cache->head == line) return;
+    unlinkLRUCacheLine(cache, line);
+    pushLRUCacheHead(cache, line);
+}
+
+// Place a block in an invalid line, or in the LRU line once the cache is full; the line is clean
+static inline int insertLRUCache(LRUFullyAssociativeCache *cache, uint64_t tag) {
+    int line;
+
+    if (cache->used < cache->size) {
+        line = cache->used++;
+    } else {
+        line = cache->tail;  // Invalidated lines wait at the tail
+        if (cache->lines[line].tag != POLICY_TAG_INVALID) removeLRUCacheTag(cache, cache->lines[line].tag);
+        unlinkLRUCacheLine(cache, line);
+    }
+
+    cache->lines[line].tag = tag;
+    assignLineBit(cache->dirty, line, false);
+    pushLRUCacheHead(cache, line);
+
+    int b = lruHomeBucket(cache, tag);
+    while (cache->buckets[b] >= 0) b = (b + 1) & cache->bucketMask;
+    cache->buckets[b] = line;
+    return line;
+}
+
+// Drop a line, it moves to the tail so the next insertion reuses it
+static inline void invalidateLRUCache(LRUFullyAssociativeCache *cache, int line) {
+    removeLRUCacheTag(cache, cache->lines[line].tag);
+    cache->lines[line].tag = POLICY_TAG_INVALID;
+    assignLineBit(cache->dirty, line, false);
+    if (cache->tail == line) return;
+    unlinkLRUCacheLine(cache, line);
+    LRUCacheNode *node = &cache->lines[line];
+    node->next = -1;
+    node->prev = cache->tail;
+    if (cache->tail >= 0) cache->lines[cache->tail].next = line;
+    cache->tail = line;
+    if (cache->head < 0) cache->head = line;
+}
+
+
+
+
+//-- functions for set associative mapping--
+
+
+// Function to initialize associative cache
+void initializeAssociativeCache(AssociativeCacheLine *cache, int sets, int ways) {
+    for (int i = 0; i < sets; i++) {
+        for (int j = 0; j < ways; j++) {
+            int index = i * ways + j;
+            cache[index].valid = false;
+            cache[index].dirty = false;
+            cache[index].tag = 0;
+            cache[index].address = 0;
+            cache[index].lru_counter = 0;
+        }
+    }
+}
+
+// Check if address is in associative cache
+// sets must be a power of two
+bool checkAssociativeCache(AssociativeCacheLine *cache, int sets, int ways, uint64_t address, uint64_t *tag, int *set, int *way) {
+    // Calculate set and tag
+    uint64_t block = address >> BLOCK_OFFSET_BITS;
+    *set = (int)(block & (uint64_t)(sets - 1));
+    *tag = block >> __builtin_ctz(sets);
+
+    // Check all ways in the set
+    for (int w = 0; w < ways; w++) {
+        int index = (*set) * ways + w;
+        if (cache[index].valid && cache[index].tag == *tag) {
+            *way = w;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Update LRU counters for all ways in a set
+void updateLRUCounters(AssociativeCacheLine *cache, int set, int ways, int accessedWay) {
+    // Increment all counters in the set
+    for (int w = 0; w < ways; w++) {
+        int index = set * ways + w;
+        if (cache[index].valid) {
+            cache[index].lru_counter++;
+        }
+    }
+
+    // Reset counter for the accessed way
+    int accessedIndex = set * ways + accessedWay;
+    cache[accessedIndex].lru_counter = 0;
+}
+
+// Find the least recently used way in a set
+int findLRUWay(AssociativeCacheLine *cache, int set, int ways) {
+    int lruWay = 0;
+    int maxCounter = -1;
+
+    for (int w = 0; w < ways; w++) {
+        int index = set * ways + w;
+
+        // If way is invalid, use it immediately
+        if (!cache[index].valid) {
+            return w;
+        }
+
+        // Otherwise find the way with highest LRU counter
+        if (cache[index].lru_counter > maxCounter) {
+            maxCounter = cache[index].lru_counter;
+            lruWay = w;
+        }
+    }
+
+    return lruWay;
+}
+
+// Update associative cache with new address
+void updateAssociativeCache(AssociativeCacheLine *cache, int set, int way, int ways, uint64_t tag, uint64_t address) {
+    int index = set * ways + way;
+    cache[index].valid = true;
+    cache[index].tag = tag;
+    cache[index].address = address;
+
+    // Reset LRU counter for this way and update others
+    updateLRUCounters(cache, set, ways, way);
+}
+
+// Display the contents of the set associative cache
+void displayAssociativeCacheContents(AssociativeCacheLine *cache, int sets, int ways, const char *cacheName) {
+    int displayLimit =  sets ;
+
+    printf("%s Contents (showing first %d sets):\n", cacheName, displayLimit);
+    printf("SET  | WAY | Valid | TAG  | Address  | LRU | Word Offset\n");
+    printf("----- | --- | ----- | ---- | -------- | --- | -----------\n");
+
+    for (int i = 0; i < displayLimit; i++) {
+        for (int j = 0; j < ways; j++) {
+            int index = i * ways + j;
+            if (cache[index].valid) {
+                printf("0x%02X | %2d  |   %d   | 0x%02" PRIX64 " | 0x%04" PRIX64 "   | %3d | 0x%01" PRIX64 "\n",
+                    i, j, cache[index].valid, cache[index].tag, cache[index].address,
+                    cache[index].lru_counter, (cache[index].address / WORD_SIZE) % WORDS_PER_LINE);
+            } else {
+                printf("0x%02X | %2d  |   %d   | ---  | -------- | --- | ---\n", i, j, cache[index].valid);
+            }
+        }
+        // Add a separator between sets
+        if (i < displayLimit - 1) printf("-----------------------------------------------------\n");
+    }
+
+    if (sets > displayLimit) {
+        printf("... and %d more sets (not shown)\n", sets - displayLimit);
+    }
+    printf("\n");
+}
+
+// Print address breakdown for set associative cache
+void printAssociativeAddressBreakdown(uint64_t address) {
+    uint64_t l1_tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
+    unsigned int l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
+    uint64_t l2_tag = address / (L2_SETS * WORDS_PER_LINE * WORD_SIZE);
+    unsigned int l2_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
+    unsigned int word_offset = (address / WORD_SIZE) % WORDS_PER_LINE;
+    unsigned int byte_offset = address % WORD_SIZE;
+
+    printf("Address Breakdown (0x%04" PRIX64 "):\n", address);
+    printf("----------------------------------------\n");
+    printf("Memory Architecture (Set Associative):\n");
+    printf("- Word Size: %d bytes\n", WORD_SIZE);
+    printf("- Words per Cache Line: %d words\n", WORDS_PER_LINE);
+    printf("- Cache Line Size: %d bytes\n", WORD_SIZE * WORDS_PER_LINE);
+    printf("- L1: %d-way set associative (%d sets)\n", L1_ASSOCIATIVITY, L1_SETS);
+    printf("- L2: %d-way set associative (%d sets)\n\n", L2_ASSOCIATIVITY, L2_SETS);
+
+    printf("Binary breakdown: ");
+    // Show in binary with clear separations between TAG, SET, WORD parts
+    for (int i = 15; i >= 0; i--) {
+        int bit = (address >> i) & 1;
+
+        // Add visual separators based on L1 cache
+        if (i == 8) printf(" | "); // Between tag and set (adjusted for set associative)
+        if (i == 4) printf(" | "); // Between set and word
+        if (i == 2) printf(" | "); // Between word and byte
+
+        printf("%d", bit);
+    }
+    printf("\n                  TAG | SET | WORD | BYTE\n\n");
+
+    printf("L1 Cache Mapping (%d-way):\n", L1_ASSOCIATIVITY);
+    printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
+           l1_tag, l1_set, word_offset, byte_offset);
+
+    printf("L2 Cache Mapping (%d-way):\n", L2_ASSOCIATIVITY);
+    printf("  TAG: 0x%01" PRIX64 "  SET: 0x%01X  WORD: 0x%01X  BYTE: 0x%01X\n\n",
+           l2_tag, l2_set, word_offset, byte_offset);
+}
+
+// Main function for set associative cache simulation, an LRU step-through like the fully
+// associative one
+int cacheSimulationSetAssociative(int t) {
+
+    int numAccesses;
+    int i;
+
+    // Statistics variables
+    int l1Hits = 0, l1Misses = 0;
+    int l2Hits = 0, l2Misses = 0;
+    long totalCycles = 0;  // Use long for potential large values
+
+    // Create cache structures for set associative caches
+    AssociativeCacheLine l1Cache[L1_SETS * L1_ASSOCIATIVITY];
+    AssociativeCacheLine l2Cache[L2_SETS * L2_ASSOCIATIVITY];
+
+    // Initialize caches
+    initializeAssociativeCache(l1Cache, L1_SETS, L1_ASSOCIATIVITY);
+    initializeAssociativeCache(l2Cache, L2_SETS, L2_ASSOCIATIVITY);
+
+    // User input
+    printf("Memory Hierarchy Simulator (Set Associative) with TAG/SET/WORD Breakdown\n");
+    printf("-------------------------------------------------------------------\n");
+    printf("L1 Cache: %d-way set associative with %d sets\n", L1_ASSOCIATIVITY, L1_SETS);
+    printf("L2 Cache: %d-way set associative with %d sets\n", L2_ASSOCIATIVITY, L2_SETS);
+    printf("Enter the number of memory access attempts to simulate: ");
+    scanf("%d", &numAccesses);
+
+
+    // Hits and misses per set, aggregated as the accesses stream by
+    HitStats hits;
+    resetArena(&interactiveArena);
+    if (initHitStats(&hits, &interactiveArena, L1_SETS, L2_SETS) != 0) {
+        printf("Memory allocation failed. Exiting...\n");
+        return 1;
+    }
+
+    // Random addresses are generated one access at a time
+    SyntheticTrace gen;
+    unsigned int seed = interactiveSeed();
+    initSyntheticTrace(&gen, PATTERN_RANDOM, seed, ADDRESS_SPACE);
+
+    // Simulate memory accesses
+    for (i = 0; i < numAccesses; i++) {
+        uint64_t address = nextSyntheticAddress(&gen);
+        uint64_t tag;
+        int set, way;
+        bool l1Hit, l2Hit;
+
+        if(t==1){
+            clearScreen();
+
+        printf("Memory Access #%d (Set Associative)\n", i + 1);
+        printf("----------------------------------\n");
+        printf("Accessing address: 0x%04" PRIX64 "\n\n", address);
+
+        // Print address breakdown with TAG/SET/WORD
+        printAssociativeAddressBreakdown(address);
+
+        }
+
+        // Check L1 Cache
+        l1Hit = checkAssociativeCache(l1Cache, L1_SETS, L1_ASSOCIATIVITY, address, &tag, &set, &way);
+        if(t==1) animateCheckL1();
+        if (l1Hit) {
+            // L1 Cache hit
+            l1Hits++;
+            totalCycles += L1_ACCESS_COST;
+
+            // Record hit information
+            recordAccess(&hits, address, 1);
+
+           if(t==1){
+             printf("L1 CACHE HIT!\n");
+            printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01X  WAY: %d  WORD: 0x%01" PRIX64 "\n",
+                   tag, set, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+            printf("Access cost: %d cycles\n\n", L1_ACCESS_COST);
+
+           }
+            // Update LRU counters
+            updateLRUCounters(l1Cache, set, L1_ASSOCIATIVITY, way);
+
+            if(t==1){
+                displayAssociativeCacheContents(l1Cache, L1_SETS, L1_ASSOCIATIVITY, "L1 Cache");
+            if (hits.hits > 0) {
+                displayHitSummary(&hits);
+            } else {
+                printf("No cache hits recorded during this simulation.\n");
+            }
+
+            printf("\nPress Enter to continue to next memory access...");
+            while (getchar() != '\n'); // Clear input buffer
+            getchar(); // Wait for user input
+            }
+        } else {
+            // L1 Cache miss
+            l1Misses++;
+
+            if(t==1){
+                printf("L1 CACHE MISS!\n");
+            printf("  Attempted to find TAG: 0x%02" PRIX64 " in SET: 0x%01X\n",
+                   tag, set);
+
+            }
+            // Check L2 Cache
+            l2Hit = checkAssociativeCache(l2Cache, L2_SETS, L2_ASSOCIATIVITY, address, &tag, &set, &way);
+            if(t==1) animateCheckL2();
+            if (l2Hit) {
+                // L2 Cache hit
+                l2Hits++;
+                totalCycles += L2_ACCESS_COST;
+
+                // Record hit information
+                recordAccess(&hits, address, 2);
+
+              if(t==1){
+                  printf("\nL2 CACHE HIT!\n");
+                printf("  TAG: 0x%02" PRIX64 "  SET: 0x%01X  WAY: %d  WORD: 0x%01" PRIX64 "\n",
+                       tag, set, way, (address / WORD_SIZE) % WORDS_PER_LINE);
+                printf("Access cost: %d cycles\n", L2_ACCESS_COST);
+              }
+
+                // Update LRU counters for L2
+                updateLRUCounters(l2Cache, set, L2_ASSOCIATIVITY, way);
+
+                // Calculate L1 parameters for update
+                uint64_t l1Tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
+                int l1Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
+                int l1Way = findLRUWay(l1Cache, l1Set, L1_ASSOCIATIVITY);
+
+                // Update L1 Cache
+                updateAssociativeCache(l1Cache, l1Set, l1Way, L1_ASSOCIATIVITY, l1Tag, address);
+               if(t==1){
+                 printf("Data loaded from L2 to L1 (placed in set 0x%01X, way %d)\n\n", l1Set, l1Way);
+
+                displayAssociativeCacheContents(l2Cache, L2_SETS, L2_ASSOCIATIVITY, "L2 Cache");
+                if (hits.hits > 0) {
+                    displayHitSummary(&hits);
+                } else {
+                    printf("No cache hits recorded during this simulation.\n");
+                }
+
+                printf("\nPress Enter to continue to next memory access...");
+                while (getchar() != '\n'); // Clear input buffer
+                getchar(); // Wait for user input
+               }
+            } else {
+                // L2 Cache miss
+                l2Misses++;
+                recordAccess(&hits, address, 0);
+                totalCycles += MEMORY_ACCESS_COST;
+
+             if(t==1){
+                   printf("\nL2 CACHE MISS!\n");
+                printf("  Attempted to find TAG: 0x%02" PRIX64 " in SET: 0x%01X\n",
+                       tag, set);
+                printf("ACCESSING MAIN MEMORY...\n");
+                printf("Access cost: %d cycles\n", MEMORY_ACCESS_COST);
+             }
+
+                // Calculate L1 parameters for update
+                uint64_t l1Tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
+                int l1Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
+                int l1Way = findLRUWay(l1Cache, l1Set, L1_ASSOCIATIVITY);
+
+                // Calculate L2 parameters for update
+                uint64_t l2Tag = address / (L2_SETS * WORDS_PER_LINE * WORD_SIZE);
+                int l2Set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
+                int l2Way = findLRUWay(l2Cache, l2Set, L2_ASSOCIATIVITY);
+
+                // Update L1 and L2 Caches (non-inclusive: L2 evictions do not back-invalidate L1)
+                updateAssociativeCache(l1Cache, l1Set, l1Way, L1_ASSOCIATIVITY, l1Tag, address);
+                updateAssociativeCache(l2Cache, l2Set, l2Way, L2_ASSOCIATIVITY, l2Tag, address);
+                if(t==1){
+
+                printf("Data loaded from Main Memory to L1 (set 0x%01X, way %d) and L2 (set 0x%01X, way %d)\n\n",
+                       l1Set, l1Way, l2Set, l2Way);
+
+                // Display cache contents after update
+                displayAssociativeCacheContents(l1Cache, L1_SETS, L1_ASSOCIATIVITY, "L1 Cache");
+                displayAssociativeCacheContents(l2Cache, L2_SETS, L2_ASSOCIATIVITY, "L2 Cache");
+
+                printf("\nPress Enter to continue to next memory access...");
+               while (getchar() != '\n'); // Clear input buffer
+               getchar(); // Wait for user input
+                }
+            }
+        }
+    }
+
+    // Calculate final statistics
+    float l1HitRatio = (float)l1Hits / numAccesses;
+    float l2HitRatio = (l1Misses > 0) ? (float)l2Hits / l1Misses : 0;
+    float amat = L1_ACCESS_COST + (1 - l1HitRatio) * (L2_ACCESS_COST + (1 - l2HitRatio) * MEMORY_ACCESS_COST);
+
+    // Display final statistics
+    clearScreen();
+    printf("Memory Hierarchy Simulation Complete (Set Associative)\n");
+    printf("---------------------------------------------------\n\n");
+    printf("Cache Architecture:\n");
+    printf("------------------\n");
+    printf("  Cache Policy: Non-inclusive (misses fill L1 and L2, L2 evictions leave L1 alone)\n");
+    printf("  L1 Cache: %d-way set associative with %d sets, %d-byte lines (%d words per line)\n",
+           L1_ASSOCIATIVITY, L1_SETS, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+    printf("  L2 Cache: %d-way set associative with %d sets, %d-byte lines (%d words per line)\n\n",
+           L2_ASSOCIATIVITY, L2_SETS, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+
+    printf("Simulation Results (seed %u):\n", seed);
+    printf("------------------\n");
+    printf("Total memory accesses: %d\n\n", numAccesses);
+
+    printf("L1 Cache Statistics:\n");
+    printf("  Hits: %d (%.2f%%)\n", l1Hits, l1HitRatio * 100);
+    printf("  Misses: %d (%.2f%%)\n\n", l1Misses, (1 - l1HitRatio) * 100);
+
+    printf("L2 Cache Statistics:\n");
+    printf("  Hits: %d (%.2f%%)\n", l2Hits, l2HitRatio * 100);
+    printf("  Misses: %d (%.2f%%)\n\n", l2Misses, (1 - l2HitRatio) * 100);
+
+    printf("Performance Metrics:\n");
+    printf("  Total Cycle Cost: %ld cycles\n", totalCycles);
+    printf("  Average Memory Access Time (AMAT): %.2f cycles\n\n", amat);
+
+    // Display hit address summary
+    if (hits.hits > 0) {
+        displayHitSummary(&hits);
+    } else {
+        printf("No cache hits recorded during this simulation.\n");
+    }
+
+  printf("\n===============================================\n");
+    printf("Set Associative Mapping analysis complete.\n");
+    printf("Press Enter to return to main menu...");
+    getchar();
+    getchar();
+    return 0;
+}
+
+
+
+
+
+
+//-- replacement policies--
+
+
+typedef enum {
+    POLICY_LRU,
+    POLICY_PLRU,     // Tree pseudo-LRU, one bit per internal node
+    POLICY_SRRIP,    // Static re-reference interval prediction, 2-bit RRPV
+    POLICY_BRRIP,    // Bimodal RRIP: most fills predicted distant
+    POLICY_RANDOM,
+    POLICY_FIFO,
+    POLICY_OPT,      // Belady's MIN, offline: needs the next use of every access
+    POLICY_COUNT
+} ReplacementPolicy;
+
+static const char *policyNames[] = { "lru", "plru", "srrip", "brrip", "random", "fifo", "opt" };
+
+#define OPT_NEVER LONG_MAX   // Next use of a line that is not accessed again
+
+#define RRPV_MAX 3           // 2-bit re-reference prediction values
+#define BRRIP_LONG_FILLS 32  // BRRIP inserts 1 in 32 fills at RRPV_MAX - 1
+
+#define POLICY_LRU_MAX_WAYS 256        // LRU ranks the ways of a set in one byte each
+
+// Set associative cache with a selectable replacement policy; a fully associative cache is
+// one set. The lines are stored as separate arrays, so a lookup only reads the packed tags,
+// and hold no address: a line's block number is its tag * sets + set
+typedef struct {
+    ReplacementPolicy policy;
+    int sets;
+    int ways;
+    uint64_t *tags;      // Per line: the tag, POLICY_TAG_INVALID while the way is invalid
+    uint64_t *dirty;     // Per line, packed 64 lines to a word
+    uint8_t *state;      // Per line: LRU recency rank (0 = most recent) or RRPV
+    uint8_t *plruTree;   // Per set, ways - 1 nodes in heap order (node 1 is the root)
+    int *fifoNext;       // Per set, way filled next once the set is full
+    int *filled;         // Per set, ways filled so far; invalid ways are filled in order
+    int *holes;          // Per set, filled ways invalidated since (back-invalidation, exclusive moves)
+    int *buckets;        // Tag -> way hash of a single-set (fully associative) cache, else NULL
+    int bucketMask;
+    int bucketShift;
+    uint32_t random;     // xorshift state for random and BRRIP
+    long nextUse;        // OPT: next use of the line being accessed, set before each access
+    long now;            // OPT: trace position of the access, keys before it have gone stale
+    const long *traceNextUse;  // OPT: next use of every trace record, to refresh stale keys
+    long *optKey;        // OPT: per line, next use when it was last accessed
+    int *optHeap;        // OPT: per set, max-heap of ways by optKey (the victim on top)
+    int *optHeapPos;     // OPT: per line, its position in the set's heap
+    Arena *arena;        // Owner of the arrays, NULL for the heap
+} PolicyCache;
+
+// Open addressing map from line number to a position in the trace
+typedef struct {
+    uint64_t *keys;
+    long *values;        // -1 marks an empty slot
+    long capacity;       // Power of two
+    long count;
+    Arena *arena;        // Owner of the arrays, NULL for the heap
+} LineMap;
+
+void freeLineMap(LineMap *map) {
+    arenaFree(map->arena, map->keys);
+    arenaFree(map->arena, map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+// Returns 0 on success
+int initLineMap(LineMap *map, long capacity, Arena *arena) {
+    map->arena = arena;
+    map->keys = (uint64_t *)arenaAlloc(arena, capacity * sizeof(uint64_t));
+    map->values = (long *)arenaAlloc(arena, capacity * sizeof(long));
+    map->capacity = capacity;
+    map->count = 0;
+    if (map->keys == NULL || map->values == NULL) {
+        freeLineMap(map);
+        return 1;
+    }
+    for (long i = 0; i < capacity; i++) map->values[i] = -1;
+    return 0;
+}
+
+// Slot a line hashes to, where its probe starts
+static inline long lineMapHome(const LineMap *map, uint64_t line) {
+    return (long)((line * 0x9E3779B97F4A7C15ULL) >> 20) & (map->capacity - 1);
+}
+
+// Slot of 'line', or of the empty slot where it belongs
+static inline long findLineMapSlot(const LineMap *map, uint64_t line) {
+    long b = lineMapHome(map, line);
+    while (map->values[b] >= 0 && map->keys[b] != line) {
+        b = (b + 1) & (map->capacity - 1);
+    }
+    return b;
+}
+
+// Store 'value' for 'line', doubling the map once it is half full; returns 0 on success
+static inline int setLineMap(LineMap *map, long slot, uint64_t line, long value) {
+    if (map->values[slot] < 0) {
+        map->keys[slot] = line;
+        map->count++;
+    }
+    map->values[slot] = value;
+    if (2 * map->count <= map->capacity) return 0;
+
+    LineMap grown;
+    if (initLineMap(&grown, map->capacity * 2, map->arena) != 0) return 1;
+    for (long i = 0; i < map->capacity; i++) {
+        if (map->values[i] < 0) continue;
+        long b = findLineMapSlot(&grown, map->keys[i]);
+        grown.keys[b] = map->keys[i];
+        grown.values[b] = map->values[i];
+    }
+    grown.count = map->count;
+    freeLineMap(map);
+    *map = grown;
+    return 0;
+}
+
+// Empty 'slot', shifting back the entries probed past it so every lookup still finds its line
+static void removeLineMap(LineMap *map, long slot) {
+    long mask = map->capacity - 1;
+    long hole = slot;
+    for (long b = (slot + 1) & mask; map->values[b] >= 0; b = (b + 1) & mask) {
+        long home = lineMapHome(map, map->keys[b]);
+        if (((b - home) & mask) < ((b - hole) & mask)) continue;  // The hole lies before its home
+        map->keys[hole] = map->keys[b];
+        map->values[hole] = map->values[b];
+        hole = b;
+    }
+    map->values[hole] = -1;
+    map->count--;
+}
+
+static void clearLineMap(LineMap *map) {
+    for (long i = 0; i < map->capacity; i++) map->values[i] = -1;
+    map->count = 0;
+}
+
+// Lines a simulator remembers for a while (lost to another core, evicted by a prefetch), bounded
+// by what a cache could still hold: once 'limit' lines are recorded the older generation is
+// dropped, so between 'limit' and 2 * 'limit' of the latest lines are kept
+typedef struct {
+    LineMap current;
+    LineMap previous;
+    long limit;
+} LineWindow;
+
+void freeLineWindow(LineWindow *window) {
+    freeLineMap(&window->current);
+    freeLineMap(&window->previous);
+    window->limit = 0;
+}
+
+// Returns 0 on success
+int initLineWindow(LineWindow *window, long limit, Arena *arena) {
+    memset(window, 0, sizeof(*window));
+    window->limit = (limit > 0) ? limit : 1;
+    if (initLineMap(&window->current, 1024, arena) != 0 || initLineMap(&window->previous, 1024, arena) != 0) {
+        freeLineWindow(window);
+        return 1;
+    }
+    return 0;
+}
+
+// Value recorded for 'line', which is forgotten; -1 if it is not in the window
+static inline long takeLineWindow(LineWindow *window, uint64_t line) {
+    LineMap *maps[2] = { &window->current, &window->previous };
+    for (int m = 0; m < 2; m++) {
+        long slot = findLineMapSlot(maps[m], line);
+        long value = maps[m]->values[slot];
+        if (value < 0) continue;
+        removeLineMap(maps[m], slot);
+        return value;
+    }
+    return -1;
+}
+
+// Record 'value' for 'line'; returns 0 on success
+static inline int putLineWindow(LineWindow *window, uint64_t line, long value) {
+    takeLineWindow(window, line);
+    if (setLineMap(&window->current, findLineMapSlot(&window->current, line), line, value) != 0) return 1;
+    if (window->current.count < window->limit) return 0;
+    LineMap older = window->previous;
+    window->previous = window->current;
+    window->current = older;
+    clearLineMap(&window->current);
+    return 0;
+}
+
+// Next access to the same line for every record, from one backward pass over the
+// trace; OPT_NEVER if the line is not used again. The index comes from 'arena' (the heap
+// when NULL), the map of lines seen is freed on return. Returns NULL on allocation failure.
+long *buildNextUseIndex(const TraceRecord *records, size_t count, int lineSize, Arena *arena) {
+    long *nextUse = (long *)arenaAlloc(arena, (count ? count : 1) * sizeof(long));
+    LineMap seen;
+    if (nextUse == NULL || initLineMap(&seen, 1024, NULL) != 0) {
+        arenaFree(arena, nextUse);
+        return NULL;
+    }
+
+    for (size_t i = count; i-- > 0; ) {
+        uint64_t line = traceAddress(records[i]) / (uint64_t)lineSize;
+        long slot = findLineMapSlot(&seen, line);
+        nextUse[i] = (seen.values[slot] >= 0) ? seen.values[slot] : OPT_NEVER;
+        if (setLineMap(&seen, slot, line, (long)i) != 0) {
+            arenaFree(arena, nextUse);
+            nextUse = NULL;
+            break;
+        }
+    }
+
+    freeLineMap(&seen);
+    return nextUse;
+}
+
+// Parse a policy name, returns -1 if unknown
+int parseReplacementPolicy(const char *name) {
+    for (int p = 0; p < POLICY_COUNT; p++) {
+        if (strcmp(name, policyNames[p]) == 0) return p;
+    }
+    return -1;
+}
+
+void freePolicyCache(PolicyCache *cache) {
+    arenaFree(cache->arena, cache->tags);
+    arenaFree(cache->arena, cache->dirty);
+    arenaFree(cache->arena, cache->state);
+    arenaFree(cache->arena, cache->plruTree);
+    arenaFree(cache->arena, cache->fifoNext);
+    arenaFree(cache->arena, cache->filled);
+    arenaFree(cache->arena, cache->holes);
+    arenaFree(cache->arena, cache->buckets);
+    arenaFree(cache->arena, cache->optKey);
+    arenaFree(cache->arena, cache->optHeap);
+    arenaFree(cache->arena, cache->optHeapPos);
+    cache->optKey = NULL;
+    cache->optHeap = cache->optHeapPos = NULL;
+    cache->tags = NULL;
+    cache->dirty = NULL;
+    cache->state = NULL;
+    cache->plruTree = NULL;
+    cache->fifoNext = NULL;
+    cache->filled = NULL;
+    cache->holes = NULL;
+    cache->buckets = NULL;
+}
+
+// Allocate an empty cache, returns 0 on success; tree-PLRU needs a power-of-two way count
+int initPolicyCache(PolicyCache *cache, ReplacementPolicy policy, int sets, int ways, Arena *arena) {
+    memset(cache, 0, sizeof(*cache));
+    cache->arena = arena;
+    cache->policy = policy;
+    cache->sets = sets;
+    cache->ways = ways;
+    cache->random = 0x9E3779B9u;
+    cache->tags = (uint64_t *)arenaAlloc(arena, (size_t)sets * ways * sizeof(uint64_t));
+    cache->dirty = (uint64_t *)arenaCalloc(arena, lineBitWords((size_t)sets * ways), sizeof(uint64_t));
+    cache->state = (uint8_t *)arenaCalloc(arena, (size_t)sets * ways, sizeof(uint8_t));
+    cache->plruTree = (uint8_t *)arenaCalloc(arena, (size_t)sets * ways, sizeof(uint8_t));
+    cache->fifoNext = (int *)arenaCalloc(arena, sets, sizeof(int));
+    cache->filled = (int *)arenaCalloc(arena, sets, sizeof(int));
+    cache->holes = (int *)arenaCalloc(arena, sets, sizeof(int));
+    if (cache->tags == NULL || cache->dirty == NULL || cache->state == NULL || cache->plruTree == NULL ||
+        cache->fifoNext == NULL || cache->filled == NULL || cache->holes == NULL) {
+        freePolicyCache(cache);
+        return 1;
+    }
+    for (size_t i = 0; i < (size_t)sets * ways; i++) {
+        cache->tags[i] = POLICY_TAG_INVALID;
+        // LRU ranks start as a permutation of the ways; with more ways than a byte ranks
+        // (fully associative, other policies) the state is RRPV or unused
+        cache->state[i] = (uint8_t)(i % ways);
+    }
+
+    if (policy == POLICY_OPT) {
+        cache->optKey = (long *)arenaAlloc(arena, (size_t)sets * ways * sizeof(long));
+        cache->optHeap = (int *)arenaAlloc(arena, (size_t)sets * ways * sizeof(int));
+        cache->optHeapPos = (int *)arenaAlloc(arena, (size_t)sets * ways * sizeof(int));
+        if (cache->optKey == NULL || cache->optHeap == NULL || cache->optHeapPos == NULL) {
+            freePolicyCache(cache);
+            return 1;
+        }
+    }
+
+    // A single set is searched through a hash table, as in the O(1) LRU cache
+    if (sets == 1) {
+        int buckets = 2, bucketBits = 1;
+        while (buckets < 4 * ways) {
+            buckets <<= 1;
+            bucketBits++;
+        }
+        cache->buckets = (int *)arenaAlloc(arena, (size_t)buckets * sizeof(int));
+        if (cache->buckets == NULL) {
+            freePolicyCache(cache);
+            return 1;
+        }
+        for (int b = 0; b < buckets; b++) {
+            cache->buckets[b] = -1;
+        }
+        cache->bucketMask = buckets - 1;
+        cache->bucketShift = 64 - bucketBits;
+    }
+    return 0;
+}
+
+static inline int policyHomeBucket(const PolicyCache *cache, uint64_t tag) {
+    return (int)((tag * 0x9E3779B97F4A7C15ULL) >> cache->bucketShift);
+}
+
+// Remove 'tag' from the hash table with backward-shift deletion, see removeLRUCacheTag
+static void removePolicyTag(PolicyCache *cache, uint64_t tag) {
+    int mask = cache->bucketMask;
+    int hole = policyHomeBucket(cache, tag);
+
+    while (cache->tags[cache->buckets[hole]] != tag) {
+        hole = (hole + 1) & mask;
+    }
+
+    for (int b = (hole + 1) & mask; cache->buckets[b] >= 0; b = (b + 1) & mask) {
+        int home = policyHomeBucket(cache, cache->tags[cache->buckets[b]]);
+        bool stays = (hole <= b) ? (home > hole && home <= b) : (home > hole || home <= b);
+        if (!stays) {
+            cache->buckets[hole] = cache->buckets[b];
+            hole = b;
+        }
+    }
+    cache->buckets[hole] = -1;
+}
+
+static void insertPolicyTag(PolicyCache *cache, uint64_t tag, int way) {
+    int b = policyHomeBucket(cache, tag);
+    while (cache->buckets[b] >= 0) {
+        b = (b + 1) & cache->bucketMask;
+    }
+    cache->buckets[b] = way;
+}
+
+static inline uint32_t nextPolicyRandom(PolicyCache *cache) {
+    uint32_t x = cache->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return cache->random = x;
+}
+
+// Point every tree node on the path to 'way' away from it
+static inline void touchPLRUTree(uint8_t *tree, int ways, int way) {
+    int node = 1;
+    for (int bit = ways >> 1; bit > 0; bit >>= 1) {
+        int right = (way & bit) != 0;
+        tree[node] = !right;
+        node = 2 * node + right;
+    }
+}
+
+// Follow the tree nodes to the pseudo least recently used way
+static inline int findPLRUVictim(const uint8_t *tree, int ways) {
+    int node = 1;
+    while (node < ways) {
+        node = 2 * node + tree[node];
+    }
+    return node - ways;
+}
+
+// Restore the heap order of a set around the entry at 'pos' after its key changed
+static void siftOptHeap(PolicyCache *cache, int set, int pos) {
+    int ways = cache->ways, size = cache->filled[set];
+    int *heap = cache->optHeap + (size_t)set * ways;
+    int *heapPos = cache->optHeapPos + (size_t)set * ways;
+    const long *key = cache->optKey + (size_t)set * ways;
+    int way = heap[pos];
+
+    while (pos > 0 && key[heap[(pos - 1) / 2]] < key[way]) {
+        heap[pos] = heap[(pos - 1) / 2];
+        heapPos[heap[pos]] = pos;
+        pos = (pos - 1) / 2;
+    }
+    while (2 * pos + 1 < size) {
+        int child = 2 * pos + 1;
+        if (child + 1 < size && key[heap[child + 1]] > key[heap[child]]) child++;
+        if (key[heap[child]] <= key[way]) break;
+        heap[pos] = heap[child];
+        heapPos[heap[pos]] = pos;
+        pos = child;
+    }
+    heap[pos] = way;
+    heapPos[way] = pos;
+}
+
+// A level below the L1 only sees the accesses that miss above it, so a line the L1 keeps
+// hitting holds a key that has passed and would never be evicted. Move every such key on to
+// the line's first use from now, as if the level had seen all its accesses
+static void refreshOptKeys(PolicyCache *cache, int set) {
+    long *key = cache->optKey + (size_t)set * cache->ways;
+
+    if (cache->traceNextUse == NULL) return;
+    for (int w = 0; w < cache->filled[set]; w++) {
+        if (key[w] >= cache->now) continue;
+        while (key[w] < cache->now) key[w] = cache->traceNextUse[key[w]];
+        siftOptHeap(cache, set, cache->optHeapPos[(size_t)set * cache->ways + w]);
+    }
+}
+
+// Way of 'tag' among the packed tags of one set, -1 if none. Builds for AVX2 compare four
+// ways per instruction and plain x86-64 (SSE2) two; the remaining ways are compared one by one
+ALWAYS_INLINE int findPackedTag(const uint64_t *tags, int ways, uint64_t tag) {
+    int w = 0;
+
+#if defined(__AVX2__)
+    const __m256i key = _mm256_set1_epi64x((long long)tag);
+    for (; w + 4 <= ways; w += 4) {
+        __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(tags + w)), key);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+        if (mask != 0) return w + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i key = _mm_set1_epi64x((long long)tag);
+    for (; w + 2 <= ways; w += 2) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tags + w)), key);
+        // SSE2 has no 64-bit compare: a way matches when both halves of its tag do
+        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+        if (mask != 0) return w + __builtin_ctz(mask);
+    }
+#endif
+    for (; w < ways; w++) {
+        if (tags[w] == tag) return w;
+    }
+    return -1;
+}
+
+// Way holding 'tag' in a set, -1 on a miss
+ALWAYS_INLINE int findPolicyWay(const PolicyCache *cache, int set, uint64_t tag) {
+    if (cache->buckets != NULL) {
+        for (int b = policyHomeBucket(cache, tag); cache->buckets[b] >= 0; b = (b + 1) & cache->bucketMask) {
+            if (cache->tags[cache->buckets[b]] == tag) return cache->buckets[b];
+        }
+        return -1;
+    }
+    return findPackedTag(cache->tags + (size_t)set * cache->ways, cache->ways, tag);
+}
+
+// Make 'way' the most recently used of its set: the ways more recent than it move one rank
+// down, so the ranks stay a permutation ordered like the counters of updateLRUCounters.
+// Invalid ways keep a rank too; they are refilled before any valid way is evicted
+ALWAYS_INLINE void touchPolicyLRU(PolicyCache *cache, int set, int way) {
+    uint8_t *rank = cache->state + (size_t)set * cache->ways;
+    uint8_t old = rank[way];
+
+    for (int w = 0; w < cache->ways; w++) {
+        rank[w] += rank[w] < old;
+    }
+    rank[way] = 0;
+}
+
+// Update the policy state on a hit
+ALWAYS_INLINE void touchPolicyWay(PolicyCache *cache, int set, int way, const ReplacementPolicy policy) {
+    uint8_t *state = cache->state + (size_t)set * cache->ways;
+
+    switch (policy) {
+    case POLICY_LRU:
+        touchPolicyLRU(cache, set, way);
+        break;
+    case POLICY_PLRU:
+        touchPLRUTree(cache->plruTree + (size_t)set * cache->ways, cache->ways, way);
+        break;
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+        state[way] = 0;              // Hit priority: predict a near re-reference
+        break;
+    case POLICY_OPT:
+        cache->optKey[(size_t)set * cache->ways + way] = cache->nextUse;
+        siftOptHeap(cache, set, cache->optHeapPos[(size_t)set * cache->ways + way]);
+        break;
+    default:
+        break;                       // Random and FIFO ignore hits
+    }
+}
+
+// Way to fill on a miss: an invalid way if there is one, otherwise the policy's victim
+ALWAYS_INLINE int findPolicyVictim(PolicyCache *cache, int set, const ReplacementPolicy policy) {
+    uint8_t *state = cache->state + (size_t)set * cache->ways;
+    int ways = cache->ways;
+
+    if (cache->filled[set] < ways) return cache->filled[set];
+    if (cache->holes[set] > 0) return findPackedTag(cache->tags + (size_t)set * ways, ways, POLICY_TAG_INVALID);
+    if (policy == POLICY_LRU) {
+        // Every way is valid here: the one ranked last
+        for (int w = 0; w < ways; w++) {
+            if (state[w] == ways - 1) return w;
+        }
+    }
+
+    switch (policy) {
+    case POLICY_PLRU:
+        return findPLRUVictim(cache->plruTree + (size_t)set * ways, ways);
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+        // Age the whole set until some line is predicted for a distant re-reference
+        while (true) {
+            for (int w = 0; w < ways; w++) {
+                if (state[w] >= RRPV_MAX) return w;
+            }
+            for (int w = 0; w < ways; w++) {
+                state[w]++;
+            }
+        }
+    case POLICY_RANDOM:
+        return (int)(nextPolicyRandom(cache) % (uint32_t)ways);
+    case POLICY_OPT:
+        refreshOptKeys(cache, set);
+        return cache->optHeap[(size_t)set * ways];  // Used furthest in the future, or never
+    default:
+        return cache->fifoNext[set];
+    }
+}
+
+// Install 'tag' in 'way' and set its initial policy state
+ALWAYS_INLINE void fillPolicyWay(PolicyCache *cache, int set, int way, uint64_t tag, const ReplacementPolicy policy) {
+    size_t index = (size_t)set * cache->ways + way;
+    bool valid = cache->tags[index] != POLICY_TAG_INVALID;
+
+    if (cache->buckets != NULL) {
+        if (valid) removePolicyTag(cache, cache->tags[index]);
+        insertPolicyTag(cache, tag, way);
+    }
+    // A way below 'filled' that is invalid is a hole left by an invalidation
+    bool newLine = !valid && way == cache->filled[set];
+    if (newLine) cache->filled[set]++;
+    bool hole = !valid && !newLine;
+    if (hole) cache->holes[set]--;
+    cache->tags[index] = tag;
+
+    switch (policy) {
+    case POLICY_LRU:
+        touchPolicyLRU(cache, set, way);
+        break;
+    case POLICY_PLRU:
+        touchPLRUTree(cache->plruTree + (size_t)set * cache->ways, cache->ways, way);
+        break;
+    case POLICY_SRRIP:
+        cache->state[index] = RRPV_MAX - 1;
+        break;
+    case POLICY_BRRIP:
+        cache->state[index] = (nextPolicyRandom(cache) % BRRIP_LONG_FILLS == 0) ? RRPV_MAX - 1 : RRPV_MAX;
+        break;
+    case POLICY_FIFO:
+        // Fills go to invalid ways in order first, so the next way is always the oldest;
+        // a refilled hole keeps the queue position of the line it replaced
+        if (!hole) cache->fifoNext[set] = (way + 1 == cache->ways) ? 0 : way + 1;
+        break;
+    case POLICY_OPT:
+        cache->optKey[index] = cache->nextUse;
+        if (newLine) {
+            int pos = cache->filled[set] - 1;
+            cache->optHeap[(size_t)set * cache->ways + pos] = way;
+            cache->optHeapPos[index] = pos;
+        }
+        siftOptHeap(cache, set, cache->optHeapPos[index]);
+        break;
+    default:
+        break;
+    }
+}
+
+// Drop a valid way, its slot is refilled before any valid way is evicted
+void invalidatePolicyWay(PolicyCache *cache, int set, int way) {
+    size_t index = (size_t)set * cache->ways + way;
+
+    if (cache->buckets != NULL) removePolicyTag(cache, cache->tags[index]);
+    cache->tags[index] = POLICY_TAG_INVALID;
+    assignLineBit(cache->dirty, index, false);
+    cache->holes[set]++;
+    if (cache->policy == POLICY_OPT) {
+        cache->optKey[index] = OPT_NEVER;
+        siftOptHeap(cache, set, cache->optHeapPos[index]);
+    }
+}
+
+//-- runtime cache configuration--
+
+
+// Hardware prefetcher attached to a cache level
+typedef enum {
+    PREFETCH_NONE,
+    PREFETCH_NEXT_LINE,  // The lines after a miss (or a hit on a prefetched line)
+    PREFETCH_STRIDE,     // A constant stride seen twice within a 4 KB region
+    PREFETCH_STREAM      // Ascending or descending runs of misses, confirmed before prefetching
+} PrefetcherKind;
+
+static const char *prefetcherNames[] = { "none", "next-line", "stride", "stream" };
+
+#define PREFETCH_MAX_DEGREE 16  // Lines one trigger may prefetch
+
+// Geometry and latency of one cache level
+typedef struct {
+    int lines;          // Total lines (entries) in the level
+    int associativity;  // Ways per set, used by the set associative mapping
+    int accessCost;     // Cycles charged when the access is served here
+    bool writeBack;     // Dirty lines are written to the next level on eviction, else writes go through
+    bool writeAllocate; // A write miss fetches the line, else the write goes around the level
+    int policy;         // Replacement policy of this level, -1 follows the configuration's
+    PrefetcherKind prefetcher;
+    int prefetchDegree; // Lines prefetched per trigger
+    int banks;          // Timing mode: independent banks, interleaved by line, each busy for a lookup
+    int ports;          // Timing mode: lookups the level starts per cycle
+} CacheLevelConfig;
+
+// How the contents of neighbouring levels relate
+typedef enum {
+    INCLUSION_NINE,       // Non-inclusive non-exclusive: misses fill every level, evictions leave upper levels alone
+    INCLUSION_INCLUSIVE,  // A level holds every line above it, its evictions back-invalidate upper levels
+    INCLUSION_EXCLUSIVE   // A line lives in one level: victims move down a level and hits move up
+} InclusionPolicy;
+
+static const char *inclusionNames[] = { "nine", "inclusive", "exclusive" };
+
+// One cache configuration, the compile-time macros are its defaults
+typedef struct {
+    char name[32];
+    int lineSize;       // Bytes per cache line
+    int numLevels;
+    CacheLevelConfig levels[MAX_CACHE_LEVELS];  // levels[0] is L1, the L1D when the L1 is split
+    bool splitL1;              // Instruction fetches go to their own L1I in front of L2
+    CacheLevelConfig l1i;      // Read-only: stores always go to levels[0]
+    int memoryCost;
+    ReplacementPolicy policy;  // Set associative, and fully associative when not LRU
+    InclusionPolicy inclusion;
+    int cores;                 // Cores of a multi-core hierarchy, kept coherent with MESI
+    int privateLevels;         // Levels each core has its own copy of, 0 = all but the last
+    int victimLines;           // Fully associative victim cache behind the L1 (the L1D), 0 = none
+    int victimCost;            // Cycles of a victim cache hit
+    int mshrs;                 // Outstanding misses per core, 0 = blocking caches that miss serially
+    bool timing;               // Time accesses through the level ports/banks and a DRAM model
+    int dramBanks;             // Timing mode: DRAM banks, interleaved by row
+    int dramRowBytes;          // Timing mode: bytes per DRAM row (the row buffer)
+    int dramCas;               // Timing mode: cycles to read an open row
+    int dramRcd;               // Timing mode: cycles to open a row
+    int dramRp;                // Timing mode: cycles to close (precharge) the open row
+} CacheConfig;
+
+// List of configurations to simulate
+typedef struct {
+    CacheConfig *configs;
+    int count;
+    int capacity;
+} CacheConfigList;
+
+void defaultCacheConfig(CacheConfig *config) {
+    snprintf(config->name, sizeof(config->name), "default");
+    config->lineSize = BLOCK_SIZE;
+    config->numLevels = 2;
+    config->levels[0].lines = L1_SIZE;
+    config->levels[0].associativity = L1_ASSOCIATIVITY;
+    config->levels[0].accessCost = L1_ACCESS_COST;
+    config->levels[1].lines = L2_SIZE;
+    config->levels[1].associativity = L2_ASSOCIATIVITY;
+    config->levels[1].accessCost = L2_ACCESS_COST;
+    // Deeper levels, used once 'levels' is raised: their lines and cost stay 0 until
+    // resolveCacheConfig derives them from the level above as it is finally configured
+    for (int i = 2; i < MAX_CACHE_LEVELS; i++) {
+        config->levels[i].lines = 0;
+        config->levels[i].associativity = L2_ASSOCIATIVITY;
+        config->levels[i].accessCost = 0;
+    }
+    for (int i = 0; i < MAX_CACHE_LEVELS; i++) {
+        config->levels[i].writeBack = true;
+        config->levels[i].writeAllocate = true;
+        config->levels[i].policy = -1;
+        config->levels[i].prefetcher = PREFETCH_NONE;
+        config->levels[i].prefetchDegree = 1;
+        config->levels[i].banks = 1;
+        config->levels[i].ports = 1;
+    }
+    config->splitL1 = false;
+    config->l1i = config->levels[0];  // Same geometry as the L1D unless set
+    config->memoryCost = MEMORY_ACCESS_COST;
+    config->policy = POLICY_LRU;
+    config->inclusion = INCLUSION_NINE;
+    config->cores = 1;
+    config->privateLevels = 0;
+    config->victimLines = 0;
+    config->victimCost = 1;
+    config->mshrs = 0;
+    // DRAM timings: an access to the open row takes 40 cycles, one to a closed bank 70, and
+    // one that must first close another row 100 (the memory cost)
+    config->timing = false;
+    config->dramBanks = 8;
+    config->dramRowBytes = 2048;
+    config->dramCas = 40;
+    config->dramRcd = 30;
+    config->dramRp = 30;
+}
+
+static bool isPowerOfTwo(int value) {
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+static int log2Int(int value) {
+    int bits = 0;
+    while ((1 << bits) < value) bits++;
+    return bits;
+}
+
+// Levels private to each core; the levels below them are shared by all cores. A single
+// core owns every level
+int configPrivateLevels(const CacheConfig *config) {
+    if (config->cores == 1) return config->numLevels;
+    if (config->privateLevels > 0) return config->privateLevels;
+    return (config->numLevels > 1) ? config->numLevels - 1 : 1;
+}
+
+// Replacement policy of one level
+static ReplacementPolicy levelPolicy(const CacheConfig *config, const CacheLevelConfig *level) {
+    return (level->policy >= 0) ? (ReplacementPolicy)level->policy : config->policy;
+}
+
+// Whether any level of a configuration replaces with 'policy'
+bool configUsesPolicy(const CacheConfig *config, ReplacementPolicy policy) {
+    for (int i = 0; i < config->numLevels; i++) {
+        if (levelPolicy(config, &config->levels[i]) == policy) return true;
+    }
+    return config->splitL1 && levelPolicy(config, &config->l1i) == policy;
+}
+
+// Parse a positive integer setting, returns 0 on success
+static int parseSettingNumber(const char *key, const char *value, long max, int *number) {
+    char *end;
+    long parsed = strtol(value, &end, 0);
+    if (end == value || *end != '\0' || parsed <= 0 || parsed > max) {
+        fprintf(stderr, "Invalid value '%s' for %s\n", value, key);
+        return 1;
+    }
+    *number = (int)parsed;
+    return 0;
+}
+
+// Set one 'key = value' setting, returns 0 on success
+// Level settings take an lN_ prefix (l1_lines, l3_cost, ...), or l1i_ for the instruction
+// cache of a split L1; write_policy and write_allocate without a prefix set every level
+int applyCacheConfigSetting(CacheConfig *config, const char *key, const char *value) {
+    static const struct {
+        const char *key;
+        size_t offset;
+    } settings[] = {
+        { "line_size",   offsetof(CacheConfig, lineSize) },
+        { "memory_cost", offsetof(CacheConfig, memoryCost) },
+        { "victim_lines", offsetof(CacheConfig, victimLines) },
+        { "victim_cost", offsetof(CacheConfig, victimCost) },
+        { "dram_banks",  offsetof(CacheConfig, dramBanks) },
+        { "dram_row_bytes", offsetof(CacheConfig, dramRowBytes) },
+        { "dram_cas",    offsetof(CacheConfig, dramCas) },
+        { "dram_rcd",    offsetof(CacheConfig, dramRcd) },
+        { "dram_rp",     offsetof(CacheConfig, dramRp) },
+    }, levelSettings[] = {
+        { "lines",       offsetof(CacheLevelConfig, lines) },
+        { "ways",        offsetof(CacheLevelConfig, associativity) },
+        { "cost",        offsetof(CacheLevelConfig, accessCost) },
+        { "banks",       offsetof(CacheLevelConfig, banks) },
+        { "ports",       offsetof(CacheLevelConfig, ports) },
+    };
+
+    if (strcmp(key, "name") == 0) {
+        snprintf(config->name, sizeof(config->name), "%s", value);
+        return 0;
+    }
+    if (strcmp(key, "levels") == 0) {
+        return parseSettingNumber(key, value, MAX_CACHE_LEVELS, &config->numLevels);
+    }
+    if (strcmp(key, "cores") == 0) {
+        return parseSettingNumber(key, value, MAX_CORES, &config->cores);
+    }
+    if (strcmp(key, "private_levels") == 0) {
+        return parseSettingNumber(key, value, MAX_CACHE_LEVELS, &config->privateLevels);
+    }
+    if (strcmp(key, "mshrs") == 0) {
+        return parseSettingNumber(key, value, MAX_MSHRS, &config->mshrs);
+    }
+    if (strcmp(key, "split_l1") == 0 || strcmp(key, "timing") == 0) {
+        if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) {
+            fprintf(stderr, "Invalid value '%s' for %s (expected yes or no)\n", value, key);
+            return 1;
+        }
+        *(strcmp(key, "timing") == 0 ? &config->timing : &config->splitL1) = strcmp(value, "yes") == 0;
+        return 0;
+    }
+    if (strcmp(key, "inclusion") == 0) {
+        for (int i = 0; i < (int)(sizeof(inclusionNames) / sizeof(inclusionNames[0])); i++) {
+            if (strcmp(value, inclusionNames[i]) == 0) {
+                config->inclusion = (InclusionPolicy)i;
+                return 0;
+            }
+        }
+        fprintf(stderr, "Unknown inclusion policy '%s' (expected nine, inclusive or exclusive)\n", value);
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        if (strcmp(key, settings[i].key) == 0) {
+            return parseSettingNumber(key, value, 1L << 30, (int *)((char *)config + settings[i].offset));
+        }
+    }
+
+    const char *levelKey = key;
+    CacheLevelConfig *level = NULL;  // The level named by the prefix
+    int first = 0, last = MAX_CACHE_LEVELS - 1;
+    if (strncmp(key, "l1i_", 4) == 0) {
+        level = &config->l1i;
+        levelKey = key + 4;
+    } else if (key[0] == 'l' && key[1] >= '1' && key[1] < '1' + MAX_CACHE_LEVELS && key[2] == '_') {
+        first = last = key[1] - '1';
+        level = &config->levels[first];
+        levelKey = key + 3;
+    }
+
+    if (strcmp(levelKey, "policy") == 0) {
+        int policy = parseReplacementPolicy(value);
+        if (policy < 0) {
+            fprintf(stderr, "Unknown replacement policy '%s'\n", value);
+            return 1;
+        }
+        if (level == NULL) {
+            config->policy = (ReplacementPolicy)policy;
+        } else {
+            level->policy = policy;
+        }
+        return 0;
+    }
+    if (strcmp(levelKey, "write_policy") == 0 || strcmp(levelKey, "write_allocate") == 0) {
+        if (level == &config->l1i) {
+            fprintf(stderr, "Setting '%s': the instruction cache is never written\n", key);
+            return 1;
+        }
+        bool isPolicy = strcmp(levelKey, "write_policy") == 0;
+        const char *on = isPolicy ? "back" : "yes";
+        const char *off = isPolicy ? "through" : "no";
+        if (strcmp(value, on) != 0 && strcmp(value, off) != 0) {
+            fprintf(stderr, "Invalid value '%s' for %s (expected %s or %s)\n", value, key, on, off);
+            return 1;
+        }
+        for (int i = first; i <= last; i++) {
+            if (isPolicy) {
+                config->levels[i].writeBack = strcmp(value, on) == 0;
+            } else {
+                config->levels[i].writeAllocate = strcmp(value, on) == 0;
+            }
+        }
+        return 0;
+    }
+    if (strcmp(levelKey, "prefetch") == 0 || strcmp(levelKey, "prefetch_degree") == 0) {
+        int setting = -1;
+        if (strcmp(levelKey, "prefetch_degree") == 0) {
+            if (parseSettingNumber(key, value, PREFETCH_MAX_DEGREE, &setting) != 0) return 1;
+        } else {
+            for (int i = 0; i < (int)(sizeof(prefetcherNames) / sizeof(prefetcherNames[0])); i++) {
+                if (strcmp(value, prefetcherNames[i]) == 0) setting = i;
+            }
+            if (setting < 0) {
+                fprintf(stderr, "Unknown prefetcher '%s' (expected none, next-line, stride or stream)\n", value);
+                return 1;
+            }
+        }
+        // Without a prefix every level of the chain gets the setting
+        CacheLevelConfig *targets = (level != NULL) ? level : config->levels;
+        for (int i = 0; i < ((level != NULL) ? 1 : MAX_CACHE_LEVELS); i++) {
+            CacheLevelConfig *target = &targets[i];
+            if (strcmp(levelKey, "prefetch") == 0) {
+                target->prefetcher = (PrefetcherKind)setting;
+            } else {
+                target->prefetchDegree = setting;
+            }
+        }
+        return 0;
+    }
+    for (size_t i = 0; level != NULL && i < sizeof(levelSettings) / sizeof(levelSettings[0]); i++) {
+        if (strcmp(levelKey, levelSettings[i].key) == 0) {
+            return parseSettingNumber(key, value, 1L << 30, (int *)((char *)level + levelSettings[i].offset));
+        }
+    }
+
+    fprintf(stderr, "Unknown cache setting '%s'\n", key);
+    return 1;
+}
+
+// Apply a "key=value" argument, as given to --set
+int applyCacheConfigArgument(CacheConfig *config, const char *argument) {
+    char key[64];
+    const char *equals = strchr(argument, '=');
+
+    if (equals == NULL || equals - argument >= (long)sizeof(key)) {
+        fprintf(stderr, "Expected key=value, got '%s'\n", argument);
+        return 1;
+    }
+    memcpy(key, argument, equals - argument);
+    key[equals - argument] = '\0';
+    return applyCacheConfigSetting(config, key, equals + 1);
+}
+
+// Whether the replacement policy can manage one level: the PLRU tree needs a leaf per
+// way, for the fully associative mapping a way per line; LRU ranks a set's ways in a byte
+static bool policyFitsLevel(const CacheConfig *config, const CacheLevelConfig *level) {
+    if (levelPolicy(config, level) == POLICY_LRU) return level->associativity <= POLICY_LRU_MAX_WAYS;
+    return levelPolicy(config, level) != POLICY_PLRU ||
+           (isPowerOfTwo(level->lines) && isPowerOfTwo(level->associativity));
+}
+
+// Whether the policies of every level of a configuration can manage it
+static bool policyFitsConfig(const CacheConfig *config) {
+    for (int i = 0; i < config->numLevels; i++) {
+        if (!policyFitsLevel(config, &config->levels[i])) return false;
+    }
+    return !config->splitL1 || policyFitsLevel(config, &config->l1i);
+}
+
+static int validateCacheLevel(const CacheConfig *config, const CacheLevelConfig *level, const char *name) {
+    if (level->lines % level->associativity != 0) {
+        fprintf(stderr, "Config '%s': %s lines (%d) must be a multiple of its ways (%d)\n",
+                config->name, name, level->lines, level->associativity);
+        return 1;
+    }
+    if (!policyFitsLevel(config, level) && levelPolicy(config, level) == POLICY_LRU) {
+        fprintf(stderr, "Config '%s': lru supports at most %d %s ways\n", config->name, POLICY_LRU_MAX_WAYS, name);
+        return 1;
+    }
+    if (!policyFitsLevel(config, level)) {
+        fprintf(stderr, "Config '%s': plru needs power-of-two %s lines and ways\n", config->name, name);
+        return 1;
+    }
+    return 0;
+}
+
+// Check that a configuration describes caches we can build
+// Fill in the deeper levels nobody configured: four times the lines of the level above at
+// twice its cost. Called once all settings are applied, so an enlarged L2 grows the L3 too
+void resolveCacheConfig(CacheConfig *config) {
+    for (int i = 2; i < MAX_CACHE_LEVELS; i++) {
+        if (config->levels[i].lines == 0) config->levels[i].lines = config->levels[i - 1].lines * 4;
+        if (config->levels[i].accessCost == 0) config->levels[i].accessCost = config->levels[i - 1].accessCost * 2;
+    }
+}
+
+int validateCacheConfig(const CacheConfig *config) {
+    char name[16];
+
+    for (int i = 0; i < config->numLevels; i++) {
+        snprintf(name, sizeof(name), "L%d", i + 1);
+        if (validateCacheLevel(config, &config->levels[i], name) != 0) return 1;
+        if (i > 0 && config->levels[i].lines < config->levels[i - 1].lines) {
+            fprintf(stderr, "Config '%s': L%d (%d lines) is smaller than L%d above it (%d lines)\n",
+                    config->name, i + 1, config->levels[i].lines, i, config->levels[i - 1].lines);
+            return 1;
+        }
+    }
+    if (config->splitL1 && validateCacheLevel(config, &config->l1i, "L1I") != 0) return 1;
+    if (config->privateLevels > config->numLevels) {
+        fprintf(stderr, "Config '%s': private_levels (%d) exceeds levels (%d)\n",
+                config->name, config->privateLevels, config->numLevels);
+        return 1;
+    }
+    return 0;
+}
+
+static char *trimWhitespace(char *text) {
+    while (*text == ' ' || *text == '\t') text++;
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return text;
+}
+
+int appendCacheConfig(CacheConfigList *list, const CacheConfig *config) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        CacheConfig *configs = (CacheConfig *)realloc(list->configs, capacity * sizeof(CacheConfig));
+        if (configs == NULL) {
+            fprintf(stderr, "Memory allocation failed for cache configurations\n");
+            return 1;
+        }
+        list->configs = configs;
+        list->capacity = capacity;
+    }
+    list->configs[list->count++] = *config;
+    return 0;
+}
+
+void freeCacheConfigList(CacheConfigList *list) {
+    free(list->configs);
+    list->configs = NULL;
+    list->count = list->capacity = 0;
+}
+
+// Replace every configuration by one copy per replacement policy, returns 0 on success
+// Tree-PLRU is skipped for geometries it cannot describe
+int expandPolicySweep(CacheConfigList *list) {
+    CacheConfigList expanded = { NULL, 0, 0 };
+
+    for (int c = 0; c < list->count; c++) {
+        for (int p = 0; p < POLICY_COUNT; p++) {
+            CacheConfig config = list->configs[c];
+            config.policy = (ReplacementPolicy)p;
+            if (!policyFitsConfig(&config)) {
+                if (p == POLICY_LRU) {
+                    fprintf(stderr, "Skipping lru for config '%s': more than %d ways\n", config.name, POLICY_LRU_MAX_WAYS);
+                } else {
+                    fprintf(stderr, "Skipping plru for config '%s': lines and ways must be powers of two\n", config.name);
+                }
+                continue;
+            }
+            if (appendCacheConfig(&expanded, &config) != 0) {
+                freeCacheConfigList(&expanded);
+                return 1;
+            }
+        }
+    }
+
+    freeCacheConfigList(list);
+    *list = expanded;
+    return 0;
+}
+
+// Load configurations from a file of 'key = value' lines
+// Each [name] section is one configuration; settings before the first section
+// are shared by all of them. A file without sections is a single configuration.
+int loadCacheConfigFile(const char *path, const CacheConfig *base, CacheConfigList *list) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open config '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    CacheConfig shared = *base;
+    CacheConfig current;
+    bool inSection = false;
+    int lineNumber = 0;
+    int status = 0;
+    char line[256];
+
+    while (status == 0 && fgets(line, sizeof(line), file) != NULL) {
+        char *text = trimWhitespace(line);
+        lineNumber++;
+        if (*text == '\0' || *text == '#' || *text == ';') continue;
+
+        if (*text == '[') {
+            char *close = strchr(text, ']');
+            if (close == NULL) {
+                fprintf(stderr, "%s:%d: missing ']'\n", path, lineNumber);
+                status = 1;
+                break;
+            }
+            if (inSection) status = appendCacheConfig(list, &current);
+            *close = '\0';
+            current = shared;
+            snprintf(current.name, sizeof(current.name), "%s", trimWhitespace(text + 1));
+            inSection = true;
+            continue;
+        }
+
+        char *equals = strchr(text, '=');
+        if (equals == NULL) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, lineNumber);
+            status = 1;
+            break;
+        }
+        *equals = '\0';
+        if (applyCacheConfigSetting(inSection ? &current : &shared, trimWhitespace(text), trimWhitespace(equals + 1)) != 0) {
+            fprintf(stderr, "%s:%d: bad setting\n", path, lineNumber);
+            status = 1;
+        }
+    }
+    fclose(file);
+
+    if (status == 0) {
+        status = appendCacheConfig(list, inSection ? &current : &shared);
+    }
+    return status;
+}
+
+
+
+
+//-- non-interactive batch engine--
+
+
+typedef enum {
+    OUTPUT_TEXT,
+    OUTPUT_CSV
+} OutputFormat;
+
+#define MAX_SET_PROFILES 16
+
+// Options of a batch run, filled from the command line
+typedef struct {
+    MappingType mapping;
+    long numAccesses;
+    AddressPattern pattern;
+    unsigned int seed;
+    OutputFormat format;
+    bool throughput;              // time the access kernels only, no per-level report
+    bool benchmarkLRU;            // run the fully associative LRU benchmark instead
+    const char *tracePath;        // replay this trace file instead of a synthetic pattern
+    const char *writeTracePath;   // write the synthetic pattern to this file and exit
+    uint64_t addressSpace;        // synthetic addresses fall in [0, addressSpace)
+    int jobs;                     // worker threads of the configuration sweep
+    bool stackDistance;           // add the fully associative LRU hit rate curve
+    int setProfileSets[MAX_SET_PROFILES];  // set counts of the per-set stack profile
+    int numSetProfiles;
+    int maxProfileWays;           // associativities 1..maxProfileWays are reported
+    bool allPolicies;             // sweep every replacement policy for each configuration
+    bool hitStats;                // add per-set hit rates and the hottest blocks to the report
+    const char *accessLogPath;    // stream every access and the level serving it to this file
+    CacheConfig baseConfig;       // defaults plus --set overrides
+    CacheConfigList configs;      // configurations to sweep, from --config or the base
+} BatchOptions;
+
+// Decoded geometry of one cache level
+typedef struct {
+    int sets;
+    int ways;
+    int setBits;           // log2(sets) on the power-of-two fast path
+    uint64_t setMask;
+    int lineSize;          // Bytes per line, to rebuild line addresses from tags
+} LevelGeometry;
+
+#define PREFETCH_TABLE_ENTRIES 16  // Regions (stride) or streams a prefetcher tracks
+#define PREFETCH_REGION_BITS 12    // Stride prefetcher region: 4 KB, standing in for the PC traces lack
+#define STREAM_WINDOW 16           // Lines a miss may lie from a stream's last line and extend it
+
+// Stride region or stream a prefetcher tracks
+typedef struct {
+    bool valid;
+    uint64_t region;   // Stride: address >> PREFETCH_REGION_BITS
+    uint64_t last;     // Last line seen
+    int64_t stride;    // Lines between the last two accesses; streams: their direction
+    int confidence;    // Times the stride (direction) repeated
+    long lastUse;      // Replacement of the table is LRU
+} PrefetchEntry;
+
+// Prefetcher state of one level, trained on the demand accesses that reach the level
+typedef struct {
+    PrefetcherKind kind;
+    int degree;
+    PrefetchEntry table[PREFETCH_TABLE_ENTRIES];
+    long clock;
+    LineWindow victims;    // Recent lines evicted by prefetch fills, until a demand miss finds them
+} Prefetcher;
+
+// One level of a batch hierarchy; only the representation named by 'kind' is allocated
+typedef struct {
+    MappingType kind;      // MAPPING_DIRECT, MAPPING_FULLY_ASSOCIATIVE (O(1) LRU) or MAPPING_SET_ASSOCIATIVE
+    ReplacementPolicy policy;
+    CacheLevelConfig config;  // A copy, so the hot fields sit next to the cache pointers
+    LevelGeometry geometry;
+    CacheLine *dm;
+    uint8_t *prefetched;   // Per line slot: filled by a prefetch and not yet hit, NULL without a prefetcher
+    LRUFullyAssociativeCache fa;
+    PolicyCache cache;     // Set associative, or fully associative (one set) without LRU
+    FullyAssociativeCacheLine *victims;  // L1 only: the victim cache, tagged by line number
+    int victimLines;
+    long *bankFree;        // Timing mode: cycle each bank finishes its current lookup
+    long *portFree;        // Timing mode: cycle each port can start another lookup
+    Prefetcher prefetcher;
+} SimLevel;
+
+// Miss status holding register: a line fill in flight
+typedef struct {
+    uint64_t block;
+    long ready;            // Cycle the fill completes, free from then on
+} MSHR;
+
+// Issue timeline of one core with non-blocking caches: hits take their latency in order, a
+// miss only its L1 lookup while its fill proceeds in an MSHR
+typedef struct {
+    long now;              // Cycle the next access issues
+    long finish;           // Latest fill completion so far
+    MSHR mshrs[MAX_MSHRS];
+} MissTimeline;
+
+// One DRAM bank of the timing mode and the row its row buffer holds
+typedef struct {
+    long ready;            // Cycle the bank finishes its current access
+    int64_t openRow;       // DRAM_ROW_CLOSED before the first access
+} DramBank;
+
+#define DRAM_ROW_CLOSED -1
+#define LATENCY_BUCKETS 4096  // Latencies counted one by one, longer ones share the last bucket
+
+// Distribution of the access latencies of the timing mode
+typedef struct {
+    long counts[LATENCY_BUCKETS + 1];  // Accesses per latency in cycles
+    long total;
+    long sum;
+    long max;
+} LatencyHistogram;
+
+// Accesses and coherence traffic of one core of a multi-core hierarchy
+typedef struct {
+    long accesses;
+    long private_hits;         // Accesses served by one of the core's private levels
+    long coherence_misses;
+    long false_sharing_misses;
+    long invalidations;        // Private copies this core lost to other cores' writes
+    long upgrades;
+} CoreStats;
+
+// One mapping scheme's level chain built from a CacheConfig, fed chunk by chunk
+// Hits of a batch run per set of every level and the blocks accessed most often, in memory
+// proportional to the caches rather than to the trace
+typedef struct {
+    SetCounters levels[MAX_CACHE_LEVELS + 2];  // Indexed like MappingSimulator.levels
+    HotBlockSketch hot;
+} SimHitStats;
+
+typedef struct {
+    MappingType mapping;
+    const CacheConfig *config;
+    bool powerOfTwo;       // Line size and set counts allow shift/mask decoding
+    bool uniform;          // Every level has the same kind and policy, the kernels are specialised for it
+    bool splitL1;          // Instruction fetches start at levels[L1I_LEVEL] instead of levels[0]
+    int lineSize;
+    int offsetBits;
+    int numLevels;
+    SimLevel levels[MAX_CACHE_LEVELS + 2];  // The shared levels, and the private ones of core 0
+    int cores;
+    int privateLevels;     // Levels 0..privateLevels-1 and the L1I belong to one core, the rest are shared
+    int core;              // Core whose private levels 'view' shows
+    SimLevel *view[MAX_CACHE_LEVELS + 2];  // The levels the current core accesses, indexed like 'levels'
+    SimLevel *coreLevels;  // Private levels of cores 1.., MAX_CACHE_LEVELS + 2 slots per core
+    CoreStats *coreStats;
+    LineWindow *lostLines; // Per core: lines another core's write invalidated, and that write's address
+    bool trackLostLines;   // Cleared if a lost-line window cannot grow
+    bool prefetching;      // Some level has a prefetcher
+    struct {
+        uint64_t block;
+        int pos;           // Position of the level to fill
+    } pendingPrefetches[(MAX_CACHE_LEVELS + 1) * PREFETCH_MAX_DEGREE];
+    int numPending;        // Prefetches of the current access, issued once its own fills are done
+    int lastCost;          // Cycles charged to the last demand access
+    int lastServed;        // Position that served the last demand access (numLevels = main memory)
+    bool lastVictimHit;    // The last demand access hit the victim cache
+    MissTimeline *timelines;  // Per core when the configuration has MSHRs or the timing mode
+    DramBank *dram;        // Timing mode: the memory banks
+    LatencyHistogram *latencies;  // Timing mode
+    const long *nextUse;   // OPT: next use of every trace record, indexed by access number
+    Arena *arena;          // Owner of the run state, NULL for the heap; the statistics stay on the heap
+    SimHitStats *hitStats; // --hit-stats, on the heap like the statistics
+    FILE *accessLog;       // --access-log
+    CacheStats stats;
+    long accesses;
+    long writes;
+    long fetches;
+    double seconds;  // Time spent inside the access kernel
+} MappingSimulator;
+
+static const char *mappingNames[] = { "all", "direct", "fully-associative", "set-associative" };
+static const char *patternNames[] = { "random", "sequential", "repeated" };
+
+// Block number, set and tag of an address; 'powerOfTwo' is a constant at every call
+// site so each kernel is compiled once with shifts/masks and once with divisions
+ALWAYS_INLINE uint64_t blockOf(const MappingSimulator *sim, uint64_t address, const bool powerOfTwo) {
+    return powerOfTwo ? address >> sim->offsetBits : address / sim->lineSize;
+}
+
+ALWAYS_INLINE int setOf(const LevelGeometry *level, uint64_t block, const bool powerOfTwo) {
+    return powerOfTwo ? (int)(block & level->setMask) : (int)(block % (uint64_t)level->sets);
+}
+
+ALWAYS_INLINE uint64_t tagOf(const LevelGeometry *level, uint64_t block, const bool powerOfTwo) {
+    return powerOfTwo ? block >> level->setBits : block / (uint64_t)level->sets;
+}
+
+// The batch kernels share one write model over three cache representations; 'kernel' and
+// 'policy' are constants at every call site: MAPPING_DIRECT, MAPPING_FULLY_ASSOCIATIVE for
+// the O(1) LRU caches and MAPPING_SET_ASSOCIATIVE for every policy cache (fully associative
+// ones included). A hierarchy mixing kinds or policies passes MAPPING_ALL and POLICY_COUNT,
+// and each level's own kind and policy are read at run time.
+#define LEVEL_KERNEL(level, kernel) ((kernel) == MAPPING_ALL ? (level)->kind : (kernel))
+#define LEVEL_POLICY(level, policy) ((policy) == POLICY_COUNT ? (level)->policy : (policy))
+
+// Level 'i' as 'core' sees it: the core's own copy of a private level, else the shared one
+ALWAYS_INLINE SimLevel *coreLevel(MappingSimulator *sim, int core, int i) {
+    if (core == 0 || (i >= sim->privateLevels && i != L1I_LEVEL)) return &sim->levels[i];
+    return &sim->coreLevels[(size_t)(core - 1) * (MAX_CACHE_LEVELS + 2) + i];
+}
+
+// Point the view at the private levels of 'core'
+ALWAYS_INLINE void selectCore(MappingSimulator *sim, int core) {
+    if (core == sim->core) return;
+    for (int i = 0; i < sim->privateLevels; i++) sim->view[i] = coreLevel(sim, core, i);
+    sim->view[L1I_LEVEL] = coreLevel(sim, core, L1I_LEVEL);
+    sim->core = core;
+}
+
+// Lines of a level are named by their slot: the set of a direct mapped level, the line of
+// an O(1) LRU cache and set * ways + way in a policy cache. Slots index the dirty bits and the
+// per-line prefetch flags
+ALWAYS_INLINE bool levelLineDirty(const SimLevel *level, long slot, const MappingType kernel) {
+    const MappingType kind = LEVEL_KERNEL(level, kernel);
+
+    if (kind == MAPPING_DIRECT) return level->dm[slot].dirty;
+    return lineBit((kind == MAPPING_FULLY_ASSOCIATIVE) ? level->fa.dirty : level->cache.dirty, (size_t)slot);
+}
+
+ALWAYS_INLINE void setLevelLineDirty(SimLevel *level, long slot, bool dirty, const MappingType kernel) {
+    const MappingType kind = LEVEL_KERNEL(level, kernel);
+
+    if (kind == MAPPING_DIRECT) {
+        level->dm[slot].dirty = dirty;
+    } else {
+        assignLineBit((kind == MAPPING_FULLY_ASSOCIATIVE) ? level->fa.dirty : level->cache.dirty, (size_t)slot, dirty);
+    }
+}
+
+// Look a block up in one level, returns the slot of its line or -1 on a miss; writebacks
+// and snoops look lines up without 'touch' so they leave the replacement state alone
+ALWAYS_INLINE long lookupLevel(SimLevel *level, uint64_t block, bool touch,
+                               const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    const LevelGeometry *geometry = &level->geometry;
+    const MappingType kind = LEVEL_KERNEL(level, kernel);
+
+    if (kind == MAPPING_DIRECT) {
+        int set = setOf(geometry, block, powerOfTwo);
+        const CacheLine *line = level->dm + set;
+        return (line->valid && line->tag == tagOf(geometry, block, powerOfTwo)) ? set : -1;
+    }
+    if (kind == MAPPING_FULLY_ASSOCIATIVE) {
+        int line = lookupLRUCache(&level->fa, block);
+        if (line >= 0 && touch) touchLRUCache(&level->fa, line);
+        return line;
+    }
+
+    PolicyCache *cache = &level->cache;
+    int set = setOf(geometry, block, powerOfTwo);
+    int way = findPolicyWay(cache, set, tagOf(geometry, block, powerOfTwo));
+    if (way < 0) return -1;
+    if (touch) touchPolicyWay(cache, set, way, LEVEL_POLICY(level, policy));
+    return (long)set * cache->ways + way;
+}
+
+// First address of the line in slot 'index' of a policy level, which stores only its tag
+static inline uint64_t policyLineAddress(const SimLevel *level, size_t index) {
+    const LevelGeometry *geometry = &level->geometry;
+    uint64_t set = index / (size_t)geometry->ways;
+    return (level->cache.tags[index] * (uint64_t)geometry->sets + set) * (uint64_t)geometry->lineSize;
+}
+
+// Line pushed out of a level by a fill
+typedef struct {
+    bool valid;
+    bool dirty;
+    uint64_t address;
+    long nextUse;  // OPT: when the line is used next, so an exclusive level below can rank it
+} EvictedLine;
+
+// Fill a block into one level and return the slot of its (clean) line; the line it
+// replaced is described in *evicted
+ALWAYS_INLINE long fillLevel(SimLevel *level, uint64_t block, uint64_t address, EvictedLine *evicted,
+                             const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    const LevelGeometry *geometry = &level->geometry;
+    const MappingType kind = LEVEL_KERNEL(level, kernel);
+
+    evicted->nextUse = OPT_NEVER;
+    if (kind == MAPPING_DIRECT) {
+        CacheLine *cache = level->dm;
+        int index = setOf(geometry, block, powerOfTwo);
+        evicted->valid = cache[index].valid;
+        evicted->dirty = cache[index].dirty;
+        evicted->address = cache[index].address;
+        updateCache(cache, index, tagOf(geometry, block, powerOfTwo), address);
+        cache[index].dirty = false;
+        if (level->prefetched != NULL) level->prefetched[index] = 0;
+        return index;
+    }
+    if (kind == MAPPING_FULLY_ASSOCIATIVE) {
+        LRUFullyAssociativeCache *cache = &level->fa;
+        evicted->valid = cache->used == cache->size && cache->lines[cache->tail].tag != POLICY_TAG_INVALID;
+        if (evicted->valid) {
+            evicted->dirty = lineBit(cache->dirty, cache->tail);
+            evicted->address = cache->lines[cache->tail].tag * (uint64_t)geometry->lineSize;
+        }
+        int line = insertLRUCache(cache, block);
+        if (level->prefetched != NULL) level->prefetched[line] = 0;
+        return line;
+    }
+
+    const ReplacementPolicy levelPolicy = LEVEL_POLICY(level, policy);
+    PolicyCache *cache = &level->cache;
+    int set = setOf(geometry, block, powerOfTwo);
+    int way = findPolicyVictim(cache, set, levelPolicy);
+    size_t index = (size_t)set * cache->ways + way;
+    evicted->valid = cache->tags[index] != POLICY_TAG_INVALID;
+    evicted->dirty = lineBit(cache->dirty, index);
+    evicted->address = policyLineAddress(level, index);
+    if (levelPolicy == POLICY_OPT) evicted->nextUse = cache->optKey[index];
+    fillPolicyWay(cache, set, way, tagOf(geometry, block, powerOfTwo), levelPolicy);
+    assignLineBit(cache->dirty, index, false);
+    if (level->prefetched != NULL) level->prefetched[index] = 0;
+    return (long)index;
+}
+
+// Drop a block from one level, returns whether the level held it and its dirty bit in *dirty
+ALWAYS_INLINE bool invalidateLevel(SimLevel *level, uint64_t block, bool *dirty,
+                                   const MappingType kernel, const bool powerOfTwo) {
+    const LevelGeometry *geometry = &level->geometry;
+    const MappingType kind = LEVEL_KERNEL(level, kernel);
+
+    if (kind == MAPPING_DIRECT) {
+        CacheLine *line = level->dm + setOf(geometry, block, powerOfTwo);
+        if (!line->valid || line->tag != tagOf(geometry, block, powerOfTwo)) return false;
+        *dirty = line->dirty;
+        line->valid = line->dirty = false;
+        return true;
+    }
+    if (kind == MAPPING_FULLY_ASSOCIATIVE) {
+        int line = lookupLRUCache(&level->fa, block);
+        if (line < 0) return false;
+        *dirty = lineBit(level->fa.dirty, line);
+        invalidateLRUCache(&level->fa, line);
+        return true;
+    }
+
+    PolicyCache *cache = &level->cache;
+    int set = setOf(geometry, block, powerOfTwo);
+    int way = findPolicyWay(cache, set, tagOf(geometry, block, powerOfTwo));
+    if (way < 0) return false;
+    *dirty = lineBit(cache->dirty, (size_t)set * cache->ways + way);
+    invalidatePolicyWay(cache, set, way);
+    return true;
+}
+
+// Way of 'block' in the victim cache of an L1, -1 when it is not there
+static inline int findVictimWay(const SimLevel *level, uint64_t block) {
+    for (int way = 0; way < level->victimLines; way++) {
+        if (level->victims[way].valid && level->victims[way].tag == block) return way;
+    }
+    return -1;
+}
+
+// Drop a block from the victim cache of an L1, returns whether it was there and its dirty bit in *dirty
+static bool dropVictim(SimLevel *level, uint64_t block, bool *dirty) {
+    int way = findVictimWay(level, block);
+    if (way < 0) return false;
+    *dirty = level->victims[way].dirty;
+    level->victims[way].valid = level->victims[way].dirty = false;
+    return true;
+}
+
+// Keep a line evicted from an L1 in its victim cache; *evicted becomes the least recently used
+// line the victim cache gives up for it, which continues down the hierarchy
+static void stashVictim(MappingSimulator *sim, SimLevel *level, EvictedLine *evicted) {
+    FullyAssociativeCacheLine *cache = level->victims;
+
+    if (!evicted->valid) return;
+    int way = findFullyAssociativeLRU(cache, level->victimLines);
+    EvictedLine displaced = { cache[way].valid, cache[way].dirty, cache[way].address, OPT_NEVER };
+    updateFullyAssociativeCache(cache, level->victimLines, way, blockOf(sim, evicted->address, sim->powerOfTwo),
+                                evicted->address);
+    cache[way].dirty = evicted->dirty;
+    *evicted = displaced;
+}
+
+// Swap 'block' from the victim cache of the L1 back into the L1, whose own victim takes the way
+// it frees; returns the slot of the line in the L1, -1 when the victim cache does not hold it
+ALWAYS_INLINE long recallVictim(MappingSimulator *sim, uint64_t block, uint64_t address,
+                                const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    SimLevel *level = sim->view[0];
+    EvictedLine evicted;
+    bool victimDirty;
+
+    if (!dropVictim(level, block, &victimDirty)) return -1;
+    long slot = fillLevel(level, block, address, &evicted, kernel, powerOfTwo, policy);
+    setLevelLineDirty(level, slot, victimDirty, kernel);
+    stashVictim(sim, level, &evicted);  // Gives up nothing, a way is free
+    return slot;
+}
+
+// Charge writeback or write-through traffic on top of the demand access
+ALWAYS_INLINE void chargeWriteTraffic(CacheStats *stats, int cycles) {
+    stats->write_cost += cycles;
+    stats->total_cost += cycles;
+}
+
+// Send a writeback or write-through of 'bytes' into level 'i' and below without allocating:
+// the first write-back level holding the line absorbs it, otherwise it continues to memory
+ALWAYS_INLINE void writeToLevel(MappingSimulator *sim, int i, uint64_t address, int bytes,
+                                const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    CacheStats *stats = &sim->stats;
+    uint64_t block = blockOf(sim, address, powerOfTwo);
+
+    for (; i < sim->numLevels; i++) {
+        stats->levels[i].write_bytes += bytes;
+        chargeWriteTraffic(stats, sim->view[i]->config.accessCost);
+        long slot = lookupLevel(sim->view[i], block, false, kernel, powerOfTwo, policy);
+        if (slot >= 0 && sim->view[i]->config.writeBack) {
+            setLevelLineDirty(sim->view[i], slot, true, kernel);
+            return;
+        }
+    }
+    stats->levels[i].write_bytes += bytes;
+    chargeWriteTraffic(stats, sim->config->memoryCost);
+}
+
+// Level below level 'i'; both halves of a split L1 sit above L2
+ALWAYS_INLINE int levelBelow(int i) {
+    return (i == L1I_LEVEL) ? 1 : i + 1;
+}
+
+// Retire a line evicted from level 'i': an inclusive hierarchy first back-invalidates the
+// copies above it, whose dirty data joins the writeback, then dirty data goes one level down
+ALWAYS_INLINE void retireVictim(MappingSimulator *sim, int i, EvictedLine *evicted,
+                                const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    CacheStats *stats = &sim->stats;
+
+    if (i == 0 && sim->view[0]->victims != NULL) stashVictim(sim, sim->view[0], evicted);
+    if (!evicted->valid) return;
+    if (sim->config->inclusion == INCLUSION_INCLUSIVE && i != L1I_LEVEL) {
+        uint64_t block = blockOf(sim, evicted->address, powerOfTwo);
+        // A shared level holds the lines of every core's private levels
+        int cores = (i >= sim->privateLevels) ? sim->cores : 1;
+        for (int core = 0; core < cores; core++) {
+            // -1 stands for the L1I, which sits above every level but its L1D sibling
+            for (int upper = (sim->splitL1 && i > 0) ? -1 : 0; upper < i; upper++) {
+                int index = (upper < 0) ? L1I_LEVEL : upper;
+                SimLevel *level = (cores > 1) ? coreLevel(sim, core, index) : sim->view[index];
+                bool upperDirty;
+                bool held = invalidateLevel(level, block, &upperDirty, kernel, powerOfTwo);
+                if (!held && index == 0 && level->victims != NULL) held = dropVictim(level, block, &upperDirty);
+                if (!held) continue;
+                stats->levels[index].inclusion_victims++;
+                if (upperDirty) {
+                    stats->levels[index].writebacks++;
+                    stats->levels[i].write_bytes += sim->lineSize;
+                    chargeWriteTraffic(stats, sim->view[i]->config.accessCost);
+                    evicted->dirty = true;
+                }
+            }
+        }
+    }
+    if (evicted->dirty) {
+        stats->levels[i].writebacks++;
+        writeToLevel(sim, levelBelow(i), evicted->address, sim->lineSize, kernel, powerOfTwo, policy);
+    }
+}
+
+// Exclusive hierarchy: every victim of level 'i', clean or dirty, moves down a level;
+// the victims it displaces cascade until the last level retires its own. Kept out of line:
+// inlining it into every specialised kernel doubled the build time for no measurable gain
+static void moveVictimDown(MappingSimulator *sim, int i, EvictedLine victim,
+                           const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    CacheStats *stats = &sim->stats;
+    EvictedLine evicted;
+
+    // An L1 victim stops in the victim cache first (retireVictim does that without a level below)
+    if (i == 0 && sim->view[0]->victims != NULL && sim->numLevels > 1) stashVictim(sim, sim->view[0], &victim);
+    for (; victim.valid && levelBelow(i) < sim->numLevels; i = levelBelow(i)) {
+        int b = levelBelow(i);
+        SimLevel *below = sim->view[b];
+        if (victim.dirty) stats->levels[i].writebacks++;
+        stats->levels[b].write_bytes += sim->lineSize;
+        chargeWriteTraffic(stats, below->config.accessCost);
+        uint64_t block = blockOf(sim, victim.address, powerOfTwo);
+        // Copies from several cores, or from both halves of a split L1, can move down to the
+        // same level: the later ones merge into the first
+        long slot = (sim->cores > 1 || sim->splitL1) ? lookupLevel(below, block, false, kernel, powerOfTwo, policy) : -1;
+        if (slot >= 0) {
+            evicted.valid = false;
+        } else {
+            if (LEVEL_POLICY(below, policy) == POLICY_OPT) below->cache.nextUse = victim.nextUse;
+            slot = fillLevel(below, block, victim.address, &evicted, kernel, powerOfTwo, policy);
+        }
+        if (victim.dirty && below->config.writeBack) {
+            setLevelLineDirty(below, slot, true, kernel);
+        } else if (victim.dirty) {
+            writeToLevel(sim, b + 1, victim.address, sim->lineSize, kernel, powerOfTwo, policy);  // Write-through passes it on
+        }
+        victim = evicted;
+    }
+    retireVictim(sim, i, &victim, kernel, powerOfTwo, policy);
+}
+
+// Snooping MESI between the cores' private levels, run when the current core misses all of
+// them or writes a line it holds clean. States follow from the private copies: Modified when
+// one is dirty, Exclusive when no other core holds the line, Shared otherwise. A read makes a
+// Modified owner write the line back to the shared levels and keep it Shared; a write
+// invalidates every other copy, which is an upgrade when the writer already held the line.
+// 'miss' tells a private miss from a write hit
+static void snoopOtherCores(MappingSimulator *sim, uint64_t address, bool write, bool miss) {
+    CacheStats *stats = &sim->stats;
+    CoreStats *self = &sim->coreStats[sim->core];
+    uint64_t block = blockOf(sim, address, sim->powerOfTwo);
+    bool shared = false;
+
+    if (miss && sim->trackLostLines) {
+        // A coherence miss; false sharing when the invalidating write touched another word
+        long lostBy = takeLineWindow(&sim->lostLines[sim->core], block);
+        if (lostBy >= 0) {
+            bool falseSharing = (uint64_t)lostBy / WORD_SIZE != address / WORD_SIZE;
+            stats->coherence_misses++;
+            stats->false_sharing_misses += falseSharing;
+            self->coherence_misses++;
+            self->false_sharing_misses += falseSharing;
+        }
+    }
+
+    for (int core = 0; core < sim->cores; core++) {
+        bool held = false, modified = false;
+        if (core == sim->core) continue;
+        // -1 stands for the L1I of a split L1
+        for (int pos = sim->splitL1 ? -1 : 0; pos < sim->privateLevels; pos++) {
+            SimLevel *level = coreLevel(sim, core, (pos < 0) ? L1I_LEVEL : pos);
+            bool dirty = false;
+            if (write) {
+                if (!invalidateLevel(level, block, &dirty, MAPPING_ALL, sim->powerOfTwo)) continue;
+            } else {
+                long slot = lookupLevel(level, block, false, MAPPING_ALL, sim->powerOfTwo, POLICY_COUNT);
+                if (slot < 0) continue;
+                dirty = levelLineDirty(level, slot, MAPPING_ALL);
+                setLevelLineDirty(level, slot, false, MAPPING_ALL);
+            }
+            held = true;
+            modified = modified || dirty;
+        }
+        // The victim cache of the L1 holds private copies too
+        SimLevel *l1 = coreLevel(sim, core, 0);
+        int way = (l1->victims != NULL) ? findVictimWay(l1, block) : -1;
+        if (way >= 0) {
+            modified = modified || l1->victims[way].dirty;
+            l1->victims[way].dirty = false;
+            if (write) l1->victims[way].valid = false;
+            held = true;
+        }
+        if (!held) continue;
+
+        shared = true;
+        if (modified) {
+            stats->interventions++;
+            writeToLevel(sim, sim->privateLevels, address, sim->lineSize, MAPPING_ALL, sim->powerOfTwo, POLICY_COUNT);
+        }
+        if (write) {
+            stats->invalidations++;
+            sim->coreStats[core].invalidations++;
+            if (sim->trackLostLines && putLineWindow(&sim->lostLines[core], block, (long)address) != 0) {
+                sim->trackLostLines = false;
+            }
+        }
+    }
+    if (write && !miss && shared) {
+        stats->upgrades++;
+        self->upgrades++;
+    }
+}
+
+// Queue a prefetch of the line 'offset' lines from 'block' into the level at 'pos'
+static inline void queuePrefetch(MappingSimulator *sim, int pos, uint64_t block, int64_t offset) {
+    if (offset < 0 && (uint64_t)-offset > block) return;  // Before address zero
+    sim->pendingPrefetches[sim->numPending].block = block + offset;
+    sim->pendingPrefetches[sim->numPending].pos = pos;
+    sim->numPending++;
+}
+
+// Train the prefetcher of the level at 'pos' on a demand access that reached it; 'trigger' is
+// a miss or a hit on a prefetched line. Next-line and stream prefetchers only see triggers,
+// a stride prefetcher every access. The prefetches are queued
+static void trainPrefetcher(MappingSimulator *sim, Prefetcher *pf, int pos, uint64_t address, uint64_t block,
+                            bool trigger) {
+    PrefetchEntry *entry = NULL, *victim = &pf->table[0];
+    uint64_t region = address >> PREFETCH_REGION_BITS;
+
+    if (pf->kind == PREFETCH_NEXT_LINE) {
+        for (int k = 1; trigger && k <= pf->degree; k++) queuePrefetch(sim, pos, block, k);
+        return;
+    }
+    if (pf->kind == PREFETCH_STREAM && !trigger) return;
+
+    // Stride entries match the region, streams a line within STREAM_WINDOW of their last one
+    pf->clock++;
+    for (int e = 0; e < PREFETCH_TABLE_ENTRIES; e++) {
+        PrefetchEntry *candidate = &pf->table[e];
+        uint64_t distance = (block > candidate->last) ? block - candidate->last : candidate->last - block;
+        if (candidate->valid && ((pf->kind == PREFETCH_STRIDE) ? candidate->region == region : distance <= STREAM_WINDOW)) {
+            entry = candidate;
+            break;
+        }
+        if (victim->valid && (!candidate->valid || candidate->lastUse < victim->lastUse)) victim = candidate;
+    }
+    if (entry == NULL) {
+        memset(victim, 0, sizeof(*victim));
+        victim->valid = true;
+        victim->region = region;
+        victim->last = block;
+        victim->lastUse = pf->clock;
+        return;
+    }
+
+    int64_t delta = (int64_t)(block - entry->last);
+    entry->lastUse = pf->clock;
+    if (delta == 0) return;
+    if (pf->kind == PREFETCH_STREAM) delta = (delta > 0) ? 1 : -1;
+    if (delta == entry->stride) {
+        if (entry->confidence < 3) entry->confidence++;
+    } else {
+        entry->stride = delta;
+        entry->confidence = 0;
+    }
+    entry->last = block;
+    for (int k = 1; entry->confidence > 0 && k <= pf->degree; k++) queuePrefetch(sim, pos, block, entry->stride * k);
+}
+
+// Prefetch bookkeeping of a demand access: a hit on a prefetched line makes the prefetch
+// useful, a miss on a line a prefetch recently evicted is pollution, and every prefetching level the
+// access reached trains on it. 'slot' is the line of the serving level
+static void observePrefetchers(MappingSimulator *sim, uint64_t address, uint64_t block, int first, int served,
+                               long slot) {
+    for (int pos = 0; pos <= served && pos < sim->numLevels; pos++) {
+        int i = pos ? pos : first;
+        Prefetcher *pf = &sim->view[i]->prefetcher;
+        LevelStats *stats = &sim->stats.levels[i];
+        bool trigger = pos < served;
+
+        if (pf->kind == PREFETCH_NONE) continue;
+        if (pos == served) {
+            uint8_t *prefetched = &sim->view[i]->prefetched[slot];
+            trigger = *prefetched;
+            stats->useful_prefetches += *prefetched;
+            *prefetched = 0;
+        } else if (pf->victims.limit > 0) {
+            stats->prefetch_pollution += takeLineWindow(&pf->victims, block) >= 0;
+        }
+        trainPrefetcher(sim, pf, pos, address, block, trigger);
+    }
+}
+
+// Flag a line a prefetch filled into 'level' and remember the line it evicted
+static void notePrefetchFill(MappingSimulator *sim, SimLevel *level, uint64_t block, long slot,
+                             const EvictedLine *evicted) {
+    Prefetcher *pf = &level->prefetcher;
+
+    level->prefetched[slot] = 1;
+    if (pf->victims.limit == 0) return;
+    takeLineWindow(&pf->victims, block);  // Back before a demand miss found it gone
+    if (!evicted->valid) return;
+    uint64_t victim = blockOf(sim, evicted->address, sim->powerOfTwo);
+    if (putLineWindow(&pf->victims, victim, 1) != 0) {
+        freeLineWindow(&pf->victims);  // Out of memory: stop counting pollution
+    }
+}
+
+// Issue the prefetches queued by the current access. A prefetch fills its level like a demand
+// read that costs no cycles (no timing model), skipping lines the level holds already
+static void issuePrefetches(MappingSimulator *sim, int first) {
+    CacheStats *stats = &sim->stats;
+    const bool powerOfTwo = sim->powerOfTwo;
+    EvictedLine evicted;
+
+    for (int n = 0; n < sim->numPending; n++) {
+        uint64_t block = sim->pendingPrefetches[n].block;
+        int pos = sim->pendingPrefetches[n].pos;
+        int i = pos ? pos : first;
+        SimLevel *level = sim->view[i];
+        uint64_t address = block * (uint64_t)sim->lineSize;
+        long slot;
+
+        // An exclusive hierarchy holds a line once, so it must not be in a level above either
+        bool held = false;
+        for (int p = (sim->config->inclusion == INCLUSION_EXCLUSIVE) ? 0 : pos; p <= pos && !held; p++) {
+            SimLevel *upper = sim->view[p ? p : first];
+            held = lookupLevel(upper, block, false, MAPPING_ALL, powerOfTwo, POLICY_COUNT) >= 0 ||
+                   (upper->victims != NULL && findVictimWay(upper, block) >= 0);
+        }
+        if (held) continue;
+        if (sim->cores > 1 && pos < sim->privateLevels) snoopOtherCores(sim, address, false, false);
+        int served = pos + 1;
+        while (served < sim->numLevels &&
+               lookupLevel(sim->view[served], block, false, MAPPING_ALL, powerOfTwo, POLICY_COUNT) < 0) {
+            served++;
+        }
+        stats->levels[i].prefetches++;
+
+        if (sim->config->inclusion == INCLUSION_EXCLUSIVE) {
+            bool carriedDirty = false;
+            if (served < sim->numLevels) {
+                invalidateLevel(sim->view[served], block, &carriedDirty, MAPPING_ALL, powerOfTwo);
+            }
+            stats->levels[served].read_bytes += sim->lineSize;
+            slot = fillLevel(level, block, address, &evicted, MAPPING_ALL, powerOfTwo, POLICY_COUNT);
+            setLevelLineDirty(level, slot, carriedDirty, MAPPING_ALL);
+            notePrefetchFill(sim, level, block, slot, &evicted);
+            moveVictimDown(sim, i, evicted, MAPPING_ALL, powerOfTwo, POLICY_COUNT);
+        } else {
+            for (int p = served - 1; p >= pos; p--) {
+                int index = p ? p : first;
+                stats->levels[p + 1].read_bytes += sim->lineSize;
+                slot = fillLevel(sim->view[index], block, address, &evicted, MAPPING_ALL, powerOfTwo, POLICY_COUNT);
+                if (p == pos) notePrefetchFill(sim, level, block, slot, &evicted);
+                retireVictim(sim, index, &evicted, MAPPING_ALL, powerOfTwo, POLICY_COUNT);
+            }
+        }
+    }
+    sim->numPending = 0;
+}
+
+// Run one access down the level chain with the configured write and inclusion policies;
+// 'fetch' starts it at the L1I of a split L1. Positions count levels from the L1 (0) down
+// and double as indexes into the per-level arrays, except for the L1I at L1I_LEVEL. The
+// private levels are those of the current core, kept coherent with the other cores' copies.
+// Returns the position that served it (numLevels = main memory)
+ALWAYS_INLINE int accessHierarchy(MappingSimulator *sim, uint64_t address, bool write, bool fetch,
+                                  const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    CacheStats *stats = &sim->stats;
+    const int numLevels = sim->numLevels;
+    const int first = fetch ? L1I_LEVEL : 0;
+    uint64_t block = blockOf(sim, address, powerOfTwo);
+    EvictedLine evicted = { 0 };
+    long slot = -1;
+    bool victimHit = false;
+    int served = 0, index = first;
+
+    while (served < numLevels && (slot = lookupLevel(sim->view[index], block, true, kernel, powerOfTwo, policy)) < 0) {
+        // The victim cache of the L1D (or unified L1) is probed before the level below
+        if (index == 0 && sim->view[0]->victims != NULL &&
+            (slot = recallVictim(sim, block, address, kernel, powerOfTwo, policy)) >= 0) {
+            victimHit = true;
+            break;
+        }
+        index = ++served;
+        if (served == sim->privateLevels && sim->cores > 1) snoopOtherCores(sim, address, write, true);
+    }
+    if (write && sim->cores > 1 && served < sim->privateLevels && !levelLineDirty(sim->view[index], slot, kernel)) {
+        snoopOtherCores(sim, address, true, false);
+    }
+    if (sim->prefetching) observePrefetchers(sim, address, block, first, served, slot);
+    int cycles;
+    if (victimHit) {
+        stats->victim_hits++;
+        cycles = sim->config->victimCost;
+    } else {
+        stats->levels[index].hits++;
+        cycles = (served < numLevels) ? sim->view[index]->config.accessCost : sim->config->memoryCost;
+    }
+    stats->total_cost += cycles;
+    if (sim->timelines != NULL) {
+        // The latency of the access also counts every lookup above the level that served it
+        for (int p = 0; p < (victimHit ? 1 : served); p++) cycles += sim->view[p ? p : first]->config.accessCost;
+        if (served > 0 && first == 0 && sim->view[0]->victims != NULL) cycles += sim->config->victimCost;
+        sim->lastCost = cycles;
+        sim->lastVictimHit = victimHit;
+    }
+
+    // The line is brought into the first level above 'served' that allocates for this access;
+    // a write that no level allocates for lands in the serving level (or memory)
+    int target = 0;
+    while (target < served && write && !sim->view[target ? target : first]->config.writeAllocate) target++;
+    int targetIndex = target ? target : first;
+    for (int i = 1; i <= target; i++) {
+        stats->levels[i].write_bytes += WORD_SIZE;  // The store is written around the levels above
+    }
+
+    if (target < served) {
+        if (sim->config->inclusion == INCLUSION_EXCLUSIVE) {
+            // The line leaves the level that served it (or comes from memory) for the target level
+            bool carriedDirty = false;
+            if (served < numLevels) invalidateLevel(sim->view[index], block, &carriedDirty, kernel, powerOfTwo);
+            stats->levels[index].read_bytes += sim->lineSize;
+            slot = fillLevel(sim->view[targetIndex], block, address, &evicted, kernel, powerOfTwo, policy);
+            setLevelLineDirty(sim->view[targetIndex], slot, carriedDirty, kernel);
+            moveVictimDown(sim, targetIndex, evicted, kernel, powerOfTwo, policy);
+        } else {
+            // Every level between the target and the serving level is filled, bottom up
+            for (int i = served - 1; i >= target; i--) {
+                stats->levels[i + 1].read_bytes += sim->lineSize;
+                slot = fillLevel(sim->view[i ? i : first], block, address, &evicted, kernel, powerOfTwo, policy);
+                retireVictim(sim, i ? i : first, &evicted, kernel, powerOfTwo, policy);
+            }
+        }
+    }
+
+    if (write && target < numLevels) {
+        if (sim->view[targetIndex]->config.writeBack) {
+            setLevelLineDirty(sim->view[targetIndex], slot, true, kernel);
+        } else {
+            writeToLevel(sim, target + 1, address, WORD_SIZE, kernel, powerOfTwo, policy);
+        }
+    }
+    if (sim->numPending > 0) issuePrefetches(sim, first);
+    return served;
+}
+
+// Hit rate and AMAT, computed the same way as the interactive simulations plus the
+// writeback and write-through cycles spread over all accesses; 'fetches' are the
+// accesses a split L1 sent to its L1I
+void finalizeCacheStats(CacheStats *stats, long numAccesses, long fetches, const CacheConfig *config) {
+    int numLevels = config->numLevels;
+    const LevelStats *l1i = &stats->levels[L1I_LEVEL];
+    long reaching[MAX_CACHE_LEVELS + 1];
+    long cacheHits = l1i->hits;
+
+    reaching[0] = numAccesses;
+    for (int i = 0; i < numLevels; i++) {
+        reaching[i + 1] = reaching[i] - stats->levels[i].hits - (i == 0 ? l1i->hits + stats->victim_hits : 0);
+        cacheHits += stats->levels[i].hits;
+    }
+    cacheHits += stats->victim_hits;
+    stats->l1_hits = stats->levels[0].hits + l1i->hits;
+    stats->l2_hits = (numLevels > 1) ? stats->levels[1].hits : 0;
+    stats->memory_accesses = stats->levels[numLevels].hits;
+
+    // AMAT from the last level up: each level adds its cost and passes its misses on
+    stats->hit_rate = (numAccesses > 0) ? (float)cacheHits / numAccesses * 100 : 0;
+    stats->avg_access_time = config->memoryCost;
+    for (int i = numLevels - 1; i >= 1; i--) {
+        float hitRatio = (reaching[i] > 0) ? (float)stats->levels[i].hits / reaching[i] : 0;
+        stats->avg_access_time = config->levels[i].accessCost + (1 - hitRatio) * stats->avg_access_time;
+    }
+    long data = numAccesses - fetches;
+    float dataBelow = stats->avg_access_time;
+    if (config->victimLines > 0) {
+        // The victim cache takes the L1D misses first and passes on those it does not hold
+        long dataMisses = data - stats->levels[0].hits;
+        float victimHitRatio = (dataMisses > 0) ? (float)stats->victim_hits / dataMisses : 0;
+        dataBelow = config->victimCost + (1 - victimHitRatio) * dataBelow;
+    }
+    if (config->splitL1) {
+        // A split L1 weighs the data and instruction sides by the accesses each received
+        float dataHitRatio = (data > 0) ? (float)stats->levels[0].hits / data : 0;
+        float fetchHitRatio = (fetches > 0) ? (float)l1i->hits / fetches : 0;
+        float dataTime = config->levels[0].accessCost + (1 - dataHitRatio) * dataBelow;
+        float fetchTime = config->l1i.accessCost + (1 - fetchHitRatio) * stats->avg_access_time;
+        stats->avg_access_time = (numAccesses > 0) ? (dataTime * data + fetchTime * fetches) / numAccesses : dataTime;
+    } else {
+        float hitRatio = (reaching[0] > 0) ? (float)stats->levels[0].hits / reaching[0] : 0;
+        stats->avg_access_time = config->levels[0].accessCost + (1 - hitRatio) * dataBelow;
+    }
+    if (numAccesses > 0) {
+        stats->avg_access_time += (float)stats->write_cost / numAccesses;  // Writeback traffic
+    }
+    stats->blocking_access_time = stats->avg_access_time;
+    if (config->mshrs > 0 && numAccesses > 0) {
+        // Non-blocking L1: the time the accesses took with their misses overlapped
+        stats->avg_access_time = (float)stats->elapsed_cycles / numAccesses + (float)stats->write_cost / numAccesses;
+    }
+}
+
+// Address of line 'line' of one level, false when the line is invalid
+static bool residentLineAddress(const SimLevel *level, int line, uint64_t *address) {
+    if (level->kind == MAPPING_DIRECT) {
+        *address = level->dm[line].address;
+        return level->dm[line].valid;
+    }
+    if (level->kind == MAPPING_FULLY_ASSOCIATIVE) {
+        *address = level->fa.lines[line].tag * (uint64_t)level->geometry.lineSize;
+        return level->fa.lines[line].tag != POLICY_TAG_INVALID;
+    }
+    *address = policyLineAddress(level, line);
+    return level->cache.tags[line] != POLICY_TAG_INVALID;
+}
+
+// Distinct lines held by all levels of all cores together, the capacity the inclusion policy
+// leaves usable; -1 if the line set cannot be allocated
+long countResidentLines(MappingSimulator *sim) {
+    LineMap seen;
+    uint64_t address;
+
+    if (initLineMap(&seen, 1024, sim->arena) != 0) return -1;
+    for (int core = 0; core < sim->cores; core++) {
+        // Position -1 is the L1I of a split L1; core 0 covers the shared levels
+        for (int pos = sim->splitL1 ? -1 : 0; pos < (core ? sim->privateLevels : sim->numLevels); pos++) {
+            SimLevel *level = coreLevel(sim, core, (pos < 0) ? L1I_LEVEL : pos);
+            for (int line = 0; line < level->config.lines; line++) {
+                if (!residentLineAddress(level, line, &address)) continue;
+                uint64_t block = blockOf(sim, address, sim->powerOfTwo);
+                if (setLineMap(&seen, findLineMapSlot(&seen, block), block, 0) != 0) {
+                    freeLineMap(&seen);
+                    return -1;
+                }
+            }
+            for (int way = 0; pos == 0 && way < level->victimLines; way++) {
+                if (!level->victims[way].valid) continue;
+                uint64_t block = level->victims[way].tag;
+                if (setLineMap(&seen, findLineMapSlot(&seen, block), block, 0) != 0) {
+                    freeLineMap(&seen);
+                    return -1;
+                }
+            }
+        }
+    }
+    long resident = seen.count;
+    freeLineMap(&seen);
+    return resident;
+}
+
+// Final statistics of a finished mapping scheme
+void finishMappingSimulator(MappingSimulator *sim) {
+    // The cores run side by side; their cycles add up like the serial costs of their accesses
+    for (int core = 0; sim->timelines != NULL && core < sim->cores; core++) {
+        const MissTimeline *timeline = &sim->timelines[core];
+        sim->stats.elapsed_cycles += (timeline->finish > timeline->now) ? timeline->finish : timeline->now;
+    }
+    finalizeCacheStats(&sim->stats, sim->accesses, sim->splitL1 ? sim->fetches : 0, sim->config);
+    if (sim->latencies != NULL && sim->accesses > 0) {
+        sim->stats.timed_access_time = (float)sim->latencies->sum / sim->accesses +
+                                       (float)sim->stats.write_cost / sim->accesses;
+    }
+    sim->stats.resident_lines = countResidentLines(sim);
+}
+
+// Seconds on a monotonic clock, for throughput measurements
+double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void initLevelGeometry(LevelGeometry *level, int sets, int ways, int lineSize) {
+    level->sets = sets;
+    level->lineSize = lineSize;
+    level->ways = ways;
+    level->setBits = log2Int(sets);
+    level->setMask = (uint64_t)sets - 1;
+}
+
+static void freeSimLevel(SimLevel *level, Arena *arena) {
+    arenaFree(arena, level->dm);
+    freePolicyCache(&level->cache);
+    freeLRUCache(&level->fa);
+    arenaFree(arena, level->prefetched);
+    freeLineWindow(&level->prefetcher.victims);
+    arenaFree(arena, level->victims);
+    arenaFree(arena, level->bankFree);
+    arenaFree(arena, level->portFree);
+    level->dm = NULL;
+    level->prefetched = NULL;
+    level->victims = NULL;
+    level->bankFree = NULL;
+    level->portFree = NULL;
+}
+
+// Free the caches and the rest of the run state once the run is finished, keeping the
+// statistics its report reads. Afterwards the simulator no longer points into its arena,
+// which may be reset
+void releaseSimulatorState(MappingSimulator *sim) {
+    Arena *arena = sim->arena;
+    for (int i = 0; i < MAX_CACHE_LEVELS + 2; i++) freeSimLevel(&sim->levels[i], arena);
+    for (int i = 0; sim->coreLevels != NULL && i < (sim->cores - 1) * (MAX_CACHE_LEVELS + 2); i++) {
+        freeSimLevel(&sim->coreLevels[i], arena);
+    }
+    for (int core = 0; sim->lostLines != NULL && core < sim->cores; core++) freeLineWindow(&sim->lostLines[core]);
+    arenaFree(arena, sim->coreLevels);
+    arenaFree(arena, sim->lostLines);
+    arenaFree(arena, sim->timelines);
+    arenaFree(arena, sim->dram);
+    sim->coreLevels = NULL;
+    sim->lostLines = NULL;
+    sim->timelines = NULL;
+    sim->dram = NULL;
+    sim->arena = NULL;
+    if (sim->accessLog != NULL) fclose(sim->accessLog);
+    sim->accessLog = NULL;
+}
+
+void freeMappingSimulator(MappingSimulator *sim) {
+    releaseSimulatorState(sim);
+    for (int i = 0; sim->hitStats != NULL && i < MAX_CACHE_LEVELS + 2; i++) {
+        free(sim->hitStats->levels[i].hits);
+        free(sim->hitStats->levels[i].misses);
+    }
+    free(sim->coreStats);
+    free(sim->latencies);
+    free(sim->hitStats);
+    sim->coreStats = NULL;
+    sim->latencies = NULL;
+    sim->hitStats = NULL;
+}
+
+// Build one level in the representation the mapping scheme and its policy call for
+static int initSimLevel(MappingSimulator *sim, SimLevel *level, const CacheLevelConfig *levelConfig) {
+    const CacheConfig *config = sim->config;
+
+    level->config = *levelConfig;
+    level->policy = levelPolicy(config, levelConfig);
+    if (sim->mapping == MAPPING_DIRECT) {
+        level->kind = MAPPING_DIRECT;
+        level->policy = config->policy;  // Unused, one line per set
+        initLevelGeometry(&level->geometry, levelConfig->lines, 1, config->lineSize);
+        level->dm = (CacheLine *)arenaAlloc(sim->arena, levelConfig->lines * sizeof(CacheLine));
+        if (level->dm == NULL) return 1;
+        initializeCache(level->dm, levelConfig->lines);
+    } else if (sim->mapping == MAPPING_FULLY_ASSOCIATIVE && level->policy == POLICY_LRU) {
+        level->kind = MAPPING_FULLY_ASSOCIATIVE;
+        initLevelGeometry(&level->geometry, 1, levelConfig->lines, config->lineSize);
+        if (initializeLRUCache(&level->fa, levelConfig->lines, sim->arena) != 0) return 1;
+    } else {
+        level->kind = MAPPING_SET_ASSOCIATIVE;
+        if (sim->mapping == MAPPING_FULLY_ASSOCIATIVE) {
+            initLevelGeometry(&level->geometry, 1, levelConfig->lines, config->lineSize);
+        } else {
+            initLevelGeometry(&level->geometry, levelConfig->lines / levelConfig->associativity,
+                              levelConfig->associativity, config->lineSize);
+        }
+        if (initPolicyCache(&level->cache, level->policy, level->geometry.sets, level->geometry.ways, sim->arena) != 0) {
+            return 1;
+        }
+    }
+
+    level->prefetcher.kind = levelConfig->prefetcher;
+    level->prefetcher.degree = levelConfig->prefetchDegree;
+    if (levelConfig->prefetcher != PREFETCH_NONE) {
+        level->prefetched = (uint8_t *)arenaCalloc(sim->arena, levelConfig->lines, sizeof(uint8_t));
+        // A victim evicted more than a level's worth of lines ago would have been evicted anyway
+        if (level->prefetched == NULL || initLineWindow(&level->prefetcher.victims, levelConfig->lines, sim->arena) != 0) {
+            return 1;
+        }
+        sim->prefetching = true;
+    }
+    if (config->timing) {
+        level->bankFree = (long *)arenaCalloc(sim->arena, levelConfig->banks, sizeof(long));
+        level->portFree = (long *)arenaCalloc(sim->arena, levelConfig->ports, sizeof(long));
+        if (level->bankFree == NULL || level->portFree == NULL) return 1;
+    }
+
+    sim->powerOfTwo = sim->powerOfTwo && isPowerOfTwo(level->geometry.sets);
+    sim->uniform = sim->uniform && level->kind == sim->levels[0].kind && level->policy == sim->levels[0].policy;
+    return 0;
+}
+
+// Give an L1 its victim cache, when one is configured
+static int initVictimCache(MappingSimulator *sim, SimLevel *level) {
+    const CacheConfig *config = sim->config;
+    if (config->victimLines == 0) return 0;
+    level->victims = (FullyAssociativeCacheLine *)arenaAlloc(sim->arena,
+                                                             config->victimLines * sizeof(FullyAssociativeCacheLine));
+    if (level->victims == NULL) return 1;
+    initializeFullyAssociativeCache(level->victims, config->victimLines);
+    level->victimLines = config->victimLines;
+    return 0;
+}
+
+// Build the level chain of one mapping scheme in 'arena', or on the heap when it is NULL;
+// returns 0 on success
+int initMappingSimulator(MappingSimulator *sim, MappingType mapping, const CacheConfig *config, Arena *arena) {
+    memset(sim, 0, sizeof(*sim));
+    sim->arena = arena;
+    sim->mapping = mapping;
+    sim->config = config;
+    sim->lineSize = config->lineSize;
+    sim->offsetBits = log2Int(config->lineSize);
+    sim->numLevels = config->numLevels;
+    sim->splitL1 = config->splitL1;
+    sim->powerOfTwo = isPowerOfTwo(config->lineSize);
+    sim->uniform = true;
+
+    sim->cores = config->cores;
+    sim->privateLevels = configPrivateLevels(config);
+    for (int i = 0; i < MAX_CACHE_LEVELS + 2; i++) sim->view[i] = &sim->levels[i];
+
+    for (int i = 0; i < config->numLevels; i++) {
+        if (initSimLevel(sim, &sim->levels[i], &config->levels[i]) != 0) goto fail;
+    }
+    if (config->splitL1 && initSimLevel(sim, &sim->levels[L1I_LEVEL], &config->l1i) != 0) goto fail;
+    if (initVictimCache(sim, &sim->levels[0]) != 0) goto fail;
+    if (config->mshrs > 0 || config->timing) {
+        sim->timelines = (MissTimeline *)arenaCalloc(arena, sim->cores, sizeof(MissTimeline));
+        if (sim->timelines == NULL) goto fail;
+    }
+    if (config->timing) {
+        sim->dram = (DramBank *)arenaAlloc(arena, config->dramBanks * sizeof(DramBank));
+        sim->latencies = (LatencyHistogram *)calloc(1, sizeof(LatencyHistogram));
+        if (sim->dram == NULL || sim->latencies == NULL) goto fail;
+        for (int bank = 0; bank < config->dramBanks; bank++) {
+            sim->dram[bank].ready = 0;
+            sim->dram[bank].openRow = DRAM_ROW_CLOSED;
+        }
+    }
+    if (sim->cores == 1) return 0;
+
+    // Every further core gets its own copy of the private levels
+    sim->coreLevels = (SimLevel *)arenaCalloc(arena, (size_t)(sim->cores - 1) * (MAX_CACHE_LEVELS + 2), sizeof(SimLevel));
+    sim->coreStats = (CoreStats *)calloc(sim->cores, sizeof(CoreStats));
+    sim->lostLines = (LineWindow *)arenaCalloc(arena, sim->cores, sizeof(LineWindow));
+    if (sim->coreLevels == NULL || sim->coreStats == NULL || sim->lostLines == NULL) goto fail;
+    // A lost line the core could no longer hold anyway is a capacity miss, not a coherence miss
+    long privateLines = config->victimLines + (config->splitL1 ? config->l1i.lines : 0);
+    for (int i = 0; i < sim->privateLevels; i++) privateLines += config->levels[i].lines;
+    for (int core = 0; core < sim->cores; core++) {
+        if (initLineWindow(&sim->lostLines[core], privateLines, sim->arena) != 0) goto fail;
+        for (int i = 0; core > 0 && i < sim->privateLevels; i++) {
+            if (initSimLevel(sim, coreLevel(sim, core, i), &config->levels[i]) != 0) goto fail;
+        }
+        if (core > 0 && initVictimCache(sim, coreLevel(sim, core, 0)) != 0) goto fail;
+        if (core > 0 && config->splitL1 && initSimLevel(sim, coreLevel(sim, core, L1I_LEVEL), &config->l1i) != 0) {
+            goto fail;
+        }
+    }
+    sim->trackLostLines = true;
+    return 0;
+
+fail:
+    freeMappingSimulator(sim);
+    return 1;
+}
+
+// Start a lookup arriving at cycle 't' on the first free port of a level and the bank its
+// line maps to, returns the cycle it completes
+static long reserveLevel(MappingSimulator *sim, SimLevel *level, uint64_t block, long t) {
+    CacheStats *stats = &sim->stats;
+    long *port = &level->portFree[0];
+
+    for (int n = 1; n < level->config.ports; n++) {
+        if (level->portFree[n] < *port) port = &level->portFree[n];
+    }
+    if (*port > t) {
+        stats->port_wait_cycles += *port - t;
+        t = *port;
+    }
+    long *bank = &level->bankFree[block % level->config.banks];
+    if (*bank > t) {
+        stats->bank_conflict_cycles += *bank - t;
+        t = *bank;
+    }
+    *port = t + 1;  // Lookups are pipelined through the port, not through the bank
+    *bank = t + level->config.accessCost;
+    return *bank;
+}
+
+// Access main memory at cycle 't': an open-page DRAM whose banks each keep the last row they
+// read open, so the latency depends on whether the row buffer already holds the address
+static long reserveDram(MappingSimulator *sim, uint64_t address, long t) {
+    const CacheConfig *config = sim->config;
+    CacheStats *stats = &sim->stats;
+    uint64_t row = address / config->dramRowBytes;
+    DramBank *bank = &sim->dram[row % config->dramBanks];
+    int latency;
+
+    row /= config->dramBanks;
+    if (bank->ready > t) {
+        stats->bank_conflict_cycles += bank->ready - t;
+        t = bank->ready;
+    }
+    if (bank->openRow == (int64_t)row) {
+        stats->dram_row_hits++;
+        latency = config->dramCas;
+    } else if (bank->openRow == DRAM_ROW_CLOSED) {
+        stats->dram_row_empty++;
+        latency = config->dramRcd + config->dramCas;
+    } else {
+        stats->dram_row_conflicts++;
+        latency = config->dramRp + config->dramRcd + config->dramCas;
+    }
+    bank->openRow = (int64_t)row;
+    bank->ready = t + latency;
+    return bank->ready;
+}
+
+// Timing mode: walk the last access down the levels it looked up from cycle 'start', each lookup
+// waiting for its port and bank, then the DRAM when no level held the line. Returns the cycle it
+// completes; *issued becomes the cycle its first lookup completes
+static long timeAccessPath(MappingSimulator *sim, uint64_t address, int first, int served, long start, long *issued) {
+    uint64_t block = blockOf(sim, address, sim->powerOfTwo);
+    long t = start;
+
+    for (int p = 0; p <= served && p < sim->numLevels; p++) {
+        t = reserveLevel(sim, sim->view[p ? p : first], block, t);
+        if (p == 0) {
+            *issued = t;
+            // The victim cache is probed, without ports of its own, when the L1D misses
+            if ((served > 0 || sim->lastVictimHit) && first == 0 && sim->view[0]->victims != NULL) {
+                t += sim->config->victimCost;
+            }
+            if (sim->lastVictimHit) break;
+        }
+    }
+    if (served == sim->numLevels) t = reserveDram(sim, address, t);
+    return t;
+}
+
+static void recordLatency(LatencyHistogram *histogram, long latency) {
+    histogram->counts[(latency < LATENCY_BUCKETS) ? latency : LATENCY_BUCKETS]++;
+    histogram->total++;
+    histogram->sum += latency;
+    if (latency > histogram->max) histogram->max = latency;
+}
+
+// Smallest latency at least 'fraction' of the accesses stayed within, LATENCY_BUCKETS when longer
+static long latencyPercentile(const LatencyHistogram *histogram, double fraction) {
+    long seen = 0;
+    for (long latency = 0; latency < LATENCY_BUCKETS; latency++) {
+        seen += histogram->counts[latency];
+        if (seen > 0 && seen >= fraction * histogram->total) return latency;
+    }
+    return LATENCY_BUCKETS;
+}
+
+// Move the current core's timeline past one access. Lookups issue one after another, each
+// taking the cycles of its first level; a miss then waits for its line in an MSHR while later
+// accesses go on, so independent misses overlap. An access to a line still in flight merges
+// into its MSHR, and a miss finding every MSHR busy stalls until the earliest one frees.
+// Without MSHRs every access holds up the core until it completes
+static void advanceTimeline(MappingSimulator *sim, uint64_t address, int first, int served) {
+    MissTimeline *timeline = &sim->timelines[sim->core];
+    CacheStats *stats = &sim->stats;
+    uint64_t block = blockOf(sim, address, sim->powerOfTwo);
+    MSHR *mshr = &timeline->mshrs[0];
+
+    for (int n = 0; n < sim->config->mshrs; n++) {
+        if (timeline->mshrs[n].ready > timeline->now && timeline->mshrs[n].block == block) {
+            stats->mshr_merges++;
+            if (sim->latencies != NULL) recordLatency(sim->latencies, timeline->mshrs[n].ready - timeline->now);
+            timeline->now += sim->view[first]->config.accessCost;
+            return;
+        }
+        if (timeline->mshrs[n].ready < mshr->ready) mshr = &timeline->mshrs[n];
+    }
+    bool blocking = served == 0 || sim->config->mshrs == 0;
+    if (!blocking && mshr->ready > timeline->now) {
+        stats->mshr_stall_cycles += mshr->ready - timeline->now;
+        timeline->now = mshr->ready;
+    }
+    long issued = timeline->now + sim->view[first]->config.accessCost;
+    long done = sim->config->timing ? timeAccessPath(sim, address, first, served, timeline->now, &issued)
+                                    : timeline->now + sim->lastCost;
+    if (sim->latencies != NULL) recordLatency(sim->latencies, done - timeline->now);
+    if (blocking) {
+        timeline->now = done;
+        return;
+    }
+    mshr->block = block;
+    mshr->ready = done;
+    if (mshr->ready > timeline->finish) timeline->finish = mshr->ready;
+    timeline->now = issued;
+}
+
+// Report name of level 'i'
+static const char *batchLevelName(const MappingSimulator *sim, int i) {
+    static const char *names[MAX_CACHE_LEVELS] = { "L1", "L2", "L3", "L4" };
+    if (i == L1I_LEVEL) return "L1I";
+    return (i == 0 && sim->splitL1) ? "L1D" : names[i];
+}
+
+#define ACCESS_LOG_BUFFER (1 << 20)  // Bytes buffered before the access log is written
+
+// Set up the --hit-stats counters and the --access-log file of a simulator, returns 0 on success
+int attachHitStatistics(const BatchOptions *opts, MappingSimulator *sim) {
+    if (opts->hitStats) {
+        sim->hitStats = (SimHitStats *)calloc(1, sizeof(SimHitStats));
+        if (sim->hitStats == NULL) return 1;
+        for (int i = 0; i < MAX_CACHE_LEVELS + 2; i++) {
+            if ((i < sim->numLevels || (i == L1I_LEVEL && sim->splitL1)) &&
+                initSetCounters(&sim->hitStats->levels[i], NULL, sim->levels[i].geometry.sets) != 0) {
+                return 1;
+            }
+        }
+    }
+    if (opts->accessLogPath != NULL) {
+        sim->accessLog = fopen(opts->accessLogPath, "w");
+        if (sim->accessLog == NULL) {
+            fprintf(stderr, "Cannot write access log '%s': %s\n", opts->accessLogPath, strerror(errno));
+            return 1;
+        }
+        setvbuf(sim->accessLog, NULL, _IOFBF, ACCESS_LOG_BUFFER);
+        fprintf(sim->accessLog, "index,core,address,type,served_by\n");
+    }
+    return 0;
+}
+
+// Count access 'index' in the sets it looked up, a hit in the level that served it and a
+// miss in those above; a victim cache hit counts as a hit of the L1 set
+static void recordSimAccess(MappingSimulator *sim, long index, TraceRecord record, int served) {
+    uint64_t address = traceAddress(record);
+    int first = (traceIsFetch(record) && sim->splitL1) ? L1I_LEVEL : 0;
+
+    if (sim->hitStats != NULL) {
+        uint64_t block = blockOf(sim, address, sim->powerOfTwo);
+        for (int p = 0; p <= served && p < sim->numLevels; p++) {
+            countSetAccess(&sim->hitStats->levels[p ? p : first], block, p == served);
+        }
+        addHotBlock(&sim->hitStats->hot, block);
+    }
+    if (sim->accessLog != NULL) {
+        fprintf(sim->accessLog, "%ld,%d,0x%" PRIX64 ",%c,%s\n", index, sim->core, address,
+                traceIsFetch(record) ? 'I' : (traceIsWrite(record) ? 'W' : 'R'),
+                (served < sim->numLevels) ? batchLevelName(sim, served ? served : first) : "memory");
+    }
+}
+
+ALWAYS_INLINE void simulateChunk(MappingSimulator *sim, const TraceRecord *records, size_t count,
+                                 const MappingType kernel, const bool powerOfTwo, const ReplacementPolicy policy) {
+    long writes = 0, fetches = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        bool write = traceIsWrite(records[i]);
+        bool fetch = traceIsFetch(records[i]);
+        writes += write;
+        fetches += fetch;
+        // Core ids beyond the configured cores wrap around
+        if (sim->cores > 1) selectCore(sim, traceCore(records[i]) % sim->cores);
+        // OPT keys a line by its next use in the trace. A level stores the key only when the
+        // access reaches it, so the levels below the L1 refresh the keys that have passed before
+        // choosing a victim. They rank lines by the trace's next use, not by the next miss they
+        // will see, so below the L1 OPT is close to but not exactly Belady's MIN
+        if (sim->nextUse != NULL && kernel != MAPPING_DIRECT && kernel != MAPPING_FULLY_ASSOCIATIVE &&
+            (policy == POLICY_OPT || policy == POLICY_COUNT)) {
+            long now = sim->accesses + (long)i;
+            for (int level = 0; level < sim->numLevels; level++) {
+                PolicyCache *cache = &sim->view[level]->cache;
+                cache->nextUse = sim->nextUse[now];
+                cache->now = now;
+                cache->traceNextUse = sim->nextUse;
+            }
+            sim->view[L1I_LEVEL]->cache.nextUse = sim->nextUse[now];
+            sim->view[L1I_LEVEL]->cache.now = now;
+            sim->view[L1I_LEVEL]->cache.traceNextUse = sim->nextUse;
+        }
+        int served = accessHierarchy(sim, traceAddress(records[i]), write, fetch && sim->splitL1,
+                                     kernel, powerOfTwo, policy);
+        sim->lastServed = served;
+        if (sim->timelines != NULL) {
+            advanceTimeline(sim, traceAddress(records[i]), (fetch && sim->splitL1) ? L1I_LEVEL : 0, served);
+        }
+        if (sim->hitStats != NULL || sim->accessLog != NULL) {
+            recordSimAccess(sim, sim->accesses + (long)i, records[i], served);
+        }
+        if (sim->cores > 1) {
+            sim->coreStats[sim->core].accesses++;
+            sim->coreStats[sim->core].private_hits += served < sim->privateLevels;
+        }
+    }
+    sim->writes += writes;
+    sim->fetches += fetches;
+}
+
+// Simulate a chunk of trace records, the records are read in place. The common hierarchies,
+// direct-mapped or LRU on one representation with power-of-two decoding, get kernels of their
+// own that never branch on the level kind or policy; everything else shares the generic
+// kernel, which dispatches per level. A copy for every combination took the build a minute
+void simulateTraceChunk(MappingSimulator *sim, const TraceRecord *records, size_t count) {
+    double start = monotonicSeconds();
+    const MappingType kind = sim->levels[0].kind;
+    const bool uniform = sim->uniform && sim->powerOfTwo;
+
+    // Uniform power-of-two hierarchies get a kernel per representation and policy, with no
+    // per-level dispatch in the loop; mixed and non-power-of-two ones take the generic kernel
+    if (uniform && kind == MAPPING_DIRECT) {
+        simulateChunk(sim, records, count, MAPPING_DIRECT, true, POLICY_LRU);  // The policy is unused
+    } else if (uniform && kind == MAPPING_FULLY_ASSOCIATIVE) {
+        simulateChunk(sim, records, count, MAPPING_FULLY_ASSOCIATIVE, true, POLICY_LRU);
+    } else if (uniform) {
+        switch (sim->levels[0].policy) {
+        case POLICY_LRU:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_LRU);
+            break;
+        case POLICY_PLRU:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_PLRU);
+            break;
+        case POLICY_SRRIP:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_SRRIP);
+            break;
+        case POLICY_BRRIP:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_BRRIP);
+            break;
+        case POLICY_RANDOM:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_RANDOM);
+            break;
+        case POLICY_FIFO:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_FIFO);
+            break;
+        case POLICY_OPT:
+            simulateChunk(sim, records, count, MAPPING_SET_ASSOCIATIVE, true, POLICY_OPT);
+            break;
+        default:
+            simulateChunk(sim, records, count, MAPPING_ALL, true, POLICY_COUNT);
+            break;
+        }
+    } else if (sim->powerOfTwo) {
+        simulateChunk(sim, records, count, MAPPING_ALL, true, POLICY_COUNT);
+    } else {
+        simulateChunk(sim, records, count, MAPPING_ALL, false, POLICY_COUNT);
+    }
+
+    sim->accesses += count;
+    sim->seconds += monotonicSeconds() - start;
+}
+
+// Name of the address source for reports
+const char *batchSourceName(const BatchOptions *opts) {
+    return opts->tracePath ? opts->tracePath : patternNames[opts->pattern];
+}
+
+// Seed for reports, '-' for traces, which the seed does not affect
+const char *batchSeedName(const BatchOptions *opts) {
+    static char seed[16];
+    if (opts->tracePath) return "-";
+    snprintf(seed, sizeof(seed), "%u", opts->seed);
+    return seed;
+}
+
+// Replacement policy of a mapping scheme; direct-mapped caches have none to choose
+const char *batchPolicyName(const MappingSimulator *sim) {
+    return (sim->mapping == MAPPING_DIRECT) ? "-" : policyNames[sim->config->policy];
+}
+
+// Latency distribution and resource waits of the timing mode, next to the cost-sum AMAT
+static void printTimingResults(const MappingSimulator *sim) {
+    const CacheConfig *config = sim->config;
+    const CacheStats *stats = &sim->stats;
+    const LatencyHistogram *latencies = sim->latencies;
+    long memory = stats->dram_row_hits + stats->dram_row_empty + stats->dram_row_conflicts;
+
+    printf("Timing (level ports and banks, DRAM %d banks of %d-byte rows):\n", config->dramBanks, config->dramRowBytes);
+    printf("  Timed AMAT: %.2f cycles (cost-sum AMAT %.2f), %ld cycles elapsed\n",
+           stats->timed_access_time, stats->blocking_access_time, stats->elapsed_cycles);
+    printf("  Latency: mean %.2f, p50 %ld, p90 %ld, p99 %ld, max %ld cycles\n",
+           latencies->total ? (float)latencies->sum / latencies->total : 0, latencyPercentile(latencies, 0.5),
+           latencyPercentile(latencies, 0.9), latencyPercentile(latencies, 0.99), latencies->max);
+    printf("  Waits: %ld cycles for ports, %ld cycles for busy banks\n",
+           stats->port_wait_cycles, stats->bank_conflict_cycles);
+    printf("  DRAM row buffer: %ld hits (%.2f%%), %ld empty, %ld conflicts\n", stats->dram_row_hits,
+           memory ? (float)stats->dram_row_hits / memory * 100 : 0, stats->dram_row_empty, stats->dram_row_conflicts);
+    // Power-of-two buckets: 0, 1, 2-3, 4-7, ...
+    printf("  Latency distribution:\n");
+    for (long low = 0, high = 0; low <= LATENCY_BUCKETS; low = high + 1, high = 2 * low - 1) {
+        long count = 0;
+        for (long latency = low; latency <= high && latency <= LATENCY_BUCKETS; latency++) {
+            count += latencies->counts[latency];
+        }
+        if (count == 0) continue;
+        if (low == LATENCY_BUCKETS) printf("    %6ld+     ", low);
+        else if (low == high) printf("    %6ld      ", low);
+        else printf("    %6ld-%-6ld", low, (high < LATENCY_BUCKETS) ? high : LATENCY_BUCKETS - 1);
+        printf(" %10ld (%.2f%%)\n", count, (float)count / latencies->total * 100);
+    }
+    printf("\n");
+}
+
+// Spread of the hit rates over the sets of every level, and the blocks accessed most often
+static void printHitStatistics(const MappingSimulator *sim) {
+    const SimHitStats *hitStats = sim->hitStats;
+
+    printf("Hit Statistics per Set:\n");
+    for (int i = 0; i < MAX_CACHE_LEVELS + 2; i++) {
+        const SetCounters *counters = &hitStats->levels[i];
+        if (counters->hits == NULL) continue;
+        int worst = 0, best = 0, missiest = 0, unused = 0;
+        for (int set = 0; set < counters->sets; set++) {
+            long total = counters->hits[set] + counters->misses[set];
+            if (total == 0) {
+                unused++;
+                continue;
+            }
+            // Rates compared by cross-multiplying, an unused set never wins
+            long worstTotal = counters->hits[worst] + counters->misses[worst];
+            long bestTotal = counters->hits[best] + counters->misses[best];
+            if (worstTotal == 0 || counters->hits[set] * worstTotal < counters->hits[worst] * total) worst = set;
+            if (bestTotal == 0 || counters->hits[set] * bestTotal > counters->hits[best] * total) best = set;
+            if (counters->misses[set] > counters->misses[missiest]) missiest = set;
+        }
+        if (unused == counters->sets) {
+            printf("  %s (%d sets): no accesses\n", batchLevelName(sim, i), counters->sets);
+            continue;
+        }
+        printf("  %s (%d sets): hit rate %.2f%% (set %d) to %.2f%% (set %d), most misses %ld (set %d), %d sets unused\n",
+               batchLevelName(sim, i), counters->sets,
+               counters->hits[worst] ? (float)counters->hits[worst] / (counters->hits[worst] + counters->misses[worst]) * 100 : 0,
+               worst,
+               counters->hits[best] ? (float)counters->hits[best] / (counters->hits[best] + counters->misses[best]) * 100 : 0,
+               best, counters->misses[missiest], missiest, unused);
+    }
+
+    HotBlock sorted[HOT_BLOCKS];
+    int count = sortHotBlocks(&hitStats->hot, sorted);
+    printf("Hottest Blocks (space-saving estimate, %d counters):\n", HOT_BLOCKS);
+    for (int i = 0; i < count; i++) {
+        printf("  0x%" PRIX64 ": %ld accesses", sorted[i].block * sim->lineSize, sorted[i].count);
+        if (sorted[i].error > 0) printf(" (at least %ld)", sorted[i].count - sorted[i].error);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+// Print the results of one mapping scheme
+void printBatchResults(const BatchOptions *opts, const MappingSimulator *sim) {
+    const CacheConfig *config = sim->config;
+    const CacheStats *stats = &sim->stats;
+    const LevelStats *memory = &stats->levels[sim->numLevels];
+    const LevelStats *l2 = &stats->levels[1];  // Main memory in a single-level hierarchy
+    const LevelStats *l1i = &stats->levels[L1I_LEVEL];
+    long n = sim->accesses;
+    long fetches = sim->splitL1 ? sim->fetches : 0;  // Accesses sent to the L1I
+    long l1Misses = n - stats->l1_hits;
+    long l2Misses = l1Misses - stats->victim_hits - stats->l2_hits;
+    long inclusionVictims = l1i->inclusion_victims;
+
+    for (int i = 0; i < sim->numLevels; i++) inclusionVictims += stats->levels[i].inclusion_victims;
+
+    if (opts->format == OUTPUT_CSV) {
+        printf("%s,%s,%s,%s,%s,%ld,%ld,%ld,%ld,%ld,%ld,%.4f,%.4f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%s,%ld,%ld,%d",
+               mappingNames[sim->mapping], config->name, batchPolicyName(sim), batchSourceName(opts), batchSeedName(opts), n,
+               stats->l1_hits, l1Misses, stats->l2_hits, l2Misses,
+               stats->total_cost, stats->hit_rate, stats->avg_access_time, sim->writes,
+               stats->levels[0].writebacks + l1i->writebacks, (sim->numLevels > 1) ? l2->writebacks : 0,
+               (sim->numLevels > 1) ? l2->read_bytes : 0, (sim->numLevels > 1) ? l2->write_bytes : 0,
+               memory->read_bytes, memory->write_bytes,
+               inclusionNames[config->inclusion], stats->resident_lines, inclusionVictims, sim->numLevels);
+        // Levels below L2, zero when the hierarchy is shallower
+        long reaching = l2Misses;
+        for (int i = 2; i < MAX_CACHE_LEVELS; i++) {
+            const LevelStats *level = &stats->levels[i];
+            if (i < sim->numLevels) {
+                printf(",%ld,%ld,%ld,%ld,%ld", level->hits, reaching - level->hits, level->writebacks,
+                       level->read_bytes, level->write_bytes);
+                reaching -= level->hits;
+            } else {
+                printf(",0,0,0,0,0");
+            }
+        }
+        printf(",%ld,%ld,%ld,%ld,%ld", sim->fetches, l1i->hits, fetches - l1i->hits,
+               stats->levels[0].hits, n - fetches - stats->levels[0].hits);
+        printf(",%d,%ld,%ld,%ld,%ld,%ld", sim->cores, stats->coherence_misses, stats->false_sharing_misses,
+               stats->invalidations, stats->upgrades, stats->interventions);
+        for (int i = 0; i < MAX_CACHE_LEVELS + 2; i++) {
+            const LevelStats *level = &stats->levels[i];
+            if (i == MAX_CACHE_LEVELS) continue;  // Main memory of a four-level hierarchy
+            printf(",%ld,%ld,%ld", level->prefetches, level->useful_prefetches, level->prefetch_pollution);
+        }
+        printf(",%ld,%ld,%ld,%ld", stats->victim_hits, stats->mshr_merges, stats->mshr_stall_cycles,
+               stats->elapsed_cycles);
+        const LatencyHistogram *latencies = sim->latencies;
+        printf(",%.4f,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld", stats->timed_access_time,
+               latencies ? latencyPercentile(latencies, 0.5) : 0, latencies ? latencyPercentile(latencies, 0.9) : 0,
+               latencies ? latencyPercentile(latencies, 0.99) : 0, latencies ? latencies->max : 0,
+               stats->port_wait_cycles, stats->bank_conflict_cycles,
+               stats->dram_row_hits, stats->dram_row_empty, stats->dram_row_conflicts);
+        printf("\n");
+        return;
+    }
+
+    // Position -1 is the L1I of a split L1, reported before its L1D sibling
+    int firstPos = sim->splitL1 ? -1 : 0;
+    printf("Batch Simulation Results (%s mapping, config %s)\n", mappingNames[sim->mapping], config->name);
+    printf("------------------------------------\n");
+    for (int pos = firstPos; pos < sim->numLevels; pos++) {
+        int i = (pos < 0) ? L1I_LEVEL : pos;
+        printf("%s: %d lines, %d-way", batchLevelName(sim, i), sim->levels[i].config.lines, sim->levels[i].geometry.ways);
+        if (sim->mapping != MAPPING_DIRECT && sim->levels[i].policy != config->policy) {
+            printf(" %s", policyNames[sim->levels[i].policy]);
+        }
+        printf("  ");
+    }
+    printf("Line: %d bytes  Replacement: %s\n", config->lineSize, batchPolicyName(sim));
+    printf("Costs:");
+    for (int pos = firstPos; pos < sim->numLevels; pos++) {
+        int i = (pos < 0) ? L1I_LEVEL : pos;
+        printf(" %s %d,", batchLevelName(sim, i), sim->levels[i].config.accessCost);
+    }
+    printf(" memory %d cycles\n", config->memoryCost);
+    printf("Writes:");
+    for (int i = 0; i < sim->numLevels; i++) {
+        printf("%s %s %s/%s", i ? "," : "", batchLevelName(sim, i),
+               config->levels[i].writeBack ? "write-back" : "write-through",
+               config->levels[i].writeAllocate ? "allocate" : "no-allocate");
+    }
+    printf("  Inclusion: %s\n", inclusionNames[config->inclusion]);
+    if (opts->tracePath) {
+        printf("Trace: %s  Accesses: %ld  Writes: %ld", opts->tracePath, n, sim->writes);
+        if (sim->fetches > 0) printf("  Fetches: %ld", sim->fetches);
+        printf("\n\n");
+    } else {
+        printf("Pattern: %s  Seed: %u  Accesses: %ld\n\n", patternNames[opts->pattern], opts->seed, n);
+    }
+
+    // The two halves of a split L1 see the fetches and the loads/stores, L2 on whatever both missed
+    long reaching = n;
+    for (int pos = firstPos; pos < sim->numLevels; pos++) {
+        int i = (pos < 0) ? L1I_LEVEL : pos;
+        long hits = stats->levels[i].hits;
+        long accesses = (pos < 0) ? fetches : (pos == 0) ? n - fetches : reaching;
+        printf("%s Cache Statistics:\n", batchLevelName(sim, i));
+        printf("  Hits: %ld (%.2f%%)\n", hits, accesses ? (float)hits / accesses * 100 : 0);
+        printf("  Misses: %ld (%.2f%%)\n", accesses - hits, accesses ? (float)(accesses - hits) / accesses * 100 : 0);
+        const Prefetcher *pf = &sim->levels[i].prefetcher;
+        if (pf->kind != PREFETCH_NONE) {
+            // Coverage: the share of the misses the level would have had that prefetches removed
+            const LevelStats *level = &stats->levels[i];
+            long wouldMiss = accesses - hits + level->useful_prefetches;
+            printf("  Prefetcher: %s, degree %d\n", prefetcherNames[pf->kind], pf->degree);
+            printf("  Prefetches: %ld issued, %ld useful (accuracy %.2f%%, coverage %.2f%%), %ld pollution misses\n",
+                   level->prefetches, level->useful_prefetches,
+                   level->prefetches ? (float)level->useful_prefetches / level->prefetches * 100 : 0,
+                   wouldMiss ? (float)level->useful_prefetches / wouldMiss * 100 : 0, level->prefetch_pollution);
+        }
+        printf("\n");
+        if (pos == 0 && config->victimLines > 0) {
+            long dataMisses = n - fetches - hits;
+            printf("Victim Cache (%d lines, %d cycles):\n", config->victimLines, config->victimCost);
+            printf("  Hits: %ld (%.2f%% of %s misses)\n\n", stats->victim_hits,
+                   dataMisses ? (float)stats->victim_hits / dataMisses * 100 : 0, batchLevelName(sim, 0));
+        }
+        if (pos == 0) reaching = l1Misses - stats->victim_hits;
+        else if (pos > 0) reaching -= hits;
+    }
+    printf("Write Traffic:\n");
+    printf("  Writebacks:");
+    for (int pos = firstPos; pos < sim->numLevels; pos++) {
+        int i = (pos < 0) ? L1I_LEVEL : pos;
+        printf("%s %s %ld", (pos > firstPos) ? "," : "", batchLevelName(sim, i), stats->levels[i].writebacks);
+    }
+    printf("\n");
+    for (int i = 1; i <= sim->numLevels; i++) {
+        char below[16] = "memory";
+        if (i < sim->numLevels) snprintf(below, sizeof(below), "L%d", i + 1);
+        printf("  L%d <-> %s: %ld bytes read, %ld bytes written\n", i, below,
+               stats->levels[i].read_bytes, stats->levels[i].write_bytes);
+    }
+    printf("  Writeback/write-through cost: %ld cycles\n\n", stats->write_cost);
+    // Every core has its own copy of the private levels
+    long totalLines = sim->splitL1 ? (long)config->l1i.lines * sim->cores : 0;
+    for (int i = 0; i < sim->numLevels; i++) {
+        totalLines += (long)config->levels[i].lines * ((i < sim->privateLevels) ? sim->cores : 1);
+    }
+    printf("Inclusion:\n");
+    printf("  Effective capacity: %ld of %ld lines (%ld bytes) held at the end of the run\n",
+           stats->resident_lines, totalLines, stats->resident_lines * config->lineSize);
+    printf("  Inclusion victims: %ld upper-level lines back-invalidated\n\n", inclusionVictims);
+    if (sim->cores > 1) {
+        printf("Coherence (MESI, %d cores, private L1", sim->cores);
+        if (sim->privateLevels > 1) printf("-L%d", sim->privateLevels);
+        if (sim->privateLevels < sim->numLevels) printf(", shared L%d", sim->privateLevels + 1);
+        if (sim->privateLevels + 1 < sim->numLevels) printf("-L%d", sim->numLevels);
+        printf("):\n");
+        printf("  Coherence misses: %ld (%ld false sharing)\n", stats->coherence_misses, stats->false_sharing_misses);
+        printf("  Invalidations: %ld  Upgrades: %ld  Interventions: %ld\n",
+               stats->invalidations, stats->upgrades, stats->interventions);
+        for (int core = 0; core < sim->cores; core++) {
+            const CoreStats *c = &sim->coreStats[core];
+            printf("  Core %d: %ld accesses, %ld private hits (%.2f%%), %ld coherence misses, "
+                   "%ld copies invalidated, %ld upgrades\n", core, c->accesses, c->private_hits,
+                   c->accesses ? (float)c->private_hits / c->accesses * 100 : 0, c->coherence_misses,
+                   c->invalidations, c->upgrades);
+        }
+        printf("\n");
+    }
+    printf("Performance Metrics:\n");
+    printf("  Total Hit Rate: %.2f%%\n", stats->hit_rate);
+    printf("  Total Cycle Cost: %ld cycles\n", stats->total_cost);
+    printf("  Average Memory Access Time (AMAT): %.2f cycles\n", stats->avg_access_time);
+    if (config->mshrs > 0) {
+        printf("  Non-blocking L1 (%d MSHRs per core): %ld cycles elapsed, AMAT %.2f cycles blocking\n",
+               config->mshrs, stats->elapsed_cycles, stats->blocking_access_time);
+        printf("  MSHR merges: %ld  Stall cycles: %ld\n", stats->mshr_merges, stats->mshr_stall_cycles);
+    }
+    printf("\n");
+    if (sim->latencies != NULL) printTimingResults(sim);
+    if (sim->hitStats != NULL) printHitStatistics(sim);
+}
+
+// Print the speed of one mapping scheme's access kernel
+void printThroughputResults(const BatchOptions *opts, const MappingSimulator *sim) {
+    double rate = (sim->seconds > 0) ? sim->accesses / sim->seconds : 0;
+
+    if (opts->format == OUTPUT_CSV) {
+        printf("%s,%s,%s,%s,%s,%ld,%.6f,%.0f,%.4f\n",
+               mappingNames[sim->mapping], sim->config->name, batchPolicyName(sim), batchSourceName(opts), batchSeedName(opts),
+               sim->accesses, sim->seconds, rate, sim->stats.hit_rate);
+        return;
+    }
+
+    printf("%-18s | %-12s | %-6s | %10ld accesses | %9.4f s | %14.0f accesses/s | hit rate %6.2f%%\n",
+           mappingNames[sim->mapping], sim->config->name, batchPolicyName(sim), sim->accesses, sim->seconds, rate,
+           sim->stats.hit_rate);
+}
+
+// Print one mapping scheme as a row of the sweep table
+void printSweepRow(const MappingSimulator *sim) {
+    const CacheConfig *config = sim->config;
+    const CacheStats *stats = &sim->stats;
+
+    char geometry[96] = "", hits[96] = "";
+    long writebacks = 0;
+
+    // "lines x ways" and hits of every level, L1 first; a split L1 shows as L1I+L1D
+    for (int pos = sim->splitL1 ? -1 : 0, g = 0, h = 0; pos < sim->numLevels; pos++) {
+        int i = (pos < 0) ? L1I_LEVEL : pos;
+        const char *separator = (pos < 0 || (pos == 0 && !sim->splitL1)) ? "" : (pos == 0) ? "+" : " ";
+        g += snprintf(geometry + g, sizeof(geometry) - g, "%s%dx%d", separator,
+                      sim->levels[i].config.lines, sim->levels[i].geometry.ways);
+        h += snprintf(hits + h, sizeof(hits) - h, "%s%ld", (pos > 0) ? " / " : separator, stats->levels[i].hits);
+        writebacks += stats->levels[i].writebacks;
+    }
+    printf("%-12s | %-18s | %-6s | %-9s | %-24s | %4d | %-30s | %10ld | %10ld | %9ld | %7.2f%% | %8.2f\n",
+           config->name, mappingNames[sim->mapping], batchPolicyName(sim), inclusionNames[config->inclusion],
+           geometry, config->lineSize, hits, stats->memory_accesses, writebacks,
+           stats->resident_lines, stats->hit_rate, stats->avg_access_time);
+}
+
+// Report a finished mapping scheme in the form selected by opts
+void printSimulatorResults(const BatchOptions *opts, const MappingSimulator *sim) {
+    if (opts->throughput) {
+        printThroughputResults(opts, sim);
+    } else if (opts->format == OUTPUT_TEXT && opts->configs.count > 1) {
+        printSweepRow(sim);
+    } else {
+        printBatchResults(opts, sim);
+    }
+}
+
+// Feed every selected mapping scheme from the binary trace, window by window
+int replayMappedTrace(const char *path, MappingSimulator *sims, int numSims) {
+    MappedTrace trace;
+    if (openMappedTrace(path, &trace) != 0) return 1;
+
+    for (uint64_t pos = 0; pos < trace.count; pos += TRACE_CHUNK_RECORDS) {
+        size_t n = (trace.count - pos < TRACE_CHUNK_RECORDS) ? (size_t)(trace.count - pos) : TRACE_CHUNK_RECORDS;
+        for (int s = 0; s < numSims; s++) {
+            simulateTraceChunk(&sims[s], trace.records + pos, n);
+        }
+        releaseMappedTrace(&trace, pos + n);
+    }
+
+    closeMappedTrace(&trace);
+    return 0;
+}
+
+// Feed every selected mapping scheme from a text trace through the bounded reader pipeline
+int replayTextTrace(const char *path, MappingSimulator *sims, int numSims) {
+    TraceStream stream;
+    if (openTraceStream(path, &stream) != 0) return 1;
+
+    const TraceRecord *records;
+    size_t n;
+    while ((n = nextTraceStreamChunk(&stream, &records)) > 0) {
+        for (int s = 0; s < numSims; s++) {
+            simulateTraceChunk(&sims[s], records, n);
+        }
+    }
+
+    return closeTraceStream(&stream, path);
+}
+
+// Binary traces are memory-mapped, anything else is read as a (compressed) text trace
+int replayTraceFile(const char *path, MappingSimulator *sims, int numSims) {
+    if (isBinaryTrace(path)) {
+        return replayMappedTrace(path, sims, numSims);
+    }
+    return replayTextTrace(path, sims, numSims);
+}
+
+// Feed every selected mapping scheme from the synthetic pattern generator
+int replaySyntheticTrace(const BatchOptions *opts, MappingSimulator *sims, int numSims) {
+    TraceRecord *chunk = (TraceRecord *)malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    if (chunk == NULL) {
+        fprintf(stderr, "Memory allocation failed for trace chunk\n");
+        return 1;
+    }
+
+    SyntheticTrace gen;
+    initSyntheticTrace(&gen, opts->pattern, opts->seed, opts->addressSpace);
+    for (long done = 0; done < opts->numAccesses; ) {
+        long remaining = opts->numAccesses - done;
+        size_t n = (remaining < TRACE_CHUNK_RECORDS) ? (size_t)remaining : TRACE_CHUNK_RECORDS;
+        fillSyntheticTrace(&gen, chunk, n);
+        for (int s = 0; s < numSims; s++) {
+            simulateTraceChunk(&sims[s], chunk, n);
+        }
+        done += n;
+    }
+
+    free(chunk);
+    return 0;
+}
+
+// Whether a configuration runs a mapping scheme; in a policy sweep the direct-mapped
+// caches, which have no replacement choice, only run with the LRU copy
+bool simulatesMapping(const BatchOptions *opts, const CacheConfig *config, MappingType mapping) {
+    if (opts->mapping != MAPPING_ALL && opts->mapping != mapping) return false;
+    return !(mapping == MAPPING_DIRECT && opts->allPolicies && config->policy != POLICY_LRU);
+}
+
+// Number of (configuration, mapping) pairs of a batch run
+int countBatchTasks(const BatchOptions *opts) {
+    int count = 0;
+    for (int c = 0; c < opts->configs.count; c++) {
+        for (int m = MAPPING_DIRECT; m <= MAPPING_SET_ASSOCIATIVE; m++) {
+            count += simulatesMapping(opts, &opts->configs.configs[c], (MappingType)m);
+        }
+    }
+    return count;
+}
+
+// Simulate the mapping schemes of one configuration in 'arena', reset once they are reported
+int runBatchConfig(const BatchOptions *opts, const CacheConfig *config, Arena *arena) {
+    MappingSimulator sims[3];
+    int numSims = 0;
+    int status = 1;
+
+    for (int m = MAPPING_DIRECT; m <= MAPPING_SET_ASSOCIATIVE; m++) {
+        if (simulatesMapping(opts, config, (MappingType)m)) {
+            if (initMappingSimulator(&sims[numSims], (MappingType)m, config, arena) != 0) {
+                fprintf(stderr, "Memory allocation failed for config '%s'\n", config->name);
+                goto cleanup;
+            }
+            numSims++;
+            if (attachHitStatistics(opts, &sims[numSims - 1]) != 0) goto cleanup;
+        }
+    }
+
+    status = opts->tracePath ? replayTraceFile(opts->tracePath, sims, numSims)
+                             : replaySyntheticTrace(opts, sims, numSims);
+    if (status != 0) goto cleanup;
+
+    for (int s = 0; s < numSims; s++) {
+        finishMappingSimulator(&sims[s]);
+        printSimulatorResults(opts, &sims[s]);
+    }
+
+cleanup:
+    for (int s = 0; s < numSims; s++) {
+        freeMappingSimulator(&sims[s]);
+    }
+    resetArena(arena);
+    return status;
+}
+
+//-- parallel configuration sweep--
+
+#define SWEEP_RING_SLOTS 4   // Trace chunks in flight between the reader and the sweep workers
+#define SWEEP_WAVE_TASKS 64  // Sweep tasks holding simulator state at the same time
+
+// Whole trace held in memory, only for consumers that look over all of it at once
+// (the next-use index of OPT); everything else streams the trace chunk by chunk
+typedef struct {
+    const TraceRecord *records;
+    size_t count;
+    TraceRecord *owned;   // Heap copy for text and synthetic sources
+    MappedTrace mapped;   // Binary traces are mapped once and never released early
+    bool isMapped;
+} SharedTrace;
+
+// One (configuration, mapping) pair. Its simulator lives in its own arena, so any worker
+// can take it through the next chunk
+typedef struct {
+    const CacheConfig *config;
+    MappingType mapping;
+    const long *nextUse;  // Next-use index for OPT, shared by tasks with the same line size
+    MappingSimulator sim;
+    Arena arena;
+    long chunks;          // Chunks simulated so far
+    bool started;         // Simulator set up
+    bool parked;          // Caught up with the published chunks, in no deque until the next one
+    bool final;           // Queued to be finished: the source is exhausted and every chunk simulated
+    bool closed;          // Finished or failed
+    int status;
+} SweepTask;
+
+// Tasks queued on one worker, each ready for its next chunk. The owner takes its newest task,
+// whose state it has just touched; idle workers steal the oldest
+typedef struct {
+    pthread_mutex_t lock;
+    int *tasks;                  // Ring of task indices, a slot for every task of the wave
+    int head;                    // Oldest task
+    int count;
+} SweepDeque;
+
+// Ring slot holding one trace chunk until every live task has simulated it
+typedef struct {
+    TraceRecord *buffer;         // Copy of a streamed chunk, unused for in-place sources
+    const TraceRecord *records;
+    size_t count;
+    uint64_t end;                // Source position after the chunk
+    int pending;                 // Live tasks that have not simulated it yet
+} SweepChunk;
+
+// Address source of a sweep, read chunk by chunk in trace order
+typedef struct {
+    const SharedTrace *whole;    // Trace loaded in full, NULL when streaming
+    MappedTrace mapped;
+    bool isMapped;
+    TraceStream stream;
+    bool isStream;
+    SyntheticTrace gen;
+    uint64_t position;
+    uint64_t count;              // Records of an in-place or synthetic source
+} SweepSource;
+
+typedef struct {
+    SweepTask *tasks;
+    int numTasks;
+    int numWorkers;
+    SweepDeque *deques;          // One per worker
+    int idleWorkers;             // Workers waiting for a task to be queued
+    SweepChunk ring[SWEEP_RING_SLOTS];
+    long published;              // Chunks handed to the workers
+    bool finished;               // The source is exhausted
+    int liveTasks;
+    int closedTasks;
+    pthread_mutex_t lock;
+    pthread_cond_t work;         // A task was queued or the sweep ended
+    pthread_cond_t slotFree;     // The oldest chunk was simulated by every live task
+    const BatchOptions *opts;
+} SweepPool;
+
+typedef struct {
+    SweepPool *pool;
+    int id;
+} SweepWorker;
+
+void freeSharedTrace(SharedTrace *trace) {
+    if (trace->isMapped) closeMappedTrace(&trace->mapped);
+    free(trace->owned);
+    memset(trace, 0, sizeof(*trace));
+}
+
+// Append a chunk to a growing heap trace, returns 0 on success
+static int appendSharedTrace(SharedTrace *trace, size_t *capacity, const TraceRecord *records, size_t n) {
+    if (trace->count + n > *capacity) {
+        size_t newCapacity = *capacity ? *capacity : TRACE_CHUNK_RECORDS;
+        while (newCapacity < trace->count + n) newCapacity *= 2;
+        TraceRecord *grown = (TraceRecord *)realloc(trace->owned, newCapacity * sizeof(TraceRecord));
+        if (grown == NULL) return 1;
+        trace->owned = grown;
+        *capacity = newCapacity;
+    }
+    memcpy(trace->owned + trace->count, records, n * sizeof(TraceRecord));
+    trace->count += n;
+    trace->records = trace->owned;
+    return 0;
+}
+
+// Read the whole batch address source into memory. Its size grows with the trace, so only
+// consumers that need every record at once call this
+int loadSharedTrace(const BatchOptions *opts, SharedTrace *trace) {
+    memset(trace, 0, sizeof(*trace));
+
+    if (opts->tracePath && isBinaryTrace(opts->tracePath)) {
+        if (openMappedTrace(opts->tracePath, &trace->mapped) != 0) return 1;
+        madvise(trace->mapped.map, trace->mapped.mapSize, MADV_WILLNEED);
+        trace->isMapped = true;
+        trace->records = trace->mapped.records;
+        trace->count = (size_t)trace->mapped.count;
+        return 0;
+    }
+
+    if (opts->tracePath) {
+        TraceStream stream;
+        if (openTraceStream(opts->tracePath, &stream) != 0) return 1;
+
+        const TraceRecord *records;
+        size_t n, capacity = 0;
+        int status = 0;
+        while (status == 0 && (n = nextTraceStreamChunk(&stream, &records)) > 0) {
+            status = appendSharedTrace(trace, &capacity, records, n);
+        }
+        if (status != 0) fprintf(stderr, "Memory allocation failed while loading '%s'\n", opts->tracePath);
+        if (closeTraceStream(&stream, opts->tracePath) != 0) status = 1;
+        if (status != 0) freeSharedTrace(trace);
+        return status;
+    }
+
+    trace->owned = (TraceRecord *)malloc((size_t)opts->numAccesses * sizeof(TraceRecord));
+    if (trace->owned == NULL) {
+        fprintf(stderr, "Memory allocation failed for %ld trace records\n", opts->numAccesses);
+        return 1;
+    }
+    SyntheticTrace gen;
+    initSyntheticTrace(&gen, opts->pattern, opts->seed, opts->addressSpace);
+    fillSyntheticTraceParallel(&gen, trace->owned, (size_t)opts->numAccesses, opts->jobs);
+    trace->records = trace->owned;
+    trace->count = (size_t)opts->numAccesses;
+    return 0;
+}
+
+// Open the sweep's source: the loaded trace if there is one, else the binary trace window
+// by window, the text trace through the reader pipeline or the synthetic generator
+static int openSweepSource(const BatchOptions *opts, const SharedTrace *whole, SweepSource *source) {
+    memset(source, 0, sizeof(*source));
+    if (whole != NULL) {
+        source->whole = whole;
+        source->count = whole->count;
+    } else if (opts->tracePath && isBinaryTrace(opts->tracePath)) {
+        if (openMappedTrace(opts->tracePath, &source->mapped) != 0) return 1;
+        source->isMapped = true;
+        source->count = source->mapped.count;
+    } else if (opts->tracePath) {
+        if (openTraceStream(opts->tracePath, &source->stream) != 0) return 1;
+        source->isStream = true;
+    } else {
+        initSyntheticTrace(&source->gen, opts->pattern, opts->seed, opts->addressSpace);
+        source->count = (uint64_t)opts->numAccesses;
+    }
+    return 0;
+}
+
+// Next chunk of the source, in place for loaded and mapped traces, copied into 'buffer'
+// otherwise. Returns its record count, 0 at the end of the trace
+static size_t nextSweepChunk(SweepSource *source, TraceRecord *buffer, const TraceRecord **records) {
+    size_t n;
+    if (source->isStream) {
+        n = nextTraceStreamChunk(&source->stream, records);
+        if (n > 0) memcpy(buffer, *records, n * sizeof(TraceRecord));
+        *records = buffer;
+    } else {
+        uint64_t remaining = source->count - source->position;
+        n = (remaining < TRACE_CHUNK_RECORDS) ? (size_t)remaining : TRACE_CHUNK_RECORDS;
+        if (source->whole != NULL) {
+            *records = source->whole->records + source->position;
+        } else if (source->isMapped) {
+            *records = source->mapped.records + source->position;
+        } else {
+            fillSyntheticTrace(&source->gen, buffer, n);
+            *records = buffer;
+        }
+    }
+    source->position += n;
+    return n;
+}
+
+// Close the source, returns nonzero if the trace could not be read to its end
+static int closeSweepSource(SweepSource *source, const char *path) {
+    if (source->isMapped) closeMappedTrace(&source->mapped);
+    return source->isStream ? closeTraceStream(&source->stream, path) : 0;
+}
+
+// Queue a task on a worker's deque. Called with the pool lock held, so a worker that finds
+// every deque empty under the lock cannot miss the task
+static void pushSweepTask(SweepPool *pool, int worker, int index) {
+    SweepDeque *deque = &pool->deques[worker];
+    pthread_mutex_lock(&deque->lock);
+    deque->tasks[(deque->head + deque->count) % pool->numTasks] = index;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// The newest task of the worker's own deque, else the oldest task of the next worker that
+// has one; -1 if every deque is empty
+static int popSweepTask(SweepPool *pool, int worker) {
+    for (int k = 0; k < pool->numWorkers; k++) {
+        SweepDeque *deque = &pool->deques[(worker + k) % pool->numWorkers];
+        int index = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->count > 0 && k == 0) {
+            index = deque->tasks[(deque->head + deque->count - 1) % pool->numTasks];
+            deque->count--;
+        } else if (deque->count > 0) {
+            index = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) % pool->numTasks;
+            deque->count--;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if (index >= 0) return index;
+    }
+    return -1;
+}
+
+// Queue a task on 'worker' if it has a published chunk left or the source is exhausted,
+// otherwise park it until the next chunk is published. Called with the pool lock held
+static void readySweepTask(SweepPool *pool, int index, int worker) {
+    SweepTask *task = &pool->tasks[index];
+    task->parked = task->chunks >= pool->published && !pool->finished;
+    if (task->parked) return;
+    task->final = task->chunks >= pool->published;
+    pushSweepTask(pool, worker, index);
+}
+
+// Workers run the tasks of their own deque and steal when it runs dry. The pool lock is only
+// taken to finish a chunk, O(1) per task and chunk of TRACE_CHUNK_RECORDS accesses, and to
+// sleep when every deque is empty; the feeder holds it for O(tasks) once per chunk
+static void *sweepWorker(void *arg) {
+    SweepWorker *worker = (SweepWorker *)arg;
+    SweepPool *pool = worker->pool;
+
+    while (true) {
+        int index = popSweepTask(pool, worker->id);
+        if (index < 0) {
+            pthread_mutex_lock(&pool->lock);
+            while ((index = popSweepTask(pool, worker->id)) < 0 && pool->closedTasks < pool->numTasks) {
+                pool->idleWorkers++;
+                pthread_cond_wait(&pool->work, &pool->lock);
+                pool->idleWorkers--;
+            }
+            pthread_mutex_unlock(&pool->lock);
+            if (index < 0) break;
+        }
+        SweepTask *task = &pool->tasks[index];
+        // The slot is not reused before this task has simulated it
+        const SweepChunk *chunk = task->final ? NULL : &pool->ring[task->chunks % SWEEP_RING_SLOTS];
+
+        bool failed = false;
+        if (!task->started) {
+            task->started = true;
+            failed = initMappingSimulator(&task->sim, task->mapping, task->config, &task->arena) != 0 ||
+                     attachHitStatistics(pool->opts, &task->sim) != 0;
+            task->sim.nextUse = task->nextUse;
+        }
+        if (!failed && chunk != NULL) {
+            simulateTraceChunk(&task->sim, chunk->records, chunk->count);
+        } else {
+            if (!failed) finishMappingSimulator(&task->sim);
+            releaseSimulatorState(&task->sim);
+            freeArena(&task->arena);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (failed) {
+            // Nothing waits for a failed task: drop it from the chunks still pending on it
+            for (long k = task->chunks; k < pool->published; k++) pool->ring[k % SWEEP_RING_SLOTS].pending--;
+            pool->liveTasks--;
+            task->status = 1;
+            task->closed = true;
+            pool->closedTasks++;
+            pthread_cond_signal(&pool->slotFree);
+        } else if (chunk != NULL) {
+            if (--pool->ring[task->chunks % SWEEP_RING_SLOTS].pending == 0) pthread_cond_signal(&pool->slotFree);
+            task->chunks++;
+            // Kept on this worker, where an idle one can steal it
+            readySweepTask(pool, index, worker->id);
+            if (!task->parked && pool->idleWorkers > 0) pthread_cond_signal(&pool->work);
+        } else {
+            task->status = 0;
+            task->closed = true;
+            pool->closedTasks++;
+        }
+        if (pool->closedTasks == pool->numTasks) pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+// Read the source into the ring of chunks, waiting for the workers to drain the oldest slot
+// before reusing it. Mapped pages behind a drained chunk are handed back to the kernel
+static void feedSweep(SweepPool *pool, SweepSource *source) {
+    size_t n;
+    do {
+        SweepChunk *slot = &pool->ring[pool->published % SWEEP_RING_SLOTS];  // Only this thread publishes
+        pthread_mutex_lock(&pool->lock);
+        while (slot->pending > 0) pthread_cond_wait(&pool->slotFree, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        if (source->isMapped && slot->count > 0) releaseMappedTrace(&source->mapped, slot->end);
+
+        const TraceRecord *records;
+        n = nextSweepChunk(source, slot->buffer, &records);
+
+        pthread_mutex_lock(&pool->lock);
+        if (n > 0) {
+            slot->records = records;
+            slot->count = n;
+            slot->end = source->position;
+            slot->pending = pool->liveTasks;
+            pool->published++;
+        } else {
+            pool->finished = true;
+        }
+        // Parked tasks go back to the deques they started on
+        for (int t = 0; t < pool->numTasks; t++) {
+            if (pool->tasks[t].parked && !pool->tasks[t].closed) readySweepTask(pool, t, t % pool->numWorkers);
+        }
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    } while (n > 0);
+}
+
+// Whether the sweep runs OPT, whose next-use index needs the whole trace in memory
+bool sweepNeedsWholeTrace(const BatchOptions *opts) {
+    for (int c = 0; c < opts->configs.count; c++) {
+        if (configUsesPolicy(&opts->configs.configs[c], POLICY_OPT)) return true;
+    }
+    return false;
+}
+
+// Stream the trace once through a pool of threads simulating 'numTasks' tasks, returns 0 once
+// the source was read to its end; a task that could not be set up has a nonzero status
+static int runSweepWave(const BatchOptions *opts, const SharedTrace *whole, SweepTask *tasks, int numTasks) {
+    int numWorkers = (opts->jobs < numTasks) ? opts->jobs : numTasks;
+    if (numWorkers < 1) numWorkers = 1;
+    int status = 1;
+
+    SweepPool pool;
+    memset(&pool, 0, sizeof(pool));
+    SweepSource source;
+    bool sourceOpen = false;
+    pthread_t *threads = (pthread_t *)malloc(numWorkers * sizeof(pthread_t));
+    SweepWorker *workers = (SweepWorker *)malloc(numWorkers * sizeof(SweepWorker));
+    SweepDeque *deques = (SweepDeque *)calloc(numWorkers, sizeof(SweepDeque));
+    if (threads == NULL || workers == NULL || deques == NULL) {
+        fprintf(stderr, "Memory allocation failed for %d sweep threads\n", numWorkers);
+        goto cleanup;
+    }
+    for (int w = 0; w < numWorkers; w++) {
+        deques[w].tasks = (int *)malloc(numTasks * sizeof(int));
+        if (deques[w].tasks == NULL) {
+            fprintf(stderr, "Memory allocation failed for %d sweep threads\n", numWorkers);
+            goto cleanup;
+        }
+    }
+
+    // Streamed text and synthetic chunks are copied into the ring, the others are read in place
+    for (int s = 0; s < SWEEP_RING_SLOTS && whole == NULL && !(opts->tracePath && isBinaryTrace(opts->tracePath)); s++) {
+        pool.ring[s].buffer = (TraceRecord *)malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+        if (pool.ring[s].buffer == NULL) {
+            fprintf(stderr, "Memory allocation failed for trace chunk\n");
+            goto cleanup;
+        }
+    }
+
+    if (openSweepSource(opts, whole, &source) != 0) goto cleanup;
+    sourceOpen = true;
+
+    pool.tasks = tasks;
+    pool.numTasks = numTasks;
+    pool.numWorkers = numWorkers;
+    pool.deques = deques;
+    pool.liveTasks = numTasks;
+    pool.opts = opts;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.slotFree, NULL);
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_mutex_init(&deques[w].lock, NULL);
+    }
+    // Every task waits for the first chunk
+    for (int t = 0; t < numTasks; t++) {
+        tasks[t].parked = true;
+    }
+
+    int started = 0;
+    for (; started < numWorkers; started++) {
+        workers[started].pool = &pool;
+        workers[started].id = started;
+        if (pthread_create(&threads[started], NULL, sweepWorker, &workers[started]) != 0) break;
+    }
+    // Idle workers steal from every deque, so the wave runs on the threads that did start
+    if (started == 0) {
+        fprintf(stderr, "Cannot start sweep threads\n");
+    } else {
+        feedSweep(&pool, &source);
+        for (int w = 0; w < started; w++) {
+            pthread_join(threads[w], NULL);
+        }
+        status = 0;
+    }
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.work);
+    pthread_cond_destroy(&pool.slotFree);
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_mutex_destroy(&deques[w].lock);
+    }
+
+cleanup:
+    if (sourceOpen && closeSweepSource(&source, opts->tracePath) != 0) status = 1;
+    for (int s = 0; s < SWEEP_RING_SLOTS; s++) {
+        free(pool.ring[s].buffer);
+    }
+    for (int w = 0; deques != NULL && w < numWorkers; w++) {
+        free(deques[w].tasks);
+    }
+    free(deques);
+    free(threads);
+    free(workers);
+    return status;
+}
+
+// Simulate every (configuration, mapping) pair on a work-stealing pool of threads and print
+// the results in configuration order once all of them are done. The trace is streamed to the workers in
+// bounded chunks, each task simulating every chunk in order on its own state. At most
+// SWEEP_WAVE_TASKS tasks hold state at once, so longer sweeps read the trace once per wave.
+// The trace is only loaded in full when OPT needs its next-use index
+int runParallelSweep(const BatchOptions *opts) {
+    SharedTrace trace = {0};
+    bool wholeTrace = sweepNeedsWholeTrace(opts);
+    if (wholeTrace && loadSharedTrace(opts, &trace) != 0) return 1;
+
+    int numTasks = countBatchTasks(opts);
+    int status = 1;
+
+    SweepTask *tasks = (SweepTask *)calloc(numTasks, sizeof(SweepTask));
+    long **nextUse = (long **)calloc(opts->configs.count, sizeof(long *));  // Owned by the first config of a line size
+    if (tasks == NULL || nextUse == NULL) {
+        fprintf(stderr, "Memory allocation failed for %d sweep tasks\n", numTasks);
+        goto cleanup;
+    }
+
+    int t = 0;
+    for (int c = 0; c < opts->configs.count; c++) {
+        const CacheConfig *config = &opts->configs.configs[c];
+        const long *configNextUse = NULL;
+
+        // OPT configurations share one next-use index per line size, built before the workers start
+        if (configUsesPolicy(config, POLICY_OPT)) {
+            for (int k = 0; k < c && configNextUse == NULL; k++) {
+                if (nextUse[k] != NULL && opts->configs.configs[k].lineSize == config->lineSize) configNextUse = nextUse[k];
+            }
+            if (configNextUse == NULL) {
+                nextUse[c] = buildNextUseIndex(trace.records, trace.count, config->lineSize, NULL);
+                if (nextUse[c] == NULL) {
+                    fprintf(stderr, "Memory allocation failed for the next-use index of config '%s'\n", config->name);
+                    goto cleanup;
+                }
+                configNextUse = nextUse[c];
+            }
+        }
+
+        for (int m = MAPPING_DIRECT; m <= MAPPING_SET_ASSOCIATIVE; m++) {
+            if (!simulatesMapping(opts, config, (MappingType)m)) continue;
+            tasks[t].config = config;
+            tasks[t].mapping = (MappingType)m;
+            tasks[t].nextUse = configNextUse;
+            tasks[t].status = -1;
+            t++;
+        }
+    }
+
+    status = 0;
+    for (int first = 0; first < numTasks && status == 0; first += SWEEP_WAVE_TASKS) {
+        int n = (numTasks - first < SWEEP_WAVE_TASKS) ? numTasks - first : SWEEP_WAVE_TASKS;
+        status = runSweepWave(opts, wholeTrace ? &trace : NULL, tasks + first, n);
+    }
+
+    for (int t = 0; t < numTasks && status == 0; t++) {
+        if (tasks[t].status != 0) {
+            fprintf(stderr, "Memory allocation failed for config '%s'\n", tasks[t].config->name);
+            status = 1;
+            break;
+        }
+        printSimulatorResults(opts, &tasks[t].sim);
+    }
+
+cleanup:
+    if (tasks != NULL) {
+        for (int t = 0; t < numTasks; t++) {
+            freeMappingSimulator(&tasks[t].sim);
+            freeArena(&tasks[t].arena);
+        }
+    }
+    if (nextUse != NULL) {
+        for (int c = 0; c < opts->configs.count; c++) {
+            free(nextUse[c]);
+        }
+    }
+    free(nextUse);
+    free(tasks);
+    freeSharedTrace(&trace);
+    return status;
+}
+
+//-- stack distance analysis--
+
+#define STACK_WINDOW_MIN (1L << 16)  // Access times in a stack distance window before compacting
+
+// LRU stack distances of a trace in one pass (Mattson et al.). A Fenwick tree over
+// access times marks the latest access of every line, so the distance of a reuse is
+// the number of marks between the previous access and now, O(log N) per access.
+// The times live in a window that is compacted when it fills: the marked times are
+// renumbered 1..lines in order, so memory follows the distinct lines, not the trace.
+typedef struct {
+    int lineSize;
+    int offsetBits;
+    bool powerOfTwo;
+    int *fenwick;          // 1-based over window times, 1 = latest access of some line
+    long window;           // Times in the window, at least twice the distinct lines
+    long now;              // Latest time handed out in the window
+    LineMap lastAccess;    // Line -> window time of its latest access
+    long *histogram;       // histogram[d] = reuses at stack distance d, d < distinct lines
+    long histogramSize;
+    long accesses;
+} StackDistanceProfile;
+
+void freeStackDistanceProfile(StackDistanceProfile *profile) {
+    free(profile->fenwick);
+    free(profile->histogram);
+    freeLineMap(&profile->lastAccess);
+    memset(profile, 0, sizeof(*profile));
+}
+
+// Profile a trace of any length with the given line size, returns 0 on success
+int initStackDistanceProfile(StackDistanceProfile *profile, int lineSize) {
+    memset(profile, 0, sizeof(*profile));
+    profile->lineSize = lineSize;
+    profile->powerOfTwo = isPowerOfTwo(lineSize);
+    profile->offsetBits = log2Int(lineSize);
+    profile->window = STACK_WINDOW_MIN;
+    profile->histogramSize = 1024;
+    profile->fenwick = (int *)calloc(profile->window + 1, sizeof(int));
+    profile->histogram = (long *)calloc(profile->histogramSize, sizeof(long));
+    if (profile->fenwick == NULL || profile->histogram == NULL || initLineMap(&profile->lastAccess, 1024, NULL) != 0) {
+        freeStackDistanceProfile(profile);
+        return 1;
+    }
+    return 0;
+}
+
+static inline void fenwickAdd(int *tree, long length, long pos, int delta) {
+    for (; pos <= length; pos += pos & -pos) tree[pos] += delta;
+}
+
+static inline long fenwickSum(const int *tree, long pos) {
+    long sum = 0;
+    for (; pos > 0; pos -= pos & -pos) sum += tree[pos];
+    return sum;
+}
+
+// Renumber the latest access of every line 1..lines, keeping their order, and rebuild the
+// tree; the window doubles while the lines fill more than half of it. Returns 0 on success
+static int compactStackWindow(StackDistanceProfile *profile) {
+    LineMap *map = &profile->lastAccess;
+    long lines = map->count;
+    long window = profile->window;
+    while (2 * lines > window) window *= 2;
+
+    long *rank = (long *)calloc(profile->now + 1, sizeof(long));  // Old time -> new time
+    if (rank == NULL) return 1;
+    if (window != profile->window) {
+        int *grown = (int *)realloc(profile->fenwick, (window + 1) * sizeof(int));
+        if (grown == NULL) {
+            free(rank);
+            return 1;
+        }
+        profile->fenwick = grown;
+        profile->window = window;
+    }
+
+    for (long s = 0; s < map->capacity; s++) {
+        if (map->values[s] >= 0) rank[map->values[s]] = 1;
+    }
+    for (long t = 1; t <= profile->now; t++) rank[t] += rank[t - 1];
+    for (long s = 0; s < map->capacity; s++) {
+        if (map->values[s] >= 0) map->values[s] = rank[map->values[s]];
+    }
+    free(rank);
+
+    // Marks at 1..lines, node i covers first..i
+    for (long i = 1; i <= window; i++) {
+        long first = i - (i & -i) + 1;
+        long last = (i < lines) ? i : lines;
+        profile->fenwick[i] = (last >= first) ? (int)(last - first + 1) : 0;
+    }
+    profile->now = lines;
+    return 0;
+}
 
-                printf("Data loaded from Main Memory to L1 (set 0x%01X, way %d) and L2 (set 0x%01X, way %d)\n\n",
-                       l1Set, l1Way, l2Set, l2Way);
+// Make room in the histogram for the distances of one more line, returns 0 on success
+static int growStackHistogram(StackDistanceProfile *profile) {
+    long size = profile->histogramSize * 2;
+    long *grown = (long *)realloc(profile->histogram, size * sizeof(long));
+    if (grown == NULL) return 1;
+    memset(grown + profile->histogramSize, 0, (size - profile->histogramSize) * sizeof(long));
+    profile->histogram = grown;
+    profile->histogramSize = size;
+    return 0;
+}
 
-                // Display cache contents after update
-                displayAssociativeCacheContents(l1Cache, L1_SETS, L1_ASSOCIATIVITY, "L1 Cache");
-                displayAssociativeCacheContents(l2Cache, L2_SETS, L2_ASSOCIATIVITY, "L2 Cache");
+// Record one access, returns 0 on success
+static inline int profileStackDistance(StackDistanceProfile *profile, uint64_t address) {
+    uint64_t line = profile->powerOfTwo ? address >> profile->offsetBits : address / profile->lineSize;
+    if (profile->now == profile->window && compactStackWindow(profile) != 0) return 1;
+    long now = ++profile->now;
+    long slot = findLineMapSlot(&profile->lastAccess, line);
+    long last = profile->lastAccess.values[slot];
+
+    profile->accesses++;
+    if (last >= 0) {
+        long distance = fenwickSum(profile->fenwick, now - 1) - fenwickSum(profile->fenwick, last);
+        profile->histogram[distance]++;
+        fenwickAdd(profile->fenwick, profile->window, last, -1);
+    } else if (profile->lastAccess.count == profile->histogramSize && growStackHistogram(profile) != 0) {
+        return 1;
+    }
+    fenwickAdd(profile->fenwick, profile->window, now, 1);
+    return setLineMap(&profile->lastAccess, slot, line, now);
+}
 
-                printf("\nPress Enter to continue to next memory access...");
-               while (getchar() != '\n'); // Clear input buffer
-               getchar(); // Wait for user input
-                }
-            }
-        }
+// Hits of a fully associative LRU cache with 'lines' lines: reuses closer than 'lines'
+long stackDistanceHits(const StackDistanceProfile *profile, long lines) {
+    long hits = 0;
+    for (long d = 0; d < lines && d < profile->lastAccess.count; d++) {
+        hits += profile->histogram[d];
     }
+    return hits;
+}
 
-    // Calculate final statistics
-    float l1HitRatio = (float)l1Hits / numAccesses;
-    float l2HitRatio = (l1Misses > 0) ? (float)l2Hits / l1Misses : 0;
-    float amat = L1_ACCESS_COST + (1 - l1HitRatio) * (L2_ACCESS_COST + (1 - l2HitRatio) * MEMORY_ACCESS_COST);
+static int compareLong(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
 
-    // Display final statistics
-    clearScreen();
-    printf("Memory Hierarchy Simulation Complete (Set Associative)\n");
-    printf("---------------------------------------------------\n\n");
-    printf("Cache Architecture:\n");
-    printf("------------------\n");
-    printf("  Cache Policy: Inclusive (L2 contains all entries in L1)\n");
-    printf("  L1 Cache: %d-way set associative with %d sets, %d-byte lines (%d words per line)\n",
-           L1_ASSOCIATIVITY, L1_SETS, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
-    printf("  L2 Cache: %d-way set associative with %d sets, %d-byte lines (%d words per line)\n\n",
-           L2_ASSOCIATIVITY, L2_SETS, WORDS_PER_LINE * WORD_SIZE, WORDS_PER_LINE);
+// Print the hit rate curve: every power of two up to the footprint plus the configured sizes
+void printStackDistanceProfile(const BatchOptions *opts, const StackDistanceProfile *profile) {
+    long sizes[80];
+    int numSizes = 0;
 
-    printf("Simulation Results:\n");
-    printf("------------------\n");
-    printf("Total memory accesses: %d\n\n", numAccesses);
+    for (long lines = 1; numSizes < 64; lines *= 2) {
+        sizes[numSizes++] = lines;
+        if (lines >= profile->lastAccess.count) break;
+    }
+    for (int c = 0; c < opts->configs.count; c++) {
+        const CacheConfig *config = &opts->configs.configs[c];
+        if (config->lineSize != profile->lineSize ||
+            numSizes + config->numLevels > (int)(sizeof(sizes) / sizeof(sizes[0]))) continue;
+        for (int i = 0; i < config->numLevels; i++) sizes[numSizes++] = config->levels[i].lines;
+    }
+    qsort(sizes, numSizes, sizeof(long), compareLong);
+
+    if (opts->format == OUTPUT_TEXT) {
+        printf("Stack Distance Profile (fully associative LRU, %d-byte lines)\n", profile->lineSize);
+        printf("-------------------------------------------------------------\n");
+        printf("Accesses: %ld  Distinct lines: %ld  Cold misses: %ld\n\n",
+               profile->accesses, profile->lastAccess.count, profile->lastAccess.count);
+        printf("   Lines |       Hits |     Misses | Hit Rate\n");
+        printf("-------- | ---------- | ---------- | --------\n");
+    }
 
-    printf("L1 Cache Statistics:\n");
-    printf("  Hits: %d (%.2f%%)\n", l1Hits, l1HitRatio * 100);
-    printf("  Misses: %d (%.2f%%)\n\n", l1Misses, (1 - l1HitRatio) * 100);
+    for (int i = 0; i < numSizes; i++) {
+        if (i > 0 && sizes[i] == sizes[i - 1]) continue;
+        long hits = stackDistanceHits(profile, sizes[i]);
+        double hitRate = profile->accesses ? (double)hits / profile->accesses * 100 : 0;
+        if (opts->format == OUTPUT_CSV) {
+            printf("%s,%s,%d,%ld,%ld,%ld,%ld,%.4f\n", batchSourceName(opts), batchSeedName(opts), profile->lineSize, sizes[i],
+                   profile->accesses, hits, profile->accesses - hits, hitRate);
+        } else {
+            printf("%8ld | %10ld | %10ld | %7.2f%%\n", sizes[i], hits, profile->accesses - hits, hitRate);
+        }
+    }
+    if (opts->format == OUTPUT_TEXT) printf("\n");
+}
 
-    printf("L2 Cache Statistics:\n");
-    printf("  Hits: %d (%.2f%%)\n", l2Hits, l2HitRatio * 100);
-    printf("  Misses: %d (%.2f%%)\n\n", l2Misses, (1 - l2HitRatio) * 100);
+// Per-set LRU stacks for one set count: the depth of a hit in its set's stack is the
+// smallest associativity that still hits, so 1..maxWays ways come out of one pass
+typedef struct {
+    int sets;
+    int maxWays;
+    uint64_t *stacks;      // sets x maxWays lines, most recently used first
+    int *depth;            // Valid entries of every stack
+    long *histogram;       // histogram[w] = hits at stack depth w
+} SetStackProfile;
+
+void freeSetStackProfile(SetStackProfile *profile) {
+    free(profile->stacks);
+    free(profile->depth);
+    free(profile->histogram);
+    memset(profile, 0, sizeof(*profile));
+}
 
-    printf("Performance Metrics:\n");
-    printf("  Total Cycle Cost: %ld cycles\n", totalCycles);
-    printf("  Average Memory Access Time (AMAT): %.2f cycles\n\n", amat);
+// Returns 0 on success
+int initSetStackProfile(SetStackProfile *profile, int sets, int maxWays) {
+    memset(profile, 0, sizeof(*profile));
+    profile->sets = sets;
+    profile->maxWays = maxWays;
+    profile->stacks = (uint64_t *)malloc((size_t)sets * maxWays * sizeof(uint64_t));
+    profile->depth = (int *)calloc(sets, sizeof(int));
+    profile->histogram = (long *)calloc(maxWays, sizeof(long));
+    if (profile->stacks == NULL || profile->depth == NULL || profile->histogram == NULL) {
+        freeSetStackProfile(profile);
+        return 1;
+    }
+    return 0;
+}
 
-    // Display hit address summary
-    if (hitCount > 0) {
-        displayHitSummary(hitInfoArray, hitCount);
+// Record one line number; the set index is the same mask as checkAssociativeCache
+static inline void profileSetStack(SetStackProfile *profile, uint64_t line) {
+    int set = (int)(line & (uint64_t)(profile->sets - 1));
+    uint64_t *stack = profile->stacks + (size_t)set * profile->maxWays;
+    int depth = profile->depth[set];
+    int pos = 0;
+
+    while (pos < depth && stack[pos] != line) pos++;
+    if (pos < depth) {
+        profile->histogram[pos]++;
+    } else if (depth < profile->maxWays) {
+        profile->depth[set] = ++depth;
     } else {
-        printf("No cache hits recorded during this simulation.\n");
+        pos = depth - 1;  // Deeper than maxWays, the least recently used line drops out
     }
-
-    // Free allocated memory
-    free(addresses);
-    free(hitInfoArray);
-  printf("\n===============================================\n");
-    printf("Set Associative Mapping analysis complete.\n");
-    printf("Press Enter to return to main menu...");
-    getchar();
-    getchar();
-    return 0;
+    memmove(stack + 1, stack, pos * sizeof(uint64_t));
+    stack[0] = line;
 }
 
+// Print hits for 1..maxWays ways of every profiled set count
+void printSetStackProfiles(const BatchOptions *opts, const SetStackProfile *profiles, int numProfiles,
+                           int lineSize, long accesses) {
+    if (opts->format == OUTPUT_TEXT) {
+        printf("Set Associative Stack Profile (LRU, %d-byte lines, %ld accesses)\n", lineSize, accesses);
+        printf("-------------------------------------------------------------\n");
+        printf("   Sets | Ways |    Lines |       Hits |     Misses | Hit Rate\n");
+        printf("------- | ---- | -------- | ---------- | ---------- | --------\n");
+    }
 
+    for (int p = 0; p < numProfiles; p++) {
+        const SetStackProfile *profile = &profiles[p];
+        long hits = 0;
+        for (int w = 0; w < profile->maxWays; w++) {
+            hits += profile->histogram[w];
+            long lines = (long)profile->sets * (w + 1);
+            double hitRate = accesses ? (double)hits / accesses * 100 : 0;
+            if (opts->format == OUTPUT_CSV) {
+                printf("%s,%s,%d,%d,%d,%ld,%ld,%ld,%ld,%.4f\n", batchSourceName(opts), batchSeedName(opts), lineSize,
+                       profile->sets, w + 1, lines, accesses, hits, accesses - hits, hitRate);
+            } else {
+                printf("%7d | %4d | %8ld | %10ld | %10ld | %7.2f%%\n",
+                       profile->sets, w + 1, lines, hits, accesses - hits, hitRate);
+            }
+        }
+    }
+    if (opts->format == OUTPUT_TEXT) printf("\n");
+}
 
+// Feed a chunk to the set profiles of one line size
+static void profileSetStackChunk(SetStackProfile *profiles, int numProfiles, int lineSize,
+                                 const TraceRecord *records, size_t n) {
+    int offsetBits = log2Int(lineSize);
+    bool powerOfTwo = isPowerOfTwo(lineSize);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t address = traceAddress(records[i]);
+        uint64_t line = powerOfTwo ? address >> offsetBits : address / lineSize;
+        for (int p = 0; p < numProfiles; p++) {
+            profileSetStack(&profiles[p], line);
+        }
+    }
+}
 
+// Whether an earlier configuration already has this configuration's line size
+static bool repeatedLineSize(const BatchOptions *opts, int c) {
+    for (int k = 0; k < c; k++) {
+        if (opts->configs.configs[k].lineSize == opts->configs.configs[c].lineSize) return true;
+    }
+    return false;
+}
 
+// Stack distance passes for every distinct line size of the configurations, all fed from
+// one streamed read of the trace; the profiles grow with the distinct lines, not the trace
+int runStackDistanceAnalysis(const BatchOptions *opts) {
+    int numSetProfiles = opts->numSetProfiles;
+    int numSizes = 0;
+    int status = 1;
+    SweepSource source;
+    bool sourceOpen = false;
+    int *lineSizes = (int *)malloc(opts->configs.count * sizeof(int));
+    StackDistanceProfile *profiles = (StackDistanceProfile *)calloc(opts->configs.count, sizeof(StackDistanceProfile));
+    SetStackProfile *setProfiles = (SetStackProfile *)calloc((size_t)opts->configs.count * (numSetProfiles ? numSetProfiles : 1),
+                                                             sizeof(SetStackProfile));
+    TraceRecord *chunk = (TraceRecord *)malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    if (lineSizes == NULL || profiles == NULL || setProfiles == NULL || chunk == NULL) {
+        fprintf(stderr, "Memory allocation failed for the stack distance profile\n");
+        goto cleanup;
+    }
 
-// Function to run comparative analysis between all three mappinh
-void compareAllCacheMappings(int numAccesses) {
-    // Statistics for each cache type
-    int dm_l1_hits = 0, dm_l2_hits = 0, dm_memory_accesses = 0;
-    int fa_l1_hits = 0, fa_l2_hits = 0, fa_memory_accesses = 0;
-    int sa_l1_hits = 0, sa_l2_hits = 0, sa_memory_accesses = 0;
+    for (int c = 0; c < opts->configs.count; c++) {
+        if (repeatedLineSize(opts, c)) continue;
+        int lineSize = opts->configs.configs[c].lineSize;
+        if (opts->stackDistance && initStackDistanceProfile(&profiles[numSizes], lineSize) != 0) {
+            fprintf(stderr, "Memory allocation failed for the stack distance profile\n");
+            goto cleanup;
+        }
+        for (int p = 0; p < numSetProfiles; p++) {
+            if (initSetStackProfile(&setProfiles[numSizes * numSetProfiles + p], opts->setProfileSets[p], opts->maxProfileWays) != 0) {
+                fprintf(stderr, "Memory allocation failed for the set stack profile\n");
+                goto cleanup;
+            }
+        }
+        lineSizes[numSizes++] = lineSize;
+    }
 
-    // Access costs
-    int dm_total_cost = 0, fa_total_cost = 0, sa_total_cost = 0;
+    if (openSweepSource(opts, NULL, &source) != 0) goto cleanup;
+    sourceOpen = true;
+
+    const TraceRecord *records;
+    size_t n;
+    long accesses = 0;
+    status = 0;
+    while (status == 0 && (n = nextSweepChunk(&source, chunk, &records)) > 0) {
+        for (int s = 0; s < numSizes; s++) {
+            for (size_t i = 0; opts->stackDistance && i < n && status == 0; i++) {
+                status = profileStackDistance(&profiles[s], traceAddress(records[i]));
+            }
+            profileSetStackChunk(&setProfiles[s * numSetProfiles], numSetProfiles, lineSizes[s], records, n);
+        }
+        if (source.isMapped) releaseMappedTrace(&source.mapped, source.position);
+        accesses += (long)n;
+    }
+    if (status != 0) fprintf(stderr, "Memory allocation failed for the stack distance profile\n");
+    sourceOpen = false;
+    if (closeSweepSource(&source, opts->tracePath) != 0) status = 1;
+    if (status != 0) goto cleanup;
+
+    if (opts->stackDistance) {
+        if (opts->format == OUTPUT_CSV) {
+            printf("\nsource,seed,line_size,lines,accesses,hits,misses,hit_rate\n");
+        }
+        for (int s = 0; s < numSizes; s++) {
+            printStackDistanceProfile(opts, &profiles[s]);
+        }
+    }
 
-    // Addresses to use (same for all three schemes)
-    unsigned int *addresses = malloc(numAccesses * sizeof(unsigned int));
-    if (!addresses) {
-        printf("Memory allocation failed!\n");
-        return;
+    if (numSetProfiles > 0) {
+        if (opts->format == OUTPUT_CSV) {
+            printf("\nsource,seed,line_size,sets,ways,lines,accesses,hits,misses,hit_rate\n");
+        }
+        for (int s = 0; s < numSizes; s++) {
+            printSetStackProfiles(opts, &setProfiles[s * numSetProfiles], numSetProfiles, lineSizes[s], accesses);
+        }
     }
 
-    // Generate random addresses for testing
-    srand(time(NULL));
-    generateAddresses(addresses, numAccesses);
+cleanup:
+    if (sourceOpen) closeSweepSource(&source, opts->tracePath);
+    for (int s = 0; profiles != NULL && s < opts->configs.count; s++) {
+        freeStackDistanceProfile(&profiles[s]);
+    }
+    for (int p = 0; setProfiles != NULL && p < opts->configs.count * numSetProfiles; p++) {
+        freeSetStackProfile(&setProfiles[p]);
+    }
+    free(lineSizes);
+    free(profiles);
+    free(setProfiles);
+    free(chunk);
+    return status;
+}
 
-    // Arrays to store hit information for each cache scheme
-    HitInfo *dm_hits = malloc(numAccesses * sizeof(HitInfo));
-    HitInfo *fa_hits = malloc(numAccesses * sizeof(HitInfo));
-    HitInfo *sa_hits = malloc(numAccesses * sizeof(HitInfo));
+// Run the batch simulation described by opts, no prompts or pauses
+int runBatchSimulation(const BatchOptions *opts) {
+    if (opts->writeTracePath) {
+        return writeTraceFile(opts->writeTracePath, opts->pattern, opts->seed, opts->addressSpace, opts->numAccesses);
+    }
 
-    if (!dm_hits || !fa_hits || !sa_hits) {
-        printf("Memory allocation failed!\n");
-        free(addresses);
-        if (dm_hits) free(dm_hits);
-        if (fa_hits) free(fa_hits);
-        if (sa_hits) free(sa_hits);
-        return;
+    for (int c = 0; c < opts->configs.count; c++) {
+        if (validateCacheConfig(&opts->configs.configs[c]) != 0) return 1;
+    }
+    if (opts->hitStats && (opts->format != OUTPUT_TEXT || opts->throughput || opts->configs.count > 1)) {
+        fprintf(stderr, "--hit-stats needs the text report of a single configuration\n");
+        return 1;
+    }
+    if (opts->accessLogPath != NULL && countBatchTasks(opts) != 1) {
+        fprintf(stderr, "--access-log needs a single configuration and mapping scheme (-m dm|fa|sa)\n");
+        return 1;
     }
 
-    int dm_hit_count = 0, fa_hit_count = 0, sa_hit_count = 0;
+    if (opts->format == OUTPUT_CSV) {
+        if (opts->throughput) {
+            printf("mapping,config,policy,source,seed,accesses,seconds,accesses_per_sec,hit_rate\n");
+        } else {
+            printf("mapping,config,policy,source,seed,accesses,l1_hits,l1_misses,l2_hits,l2_misses,total_cost,hit_rate,amat,"
+                   "writes,l1_writebacks,l2_writebacks,l2_read_bytes,l2_write_bytes,memory_read_bytes,memory_write_bytes,"
+                   "inclusion,resident_lines,inclusion_victims,levels");
+            for (int i = 3; i <= MAX_CACHE_LEVELS; i++) {
+                printf(",l%d_hits,l%d_misses,l%d_writebacks,l%d_read_bytes,l%d_write_bytes", i, i, i, i, i);
+            }
+            printf(",fetches,l1i_hits,l1i_misses,l1d_hits,l1d_misses");
+            printf(",cores,coherence_misses,false_sharing_misses,invalidations,upgrades,interventions");
+            for (int i = 1; i <= MAX_CACHE_LEVELS; i++) {
+                printf(",l%d_prefetches,l%d_useful_prefetches,l%d_prefetch_pollution", i, i, i);
+            }
+            printf(",l1i_prefetches,l1i_useful_prefetches,l1i_prefetch_pollution");
+            printf(",victim_hits,mshr_merges,mshr_stall_cycles,elapsed_cycles");
+            printf(",timed_access_time,latency_p50,latency_p90,latency_p99,latency_max,port_wait_cycles,"
+                   "bank_conflict_cycles,dram_row_hits,dram_row_empty,dram_row_conflicts\n");
+        }
+    } else if (opts->throughput) {
+        printf("Max Throughput Mode (source: %s, seed: %s)\n", batchSourceName(opts), batchSeedName(opts));
+        printf("---------------------------------------------\n");
+    } else if (opts->configs.count > 1) {
+        printf("Configuration Sweep (source: %s, seed: %s, %d configurations)\n",
+               batchSourceName(opts), batchSeedName(opts), opts->configs.count);
+        printf("-------------------------------------------------------------\n");
+        printf("%-12s | %-18s | %-6s | %-9s | %-24s | %-4s | %-30s | %10s | %10s | %9s | %8s | %8s\n",
+               "Config", "Mapping", "Policy", "Inclusion", "Levels (lines x ways)", "Line", "Hits per level", "Memory",
+               "Writebacks", "Eff lines", "Hit Rate", "AMAT");
+    }
 
-    printf("Comparing cache mapping schemes with %d memory accesses\n", numAccesses);
-    printf("-------------------------------------------------------\n\n");
+    // Several (configuration, mapping) pairs and several threads: stream the trace once to a
+    // pool of workers; OPT needs the whole trace for its next-use index, so it always takes this path
+    int numTasks = countBatchTasks(opts);
+    int status = 0;
+    if ((opts->jobs > 1 && numTasks > 1) || sweepNeedsWholeTrace(opts)) {
+        status = runParallelSweep(opts);
+    } else {
+        Arena arena = {0};
+        for (int c = 0; c < opts->configs.count && status == 0; c++) {
+            status = runBatchConfig(opts, &opts->configs.configs[c], &arena);
+        }
+        freeArena(&arena);
+    }
 
-    // 1. Set up Direct-Mapped Caches
-    CacheLine l1_cache_dm[L1_SIZE];
-    CacheLine l2_cache_dm[L2_SIZE];
-    initializeCache(l1_cache_dm, L1_SIZE);
-    initializeCache(l2_cache_dm, L2_SIZE);
+    if (status == 0 && (opts->stackDistance || opts->numSetProfiles > 0)) {
+        if (opts->format == OUTPUT_TEXT && opts->configs.count > 1) printf("\n");
+        status = runStackDistanceAnalysis(opts);
+    }
+    return status;
+}
 
-    // 2. Set up Fully Associative Caches
-    FullyAssociativeCacheLine l1_cache_fa[L1_SIZE];
-    FullyAssociativeCacheLine l2_cache_fa[L2_SIZE];
-    initializeFullyAssociativeCache(l1_cache_fa, L1_SIZE);
-    initializeFullyAssociativeCache(l2_cache_fa, L2_SIZE);
+// Compare the LRU counter sweep with the O(1) LRU cache on growing fully associative caches
+int runLRUBenchmark(const BatchOptions *opts) {
+    static const int sizes[] = { 16, 64, 256, 512, 1024, 2048, 4096 };
+    long n = opts->numAccesses;
 
-    // 3. Set up Set-Associative Caches
-    AssociativeCacheLine l1_cache_sa[L1_SIZE]; // Total size remains the same
-    AssociativeCacheLine l2_cache_sa[L2_SIZE]; // Total size remains the same
-    initializeAssociativeCache(l1_cache_sa, L1_SETS, L1_ASSOCIATIVITY);
-    initializeAssociativeCache(l2_cache_sa, L2_SETS, L2_ASSOCIATIVITY);
+    uint64_t *addresses = (uint64_t *)malloc((size_t)n * sizeof(uint64_t));
+    if (addresses == NULL) {
+        fprintf(stderr, "Memory allocation failed for %ld addresses\n", n);
+        return 1;
+    }
 
-    // Run the simulation for each address
-    for (int i = 0; i < numAccesses; i++) {
-        unsigned int address = addresses[i];
-        int tag, index, way, set;
-
-        // Direct-Mapped Cache Simulation
-
-        // Check L1 cache
-        bool l1_hit_dm = checkCache(l1_cache_dm, L1_SIZE, address, &tag, &index);
-
-        if (l1_hit_dm) {
-            // L1 hit
-            dm_l1_hits++;
-            dm_total_cost += L1_ACCESS_COST;
-            dm_hits[dm_hit_count].address = address;
-            dm_hits[dm_hit_count].cache_level = 1;
-            dm_hit_count++;
-        } else {
-            // Check L2 cache
-            bool l2_hit_dm = checkCache(l2_cache_dm, L2_SIZE, address, &tag, &index);
-
-            if (l2_hit_dm) {
-                // L2 hit
-                dm_l2_hits++;
-                dm_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                dm_hits[dm_hit_count].address = address;
-                dm_hits[dm_hit_count].cache_level = 2;
-                dm_hit_count++;
-
-                // Update L1 cache
-                int l1_tag, l1_index;
-                checkCache(l1_cache_dm, L1_SIZE, address, &l1_tag, &l1_index);
-                updateCache(l1_cache_dm, l1_index, l1_tag, address);
-            } else {
-                // Cache miss - access main memory
-                dm_memory_accesses++;
-                dm_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
+    if (opts->format == OUTPUT_CSV) {
+        printf("lines,accesses,hits,counter_seconds,o1_seconds,speedup\n");
+    } else {
+        printf("Fully Associative LRU Benchmark (%ld accesses per size, seed %u)\n", n, opts->seed);
+        printf("---------------------------------------------------------------\n");
+        printf("Lines | Hit Rate | Counter LRU (s) | O(1) LRU (s) | Speedup\n");
+        printf("----- | -------- | --------------- | ------------ | -------\n");
+    }
 
-                // Update L2 cache
-                int l2_tag, l2_index;
-                checkCache(l2_cache_dm, L2_SIZE, address, &l2_tag, &l2_index);
-                updateCache(l2_cache_dm, l2_index, l2_tag, address);
+    int status = 0;
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        int size = sizes[k];
 
-                // Update L1 cache
-                int l1_tag, l1_index;
-                checkCache(l1_cache_dm, L1_SIZE, address, &l1_tag, &l1_index);
-                updateCache(l1_cache_dm, l1_index, l1_tag, address);
-            }
+        // Blocks drawn from twice the cache size, so roughly half of the accesses hit
+        Xoshiro256 rng;
+        seedXoshiro(&rng, opts->seed);
+        for (long i = 0; i < n; i++) {
+            addresses[i] = (nextXoshiro(&rng) % (uint64_t)(2 * size)) * BLOCK_SIZE;
         }
 
+        FullyAssociativeCacheLine *counterCache = (FullyAssociativeCacheLine *)malloc(size * sizeof(FullyAssociativeCacheLine));
+        LRUFullyAssociativeCache lruCache;
+        if (counterCache == NULL || initializeLRUCache(&lruCache, size, NULL) != 0) {
+            fprintf(stderr, "Memory allocation failed for %d-line caches\n", size);
+            free(counterCache);
+            status = 1;
+            break;
+        }
+        initializeFullyAssociativeCache(counterCache, size);
+
+        long counterHits = 0;
+        double start = monotonicSeconds();
+        for (long i = 0; i < n; i++) {
+            uint64_t tag;
+            int way;
+            if (checkFullyAssociativeCache(counterCache, size, addresses[i], &tag, &way)) {
+                counterHits++;
+                updateFullyAssociativeLRU(counterCache, size, way);
+            } else {
+                way = findFullyAssociativeLRU(counterCache, size);
+                updateFullyAssociativeCache(counterCache, size, way, tag, addresses[i]);
+            }
+        }
+        double counterSeconds = monotonicSeconds() - start;
+
+        long lruHits = 0;
+        start = monotonicSeconds();
+        for (long i = 0; i < n; i++) {
+            uint64_t tag = addresses[i] >> BLOCK_OFFSET_BITS;
+            int line = lookupLRUCache(&lruCache, tag);
+            if (line >= 0) {
+                lruHits++;
+                touchLRUCache(&lruCache, line);
+            } else {
+                insertLRUCache(&lruCache, tag);
+            }
+        }
+        double lruSeconds = monotonicSeconds() - start;
 
-        // Fully Associative Cache Simulation
-
-        // Check L1 cache
-        bool l1_hit_fa = checkFullyAssociativeCache(l1_cache_fa, L1_SIZE, address, &tag, &way);
+        free(counterCache);
+        freeLRUCache(&lruCache);
 
-        if (l1_hit_fa) {
-            // L1 hit
-            fa_l1_hits++;
-            fa_total_cost += L1_ACCESS_COST;
-            fa_hits[fa_hit_count].address = address;
-            fa_hits[fa_hit_count].cache_level = 1;
-            fa_hit_count++;
+        if (counterHits != lruHits) {
+            fprintf(stderr, "Hit count mismatch for %d lines: counter %ld, O(1) %ld\n", size, counterHits, lruHits);
+            status = 1;
+            break;
+        }
 
-            // Update LRU
-            updateFullyAssociativeLRU(l1_cache_fa, L1_SIZE, way);
+        double speedup = (lruSeconds > 0) ? counterSeconds / lruSeconds : 0;
+        if (opts->format == OUTPUT_CSV) {
+            printf("%d,%ld,%ld,%.6f,%.6f,%.2f\n", size, n, lruHits, counterSeconds, lruSeconds, speedup);
         } else {
-            // Check L2 cache
-            bool l2_hit_fa = checkFullyAssociativeCache(l2_cache_fa, L2_SIZE, address, &tag, &way);
-
-            if (l2_hit_fa) {
-                // L2 hit
-                fa_l2_hits++;
-                fa_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                fa_hits[fa_hit_count].address = address;
-                fa_hits[fa_hit_count].cache_level = 2;
-                fa_hit_count++;
-
-                // Update LRU for L2
-                updateFullyAssociativeLRU(l2_cache_fa, L2_SIZE, way);
-
-                // Update L1 cache - need to find a place in L1 using LRU
-                int l1_way = findFullyAssociativeLRU(l1_cache_fa, L1_SIZE);
-                int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                updateFullyAssociativeCache(l1_cache_fa, L1_SIZE, l1_way, l1_tag, address);
-            } else {
-                // Cache miss - access main memory
-                fa_memory_accesses++;
-                fa_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
+            printf("%5d | %7.2f%% | %15.4f | %12.4f | %6.1fx\n",
+                   size, n ? (float)lruHits / n * 100 : 0, counterSeconds, lruSeconds, speedup);
+        }
+    }
+
+    free(addresses);
+    return status;
+}
 
-                // Update L2 cache - need to find a place in L2 using LRU
-                int l2_way = findFullyAssociativeLRU(l2_cache_fa, L2_SIZE);
-                int l2_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                updateFullyAssociativeCache(l2_cache_fa, L2_SIZE, l2_way, l2_tag, address);
+void printUsage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("Without options the interactive menu is started, its random addresses seeded from\n");
+    printf("SIM_SEED when set (every report shows the seed it used).\n\n");
+    printf("  -m, --mapping dm|fa|sa|all   Mapping scheme to simulate (default all)\n");
+    printf("  -n, --accesses N             Number of memory accesses (default 1000)\n");
+    printf("  -p, --pattern NAME           random, sequential or repeated (default random)\n");
+    printf("  -s, --seed S                 Random seed (default: current time)\n");
+    printf("  -f, --format text|csv        Output format (default text)\n");
+    printf("  -t, --throughput             Max throughput mode: report accesses/second only\n");
+    printf("  -T, --trace FILE             Replay a trace instead of a synthetic pattern (binary,\n");
+    printf("                               or hex text with optional R/W/I and core id,\n");
+    printf("                               plain/gzip/zstd)\n");
+    printf("  -w, --write-trace FILE       Write the synthetic pattern as a binary trace and exit\n");
+    printf("  -A, --address-bits N         Width of synthetic addresses, 4..56 (default %d)\n",
+           __builtin_ctzll(ADDRESS_SPACE));
+    printf("  -c, --config FILE            Cache configurations to sweep ('key = value' lines,\n");
+    printf("                               one [name] section per configuration)\n");
+    printf("  -S, --set KEY=VALUE          Override a setting of the default configuration: line_size,\n");
+    printf("                               levels (1..%d), lN_lines, lN_ways, lN_cost, lN_policy for\n", MAX_CACHE_LEVELS);
+    printf("                               level N (l1_lines, l3_cost, ...), memory_cost, policy,\n");
+    printf("                               write_policy (back|through), write_allocate (yes|no);\n");
+    printf("                               lN_write_* set one level, inclusion (nine|inclusive|exclusive)\n");
+    printf("                               split_l1 (yes|no) adds an L1I for instruction fetches,\n");
+    printf("                               set with l1i_lines, l1i_ways, l1i_cost, l1i_policy\n");
+    printf("                               cores (1..64) gives each core private levels kept\n");
+    printf("                               coherent with MESI, private_levels of them (default\n");
+    printf("                               all but the last level, which is shared)\n");
+    printf("                               prefetch (none|next-line|stride|stream) and\n");
+    printf("                               prefetch_degree (1..16) attach a prefetcher to every\n");
+    printf("                               level, lN_prefetch or l1i_prefetch to one\n");
+    printf("                               victim_lines puts a victim cache of that many lines behind\n");
+    printf("                               the L1 (L1D), victim_cost cycles per hit; mshrs (1..%d)\n", MAX_MSHRS);
+    printf("                               makes the L1 non-blocking with that many outstanding misses\n");
+    printf("                               timing (yes|no) times accesses through lN_banks/lN_ports\n");
+    printf("                               and a DRAM of dram_banks, dram_row_bytes, dram_cas,\n");
+    printf("                               dram_rcd, dram_rp, reporting latency distributions\n");
+    printf("  -r, --policy NAME|all        Replacement policy: lru, plru, srrip, brrip, random, fifo\n");
+    printf("                               or opt (offline Belady by next use, loads the whole trace);\n");
+    printf("                               'all' simulates every policy for each configuration\n");
+    printf("  -j, --jobs N                 Worker threads for the (configuration, mapping) sweep\n");
+    printf("                               (default: online CPUs, 1 streams the trace instead)\n");
+    printf("      --stack-distance         Also print the fully associative LRU hit rate for every\n");
+    printf("                               cache size, from one pass over the trace\n");
+    printf("      --set-distance S1,S2,..  Also print per-set LRU hit rates for 1..W ways of each\n");
+    printf("                               set count (powers of two), from one pass over the trace\n");
+    printf("      --max-ways W             Largest associativity of --set-distance (default 16)\n");
+    printf("      --hit-stats              Also report the hit rate spread over the sets of every\n");
+    printf("                               level and the hottest blocks (one configuration, text)\n");
+    printf("  -l, --access-log FILE        Stream every access and the level serving it to FILE as\n");
+    printf("                               CSV (one configuration and mapping scheme)\n");
+    printf("      --benchmark-lru          Time counter LRU against O(1) LRU for 16..4096 lines\n");
+    printf("  -h, --help                   Show this help\n");
+}
 
-                // Update L1 cache - need to find a place in L1 using LRU
-                int l1_way = findFullyAssociativeLRU(l1_cache_fa, L1_SIZE);
-                int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                updateFullyAssociativeCache(l1_cache_fa, L1_SIZE, l1_way, l1_tag, address);
+// Parse the command line into opts, returns 0 on success
+int parseBatchOptions(int argc, char *argv[], BatchOptions *opts) {
+    static const struct option longOptions[] = {
+        { "mapping",  required_argument, NULL, 'm' },
+        { "accesses", required_argument, NULL, 'n' },
+        { "pattern",  required_argument, NULL, 'p' },
+        { "seed",     required_argument, NULL, 's' },
+        { "format",   required_argument, NULL, 'f' },
+        { "throughput", no_argument,     NULL, 't' },
+        { "trace",    required_argument, NULL, 'T' },
+        { "write-trace", required_argument, NULL, 'w' },
+        { "benchmark-lru", no_argument,  NULL, 'L' },
+        { "stack-distance", no_argument, NULL, 'D' },
+        { "set-distance", required_argument, NULL, 'P' },
+        { "max-ways", required_argument, NULL, 'W' },
+        { "hit-stats", no_argument,      NULL, 'H' },
+        { "access-log", required_argument, NULL, 'l' },
+        { "address-bits", required_argument, NULL, 'A' },
+        { "jobs",     required_argument, NULL, 'j' },
+        { "config",   required_argument, NULL, 'c' },
+        { "set",      required_argument, NULL, 'S' },
+        { "policy",   required_argument, NULL, 'r' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    opts->mapping = MAPPING_ALL;
+    opts->numAccesses = 1000;
+    opts->pattern = PATTERN_RANDOM;
+    opts->seed = (unsigned int)time(NULL);
+    opts->format = OUTPUT_TEXT;
+    opts->throughput = false;
+    opts->benchmarkLRU = false;
+    opts->stackDistance = false;
+    opts->numSetProfiles = 0;
+    opts->maxProfileWays = 16;
+    opts->allPolicies = false;
+    opts->hitStats = false;
+    opts->accessLogPath = NULL;
+    opts->tracePath = NULL;
+    opts->writeTracePath = NULL;
+    opts->addressSpace = ADDRESS_SPACE;
+    opts->jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (opts->jobs < 1) opts->jobs = 1;
+    defaultCacheConfig(&opts->baseConfig);
+    memset(&opts->configs, 0, sizeof(opts->configs));
+
+    const char *configPath = NULL;
+    int c;
+    while ((c = getopt_long(argc, argv, "m:n:p:s:f:tT:w:A:c:S:r:j:l:h", longOptions, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "dm") == 0 || strcmp(optarg, "direct") == 0) opts->mapping = MAPPING_DIRECT;
+            else if (strcmp(optarg, "fa") == 0 || strcmp(optarg, "fully") == 0) opts->mapping = MAPPING_FULLY_ASSOCIATIVE;
+            else if (strcmp(optarg, "sa") == 0 || strcmp(optarg, "set") == 0) opts->mapping = MAPPING_SET_ASSOCIATIVE;
+            else if (strcmp(optarg, "all") == 0) opts->mapping = MAPPING_ALL;
+            else {
+                fprintf(stderr, "Unknown mapping '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            opts->numAccesses = atol(optarg);
+            if (opts->numAccesses <= 0) {
+                fprintf(stderr, "Number of accesses must be positive\n");
+                return 1;
+            }
+            break;
+        case 'p':
+            if (strcmp(optarg, "random") == 0) opts->pattern = PATTERN_RANDOM;
+            else if (strcmp(optarg, "sequential") == 0) opts->pattern = PATTERN_SEQUENTIAL;
+            else if (strcmp(optarg, "repeated") == 0) opts->pattern = PATTERN_REPEATED;
+            else {
+                fprintf(stderr, "Unknown pattern '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            if (parseSeed(optarg, &opts->seed) != 0) {
+                fprintf(stderr, "Invalid seed '%s' (an unsigned 32-bit number)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            if (strcmp(optarg, "text") == 0) opts->format = OUTPUT_TEXT;
+            else if (strcmp(optarg, "csv") == 0) opts->format = OUTPUT_CSV;
+            else {
+                fprintf(stderr, "Unknown format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            opts->throughput = true;
+            break;
+        case 'L':
+            opts->benchmarkLRU = true;
+            break;
+        case 'D':
+            opts->stackDistance = true;
+            break;
+        case 'H':
+            opts->hitStats = true;
+            break;
+        case 'l':
+            opts->accessLogPath = optarg;
+            break;
+        case 'P': {
+            // Comma separated set counts, powers of two as in checkAssociativeCache
+            const char *list = optarg;
+            char *end;
+            opts->numSetProfiles = 0;
+            while (true) {
+                long sets = strtol(list, &end, 0);
+                if (end == list || sets <= 0 || sets > (1L << 24) || !isPowerOfTwo((int)sets) ||
+                    opts->numSetProfiles == MAX_SET_PROFILES || (*end != ',' && *end != '\0')) {
+                    fprintf(stderr, "Invalid set count list '%s' (up to %d powers of two)\n", optarg, MAX_SET_PROFILES);
+                    return 1;
+                }
+                opts->setProfileSets[opts->numSetProfiles++] = (int)sets;
+                if (*end == '\0') break;
+                list = end + 1;
+            }
+            break;
+        }
+        case 'r':
+            if (strcmp(optarg, "all") == 0) {
+                opts->allPolicies = true;
+            } else if (applyCacheConfigSetting(&opts->baseConfig, "policy", optarg) != 0) {
+                return 1;
+            }
+            break;
+        case 'W':
+            opts->maxProfileWays = atoi(optarg);
+            if (opts->maxProfileWays <= 0 || opts->maxProfileWays > 1024) {
+                fprintf(stderr, "Maximum ways must be between 1 and 1024\n");
+                return 1;
+            }
+            break;
+        case 'c':
+            configPath = optarg;
+            break;
+        case 'S':
+            if (applyCacheConfigArgument(&opts->baseConfig, optarg) != 0) return 1;
+            break;
+        case 'T':
+            opts->tracePath = optarg;
+            break;
+        case 'w':
+            opts->writeTracePath = optarg;
+            break;
+        case 'j':
+            opts->jobs = atoi(optarg);
+            if (opts->jobs <= 0) {
+                fprintf(stderr, "Number of jobs must be positive\n");
+                return 1;
+            }
+            break;
+        case 'A': {
+            int bits = atoi(optarg);
+            if (bits < 4 || bits > 56) {
+                fprintf(stderr, "Address width must be between 4 and 56 bits\n");
+                return 1;
             }
+            opts->addressSpace = 1ULL << bits;
+            break;
         }
+        case 'h':
+            printUsage(argv[0]);
+            exit(0);
+        default:
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int status = (configPath != NULL) ? loadCacheConfigFile(configPath, &opts->baseConfig, &opts->configs)
+                                      : appendCacheConfig(&opts->configs, &opts->baseConfig);
+    for (int c = 0; status == 0 && c < opts->configs.count; c++) resolveCacheConfig(&opts->configs.configs[c]);
+    if (status == 0 && opts->allPolicies) {
+        status = expandPolicySweep(&opts->configs);
+    }
+    return status;
+}
 
+//-- interactive mapping comparison--
 
-        // Set-Associative Cache Simulation
+// Cycles of a run when an access pays for every level it looked up on its way down, the
+// total the interactive comparisons report; divided by the accesses it is the AMAT
+long lookupPathCost(const MappingSimulator *sim) {
+    const CacheStats *stats = &sim->stats;
+    long cost = 0, path = 0;
+    for (int i = 0; i < sim->numLevels; i++) {
+        path += sim->config->levels[i].accessCost;
+        cost += stats->levels[i].hits * path;
+    }
+    return cost + stats->levels[sim->numLevels].hits * (path + sim->config->memoryCost);
+}
 
-        // Check L1 cache
-        bool l1_hit_sa = checkAssociativeCache(l1_cache_sa, L1_SETS, L1_ASSOCIATIVITY, address, &tag, &set, &way);
+// Set up 'sim' on the default configuration, the compile-time L1/L2 geometry and costs, with
+// 'policy'; 'config' must outlive it. The state lives in the interactive arena. OPT reads
+// 'nextUse', the next use of every record of the pattern. Returns 0 on success
+static int initComparisonSimulator(MappingSimulator *sim, CacheConfig *config, MappingType mapping,
+                                   ReplacementPolicy policy, const long *nextUse) {
+    defaultCacheConfig(config);
+    config->policy = policy;
+    resolveCacheConfig(config);
+    if (initMappingSimulator(sim, mapping, config, &interactiveArena) != 0) return 1;
+    sim->nextUse = nextUse;
+    return 0;
+}
 
-        if (l1_hit_sa) {
-            // L1 hit
-            sa_l1_hits++;
-            sa_total_cost += L1_ACCESS_COST;
-            sa_hits[sa_hit_count].address = address;
-            sa_hits[sa_hit_count].cache_level = 1;
-            sa_hit_count++;
+// Run one record through 'sim', returns the level that served it as recordAccess counts
+// them: 1 for L1, 2 for L2, 0 for main memory
+static int compareAccess(MappingSimulator *sim, TraceRecord record) {
+    simulateTraceChunk(sim, &record, 1);
+    return (sim->lastServed < sim->numLevels) ? sim->lastServed + 1 : 0;
+}
 
-            // Update LRU
-            updateLRUCounters(l1_cache_sa, set, L1_ASSOCIATIVITY, way);
-        } else {
-            // Check L2 cache
-            bool l2_hit_sa = checkAssociativeCache(l2_cache_sa, L2_SETS, L2_ASSOCIATIVITY, address, &tag, &set, &way);
-
-            if (l2_hit_sa) {
-                // L2 hit
-                sa_l2_hits++;
-                sa_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                sa_hits[sa_hit_count].address = address;
-                sa_hits[sa_hit_count].cache_level = 2;
-                sa_hit_count++;
-
-                // Update LRU for L2
-                updateLRUCounters(l2_cache_sa, set, L2_ASSOCIATIVITY, way);
-
-                // Update L1 cache
-                int l1_tag, l1_set;
-                l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                l1_tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l1_way = findLRUWay(l1_cache_sa, l1_set, L1_ASSOCIATIVITY);
-                updateAssociativeCache(l1_cache_sa, l1_set, l1_way, L1_ASSOCIATIVITY, l1_tag, address);
-            } else {
-                // Cache miss - access main memory
-                sa_memory_accesses++;
-                sa_total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
+// Function to run comparative analysis between all three mappinh
+void compareAllCacheMappings(int numAccesses) {
+    static const MappingType mappings[] = { MAPPING_DIRECT, MAPPING_FULLY_ASSOCIATIVE, MAPPING_SET_ASSOCIATIVE };
+
+    // Random addresses for testing, generated a chunk at a time (same for all three schemes)
+    SyntheticTrace gen;
+    unsigned int seed = interactiveSeed();
+    initSyntheticTrace(&gen, PATTERN_RANDOM, seed, ADDRESS_SPACE);
+
+    // Hits of each cache scheme per set and per block; the interactive arena owns them and
+    // the simulators until the next run resets it
+    HitStats dm_hits, fa_hits, sa_hits;
+    HitStats *hits[] = { &dm_hits, &fa_hits, &sa_hits };
+    resetArena(&interactiveArena);
+    size_t chunkSize = (numAccesses < TRACE_CHUNK_RECORDS) ? (size_t)(numAccesses > 0 ? numAccesses : 1) : TRACE_CHUNK_RECORDS;
+    TraceRecord *chunk = (TraceRecord *)arenaAlloc(&interactiveArena, chunkSize * sizeof(TraceRecord));
+    if (chunk == NULL ||
+        initHitStats(&dm_hits, &interactiveArena, L1_SIZE, L2_SIZE) != 0 ||
+        initHitStats(&fa_hits, &interactiveArena, 1, 1) != 0 ||
+        initHitStats(&sa_hits, &interactiveArena, L1_SETS, L2_SETS) != 0) {
+        printf("Memory allocation failed!\n");
+        return;
+    }
+
+    printf("Comparing cache mapping schemes with %d memory accesses\n", numAccesses);
+    printf("-------------------------------------------------------\n\n");
 
-                // Update L2 cache
-                int l2_tag, l2_set;
-                l2_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
-                l2_tag = address / (L2_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l2_way = findLRUWay(l2_cache_sa, l2_set, L2_ASSOCIATIVITY);
-                updateAssociativeCache(l2_cache_sa, l2_set, l2_way, L2_ASSOCIATIVITY, l2_tag, address);
+    // One simulator per mapping scheme, then a set associative and a fully associative one
+    // per online replacement policy, all on the same L1/L2 hierarchy
+    CacheConfig configs[3], policy_configs[POLICY_OPT];
+    MappingSimulator sims[3], policy_sa[POLICY_OPT], policy_fa[POLICY_OPT];
+    bool ready = true;
+    memset(sims, 0, sizeof(sims));
+    memset(policy_sa, 0, sizeof(policy_sa));
+    memset(policy_fa, 0, sizeof(policy_fa));
+    for (int m = 0; m < 3 && ready; m++) {
+        ready = initComparisonSimulator(&sims[m], &configs[m], mappings[m], POLICY_LRU, NULL) == 0;
+    }
+    for (int p = 0; p < POLICY_OPT && ready; p++) {
+        ready = initComparisonSimulator(&policy_sa[p], &policy_configs[p], MAPPING_SET_ASSOCIATIVE, (ReplacementPolicy)p, NULL) == 0 &&
+                initComparisonSimulator(&policy_fa[p], &policy_configs[p], MAPPING_FULLY_ASSOCIATIVE, (ReplacementPolicy)p, NULL) == 0;
+    }
+    if (!ready) {
+        printf("Memory allocation failed!\n");
+        goto cleanup;
+    }
 
-                // Update L1 cache
-                int l1_tag, l1_set;
-                l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                l1_tag = address / (L1_SETS * WORDS_PER_LINE * WORD_SIZE);
-                int l1_way = findLRUWay(l1_cache_sa, l1_set, L1_ASSOCIATIVITY);
-                updateAssociativeCache(l1_cache_sa, l1_set, l1_way, L1_ASSOCIATIVITY, l1_tag, address);
+    // Run the simulation for each address
+    for (int done = 0; done < numAccesses; ) {
+        size_t n = (numAccesses - done < (int)chunkSize) ? (size_t)(numAccesses - done) : chunkSize;
+        fillSyntheticTrace(&gen, chunk, n);
+        for (size_t i = 0; i < n; i++) {
+            for (int m = 0; m < 3; m++) {
+                recordAccess(hits[m], traceAddress(chunk[i]), compareAccess(&sims[m], chunk[i]));
             }
         }
+        // Replacement policy variants of the set associative and fully associative caches
+        for (int p = 0; p < POLICY_OPT; p++) {
+            simulateTraceChunk(&policy_sa[p], chunk, n);
+            simulateTraceChunk(&policy_fa[p], chunk, n);
+        }
+        done += (int)n;
+    }
+
+    long total_cost[3];
+    for (int m = 0; m < 3; m++) {
+        finishMappingSimulator(&sims[m]);
+        total_cost[m] = lookupPathCost(&sims[m]);
     }
+    const CacheStats *dm = &sims[0].stats, *fa = &sims[1].stats, *sa = &sims[2].stats;
+    long dm_total_cost = total_cost[0], fa_total_cost = total_cost[1], sa_total_cost = total_cost[2];
 
     // Display the results
     clearScreen();
 
-    printf("Cache Comparison Results (%d accesses):\n", numAccesses);
+    printf("Cache Comparison Results (%d accesses, seed %u):\n", numAccesses, seed);
     printf("=======================================\n\n");
     printf("1. Direct-Mapped Cache Performance:\n");
     printf("----------------------------------\n");
-    printf("L1 Cache Hits: %d (%.2f%%)\n", dm_l1_hits, (float)dm_l1_hits/numAccesses*100);
-    printf("L2 Cache Hits: %d (%.2f%%)\n", dm_l2_hits, (float)dm_l2_hits/numAccesses*100);
-    printf("Memory Accesses: %d (%.2f%%)\n", dm_memory_accesses, (float)dm_memory_accesses/numAccesses*100);
-    printf("Total Hit Rate: %.2f%%\n", (float)(dm_l1_hits + dm_l2_hits)/numAccesses*100);
-    printf("Total Access Cost: %d\n", dm_total_cost);
+    printf("L1 Cache Hits: %ld (%.2f%%)\n", dm->l1_hits, (float)dm->l1_hits/numAccesses*100);
+    printf("L2 Cache Hits: %ld (%.2f%%)\n", dm->l2_hits, (float)dm->l2_hits/numAccesses*100);
+    printf("Memory Accesses: %ld (%.2f%%)\n", dm->memory_accesses, (float)dm->memory_accesses/numAccesses*100);
+    printf("Total Hit Rate: %.2f%%\n", (float)(dm->l1_hits + dm->l2_hits)/numAccesses*100);
+    printf("Total Access Cost: %ld\n", dm_total_cost);
     printf("Average Access Time: %.2f cycles/access\n\n", (float)dm_total_cost/numAccesses);
+    displayHotBlocks(&dm_hits);
     printf("\n2. Fully Associative Cache Performance:\n");
     printf("---------------------------------------\n");
-    printf("L1 Cache Hits: %d (%.2f%%)\n", fa_l1_hits, (float)fa_l1_hits/numAccesses*100);
-    printf("L2 Cache Hits: %d (%.2f%%)\n", fa_l2_hits, (float)fa_l2_hits/numAccesses*100);
-    printf("Memory Accesses: %d (%.2f%%)\n", fa_memory_accesses, (float)fa_memory_accesses/numAccesses*100);
-    printf("Total Hit Rate: %.2f%%\n", (float)(fa_l1_hits + fa_l2_hits)/numAccesses*100);
-    printf("Total Access Cost: %d\n", fa_total_cost);
+    printf("L1 Cache Hits: %ld (%.2f%%)\n", fa->l1_hits, (float)fa->l1_hits/numAccesses*100);
+    printf("L2 Cache Hits: %ld (%.2f%%)\n", fa->l2_hits, (float)fa->l2_hits/numAccesses*100);
+    printf("Memory Accesses: %ld (%.2f%%)\n", fa->memory_accesses, (float)fa->memory_accesses/numAccesses*100);
+    printf("Total Hit Rate: %.2f%%\n", (float)(fa->l1_hits + fa->l2_hits)/numAccesses*100);
+    printf("Total Access Cost: %ld\n", fa_total_cost);
     printf("Average Access Time: %.2f cycles/access\n\n", (float)fa_total_cost/numAccesses);
+    displayHotBlocks(&fa_hits);
     printf("\n3. Set-Associative Cache Performance:\n");
     printf("-------------------------------------\n");
-    printf("L1 Cache Hits: %d (%.2f%%)\n", sa_l1_hits, (float)sa_l1_hits/numAccesses*100);
-    printf("L2 Cache Hits: %d (%.2f%%)\n", sa_l2_hits, (float)sa_l2_hits/numAccesses*100);
-    printf("Memory Accesses: %d (%.2f%%)\n", sa_memory_accesses, (float)sa_memory_accesses/numAccesses*100);
-    printf("Total Hit Rate: %.2f%%\n", (float)(sa_l1_hits + sa_l2_hits)/numAccesses*100);
-    printf("Total Access Cost: %d\n", sa_total_cost);
+    printf("L1 Cache Hits: %ld (%.2f%%)\n", sa->l1_hits, (float)sa->l1_hits/numAccesses*100);
+    printf("L2 Cache Hits: %ld (%.2f%%)\n", sa->l2_hits, (float)sa->l2_hits/numAccesses*100);
+    printf("Memory Accesses: %ld (%.2f%%)\n", sa->memory_accesses, (float)sa->memory_accesses/numAccesses*100);
+    printf("Total Hit Rate: %.2f%%\n", (float)(sa->l1_hits + sa->l2_hits)/numAccesses*100);
+    printf("Total Access Cost: %ld\n", sa_total_cost);
     printf("Average Access Time: %.2f cycles/access\n\n", (float)sa_total_cost/numAccesses);
+    displayHotBlocks(&sa_hits);
     printf("\nComparative Analysis:\n");
     printf("--------------------\n");
 
-    // Find the best performer
-    int best_hit_rate = -1;
-    char *best_scheme = NULL;
-
-    float dm_hit_rate = (float)(dm_l1_hits + dm_l2_hits)/numAccesses*100;
-    float fa_hit_rate = (float)(fa_l1_hits + fa_l2_hits)/numAccesses*100;
-    float sa_hit_rate = (float)(sa_l1_hits + sa_l2_hits)/numAccesses*100;
-
-    if (dm_hit_rate >= fa_hit_rate && dm_hit_rate >= sa_hit_rate) {
-        best_hit_rate = dm_hit_rate;
-        best_scheme = "Direct-Mapped";
-    } else if (fa_hit_rate >= dm_hit_rate && fa_hit_rate >= sa_hit_rate) {
-        best_hit_rate = fa_hit_rate;
-        best_scheme = "Fully Associative";
-    } else {
-        best_hit_rate = sa_hit_rate;
-        best_scheme = "Set-Associative";
-    }
-
-    int best_cost = -1;
-    char *best_cost_scheme = NULL;
-
-    if (dm_total_cost <= fa_total_cost && dm_total_cost <= sa_total_cost) {
-        best_cost = dm_total_cost;
-        best_cost_scheme = "Direct-Mapped";
-    } else if (fa_total_cost <= dm_total_cost && fa_total_cost <= sa_total_cost) {
-        best_cost = fa_total_cost;
-        best_cost_scheme = "Fully Associative";
-    } else {
-        best_cost = sa_total_cost;
-        best_cost_scheme = "Set-Associative";
-    }
-
-  //  printf("Best Hit Rate: %s (%.2f%%)\n", best_scheme, best_hit_rate);
-  //  printf("Best Access Cost: %s (%d cycles)\n\n", best_cost_scheme, best_cost);
+    float dm_hit_rate = (float)(dm->l1_hits + dm->l2_hits)/numAccesses*100;
+    float fa_hit_rate = (float)(fa->l1_hits + fa->l2_hits)/numAccesses*100;
+    float sa_hit_rate = (float)(sa->l1_hits + sa->l2_hits)/numAccesses*100;
 
     printf("Hit Rate Comparison:\n");
     printf("- Direct-Mapped: %.2f%%\n", dm_hit_rate);
@@ -1577,11 +6832,25 @@ void compareAllCacheMappings(int numAccesses) {
     printf("- Fully Associative: %.2f cycles/access\n", (float)fa_total_cost/numAccesses);
     printf("- Set-Associative: %.2f cycles/access\n\n", (float)sa_total_cost/numAccesses);
 
-    // Clean up memory
-    free(addresses);
-    free(dm_hits);
-    free(fa_hits);
-    free(sa_hits);
+    printf("Replacement Policy Comparison (hit rate / average access time):\n");
+    printf("Policy | Set-Associative         | Fully Associative\n");
+    printf("------ | ----------------------- | -----------------------\n");
+    for (int p = 0; p < POLICY_OPT; p++) {
+        finishMappingSimulator(&policy_sa[p]);
+        finishMappingSimulator(&policy_fa[p]);
+        const CacheStats *psa = &policy_sa[p].stats, *pfa = &policy_fa[p].stats;
+        printf("%-6s | %6.2f%% / %6.2f cycles | %6.2f%% / %6.2f cycles\n", policyNames[p],
+               (float)(psa->l1_hits + psa->l2_hits)/numAccesses*100, (float)lookupPathCost(&policy_sa[p])/numAccesses,
+               (float)(pfa->l1_hits + pfa->l2_hits)/numAccesses*100, (float)lookupPathCost(&policy_fa[p])/numAccesses);
+    }
+    printf("\n");
+
+cleanup:
+    for (int m = 0; m < 3; m++) freeMappingSimulator(&sims[m]);
+    for (int p = 0; p < POLICY_OPT; p++) {
+        freeMappingSimulator(&policy_sa[p]);
+        freeMappingSimulator(&policy_fa[p]);
+    }
 }
 
 void runPredefinedAddressPattern( int numAccesses) {
@@ -1589,149 +6858,74 @@ void runPredefinedAddressPattern( int numAccesses) {
     printf("Running Cache Comparisons with Specific Address Patterns\n");
     printf("=====================================================\n\n");
 
+    // The three patterns run one after another in the interactive arena
+    Arena *arena = &interactiveArena;
+
     // Create a simpler comparison function specifically for address patterns
-    void compareWithPattern(unsigned int *addresses, int numAccesses, const char *patternName) {
-        // Statistics for each cache type
-        CacheStats dmStats = {0}, faStats = {0}, saStats = {0};
-
-        // Initialize caches
-        CacheLine *l1_cache_dm = calloc(L1_SIZE, sizeof(CacheLine));
-        CacheLine *l2_cache_dm = calloc(L2_SIZE, sizeof(CacheLine));
-        FullyAssociativeCacheLine *l1_cache_fa = calloc(L1_SIZE, sizeof(FullyAssociativeCacheLine));
-        FullyAssociativeCacheLine *l2_cache_fa = calloc(L2_SIZE, sizeof(FullyAssociativeCacheLine));
-        AssociativeCacheLine *l1_cache_sa = calloc(L1_SIZE, sizeof(AssociativeCacheLine));
-        AssociativeCacheLine *l2_cache_sa = calloc(L2_SIZE, sizeof(AssociativeCacheLine));
-
-        // Check for memory allocation failures
-        if (!l1_cache_dm || !l2_cache_dm || !l1_cache_fa || !l2_cache_fa || !l1_cache_sa || !l2_cache_sa) {
+    void compareWithPattern(SyntheticTrace *gen, int numAccesses, const char *patternName) {
+        // The three mapping schemes and Belady OPT (fully associative) for reference, all
+        // on the same L1/L2 hierarchy; OPT needs the whole pattern up front to know each
+        // line's next use
+        static const MappingType mappings[] = { MAPPING_DIRECT, MAPPING_FULLY_ASSOCIATIVE, MAPPING_SET_ASSOCIATIVE,
+                                                MAPPING_FULLY_ASSOCIATIVE };
+        CacheConfig configs[4];
+        MappingSimulator sims[4];
+        CacheStats stats[4];
+        memset(sims, 0, sizeof(sims));
+
+        // Every pattern starts from the memory the previous one handed back to the arena
+        resetArena(arena);
+        TraceRecord *records = arenaAlloc(arena, (size_t)numAccesses * sizeof(TraceRecord));
+        long *nextUse = NULL;
+        bool ready = records != NULL;
+        if (ready) {
+            fillSyntheticTrace(gen, records, (size_t)numAccesses);
+            nextUse = buildNextUseIndex(records, (size_t)numAccesses, BLOCK_SIZE, arena);
+            ready = nextUse != NULL;
+        }
+        for (int s = 0; s < 4 && ready; s++) {
+            ready = initComparisonSimulator(&sims[s], &configs[s], mappings[s], (s == 3) ? POLICY_OPT : POLICY_LRU,
+                                            nextUse) == 0;
+        }
+        if (!ready) {
             fprintf(stderr, "Memory allocation failed for pattern analysis caches!\n");
-            goto cleanup;
+            for (int s = 0; s < 4; s++) freeMappingSimulator(&sims[s]);
+            return;
         }
 
-        // Initialize caches
-        initializeCache(l1_cache_dm, L1_SIZE);
-        initializeCache(l2_cache_dm, L2_SIZE);
-        initializeFullyAssociativeCache(l1_cache_fa, L1_SIZE);
-        initializeFullyAssociativeCache(l2_cache_fa, L2_SIZE);
-        initializeAssociativeCache(l1_cache_sa, L1_SETS, L1_ASSOCIATIVITY);
-        initializeAssociativeCache(l2_cache_sa, L2_SETS, L2_ASSOCIATIVITY);
-
-        // Process each memory access for each cache type
-        for (int i = 0; i < numAccesses; i++) {
-            unsigned int address = addresses[i];
-            int tag, index, way, set;
-
-            // Direct-Mapped Cache Simulation
-            bool l1_hit_dm = checkCache(l1_cache_dm, L1_SIZE, address, &tag, &index);
-            if (l1_hit_dm) {
-                dmStats.l1_hits++;
-                dmStats.total_cost += L1_ACCESS_COST;
-            } else {
-                bool l2_hit_dm = checkCache(l2_cache_dm, L2_SIZE, address, &tag, &index);
-                if (l2_hit_dm) {
-                    dmStats.l2_hits++;
-                    dmStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE * L1_SIZE);
-                    int l1_index = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE;
-                    updateCache(l1_cache_dm, l1_index, l1_tag, address);
-                } else {
-                    dmStats.memory_accesses++;
-                    dmStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
-                    int l2_tag = address / (WORDS_PER_LINE * WORD_SIZE * L2_SIZE);
-                    int l2_index = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SIZE;
-                    updateCache(l2_cache_dm, l2_index, l2_tag, address);
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE * L1_SIZE);
-                    int l1_index = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SIZE;
-                    updateCache(l1_cache_dm, l1_index, l1_tag, address);
-                }
-            }
-
-            // Fully Associative Cache Simulation
-            bool l1_hit_fa = checkFullyAssociativeCache(l1_cache_fa, L1_SIZE, address, &tag, &way);
-            if (l1_hit_fa) {
-                faStats.l1_hits++;
-                faStats.total_cost += L1_ACCESS_COST;
-                updateFullyAssociativeLRU(l1_cache_fa, L1_SIZE, way);
-            } else {
-                bool l2_hit_fa = checkFullyAssociativeCache(l2_cache_fa, L2_SIZE, address, &tag, &way);
-                if (l2_hit_fa) {
-                    faStats.l2_hits++;
-                    faStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                    updateFullyAssociativeLRU(l2_cache_fa, L2_SIZE, way);
-                    int l1_way = findFullyAssociativeLRU(l1_cache_fa, L1_SIZE);
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                    updateFullyAssociativeCache(l1_cache_fa, L1_SIZE, l1_way, l1_tag, address);
-                } else {
-                    faStats.memory_accesses++;
-                    faStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
-                    int l2_way = findFullyAssociativeLRU(l2_cache_fa, L2_SIZE);
-                    int l2_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                    updateFullyAssociativeCache(l2_cache_fa, L2_SIZE, l2_way, l2_tag, address);
-                    int l1_way = findFullyAssociativeLRU(l1_cache_fa, L1_SIZE);
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE);
-                    updateFullyAssociativeCache(l1_cache_fa, L1_SIZE, l1_way, l1_tag, address);
-                }
-            }
-
-            // Set-Associative Cache Simulation
-            bool l1_hit_sa = checkAssociativeCache(l1_cache_sa, L1_SETS, L1_ASSOCIATIVITY, address, &tag, &set, &way);
-            if (l1_hit_sa) {
-                saStats.l1_hits++;
-                saStats.total_cost += L1_ACCESS_COST;
-                updateLRUCounters(l1_cache_sa, set, L1_ASSOCIATIVITY, way);
-            } else {
-                bool l2_hit_sa = checkAssociativeCache(l2_cache_sa, L2_SETS, L2_ASSOCIATIVITY, address, &tag, &set, &way);
-                if (l2_hit_sa) {
-                    saStats.l2_hits++;
-                    saStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST);
-                    updateLRUCounters(l2_cache_sa, set, L2_ASSOCIATIVITY, way);
-                    int l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE * L1_SETS);
-                    int l1_way = findLRUWay(l1_cache_sa, l1_set, L1_ASSOCIATIVITY);
-                    updateAssociativeCache(l1_cache_sa, l1_set, l1_way, L1_ASSOCIATIVITY, l1_tag, address);
-                } else {
-                    saStats.memory_accesses++;
-                    saStats.total_cost += (L1_ACCESS_COST + L2_ACCESS_COST + MEMORY_ACCESS_COST);
-                    int l2_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L2_SETS;
-                    int l2_tag = address / (WORDS_PER_LINE * WORD_SIZE * L2_SETS);
-                    int l2_way = findLRUWay(l2_cache_sa, l2_set, L2_ASSOCIATIVITY);
-                    updateAssociativeCache(l2_cache_sa, l2_set, l2_way, L2_ASSOCIATIVITY, l2_tag, address);
-                    int l1_set = (address / (WORDS_PER_LINE * WORD_SIZE)) % L1_SETS;
-                    int l1_tag = address / (WORDS_PER_LINE * WORD_SIZE * L1_SETS);
-                    int l1_way = findLRUWay(l1_cache_sa, l1_set, L1_ASSOCIATIVITY);
-                    updateAssociativeCache(l1_cache_sa, l1_set, l1_way, L1_ASSOCIATIVITY, l1_tag, address);
-                }
-            }
+        // Process the memory accesses for each cache type, then calculate hit rates and
+        // average access times
+        for (int s = 0; s < 4; s++) {
+            simulateTraceChunk(&sims[s], records, (size_t)numAccesses);
+            finishMappingSimulator(&sims[s]);
+            stats[s] = sims[s].stats;
+            stats[s].total_cost = lookupPathCost(&sims[s]);
+            stats[s].hit_rate = (float)(stats[s].l1_hits + stats[s].l2_hits) / numAccesses * 100;
+            stats[s].avg_access_time = (float)stats[s].total_cost / numAccesses;
+            freeMappingSimulator(&sims[s]);
         }
-
-        // Calculate hit rates and average access times
-        dmStats.hit_rate = (float)(dmStats.l1_hits + dmStats.l2_hits) / numAccesses * 100;
-        dmStats.avg_access_time = (float)dmStats.total_cost / numAccesses;
-
-        faStats.hit_rate = (float)(faStats.l1_hits + faStats.l2_hits) / numAccesses * 100;
-        faStats.avg_access_time = (float)faStats.total_cost / numAccesses;
-
-        saStats.hit_rate = (float)(saStats.l1_hits + saStats.l2_hits) / numAccesses * 100;
-        saStats.avg_access_time = (float)saStats.total_cost / numAccesses;
+        CacheStats dmStats = stats[0], faStats = stats[1], saStats = stats[2], optStats = stats[3];
 
         // Print results for this address pattern
         printf("\n\nResults for %s Pattern (%d accesses):\n", patternName, numAccesses);
         printf("-----------------------------------------\n");
 
-        printf("                     | Direct-Mapped | Fully Associative | Set-Associative |\n");
-        printf("---------------------------------------------------------------------\n");
-        printf("L1 Hit Rate          | %6.2f%%      | %6.2f%%          | %6.2f%%        |\n",
+        printf("                     | Direct-Mapped | Fully Associative | Set-Associative | OPT (FA)      |\n");
+        printf("-------------------------------------------------------------------------------------\n");
+        printf("L1 Hit Rate          | %6.2f%%      | %6.2f%%          | %6.2f%%        | %6.2f%%      |\n",
                (float)dmStats.l1_hits/numAccesses*100,
                (float)faStats.l1_hits/numAccesses*100,
-               (float)saStats.l1_hits/numAccesses*100);
-        printf("L2 Hit Rate          | %6.2f%%      | %6.2f%%          | %6.2f%%        |\n",
+               (float)saStats.l1_hits/numAccesses*100,
+               (float)optStats.l1_hits/numAccesses*100);
+        printf("L2 Hit Rate          | %6.2f%%      | %6.2f%%          | %6.2f%%        | %6.2f%%      |\n",
                (float)dmStats.l2_hits/numAccesses*100,
                (float)faStats.l2_hits/numAccesses*100,
-               (float)saStats.l2_hits/numAccesses*100);
-        printf("Total Hit Rate       | %6.2f%%      | %6.2f%%          | %6.2f%%        |\n",
-               dmStats.hit_rate, faStats.hit_rate, saStats.hit_rate);
-        printf("Avg Access Time      | %6.2f cycles | %6.2f cycles     | %6.2f cycles   |\n",
-               dmStats.avg_access_time, faStats.avg_access_time, saStats.avg_access_time);
+               (float)saStats.l2_hits/numAccesses*100,
+               (float)optStats.l2_hits/numAccesses*100);
+        printf("Total Hit Rate       | %6.2f%%      | %6.2f%%          | %6.2f%%        | %6.2f%%      |\n",
+               dmStats.hit_rate, faStats.hit_rate, saStats.hit_rate, optStats.hit_rate);
+        printf("Avg Access Time      | %6.2f cycles | %6.2f cycles     | %6.2f cycles   | %6.2f cycles |\n",
+               dmStats.avg_access_time, faStats.avg_access_time, saStats.avg_access_time, optStats.avg_access_time);
 
         // Identify best performing strategy for this pattern
         printf("\nBest cache for %s pattern: ", patternName);
@@ -1743,15 +6937,7 @@ void runPredefinedAddressPattern( int numAccesses) {
         } else {
             printf("Set-Associative (%.2f cycles/access)\n", saStats.avg_access_time);
         }
-
-    cleanup:
-        // Free memory
-        free(l1_cache_dm);
-        free(l2_cache_dm);
-        free(l1_cache_fa);
-        free(l2_cache_fa);
-        free(l1_cache_sa);
-        free(l2_cache_sa);
+        printf("OPT (offline Belady): %.2f cycles/access\n", optStats.avg_access_time);
     }
 
 
@@ -1762,59 +6948,18 @@ void runPredefinedAddressPattern( int numAccesses) {
     printf("3. Repeated Access: Repeatedly accessing a small set of addresses\n\n");
 
     // 1. Sequential access pattern (good spatial locality)
-    unsigned int *seqAddresses = malloc(numAccesses * sizeof(unsigned int));
-    if (seqAddresses) {
-        printf("Generating sequential access pattern...\n");
-        for (int i = 0; i < numAccesses; i++) {
-            seqAddresses[i] = (i * WORD_SIZE) % ADDRESS_SPACE;
-             // Sequential addresses
-        }
-        compareWithPattern(seqAddresses, numAccesses, "Sequential");
-        free(seqAddresses);
-    } else {
-        fprintf(stderr, "Memory allocation failed for sequential addresses!\n");
-    }
-
-
-
     // 2. Random access pattern (poor locality)
-    unsigned int *randomAddresses = malloc(numAccesses * sizeof(unsigned int));
-    if (randomAddresses) {
-        printf("\nGenerating random access pattern...\n");
-        srand((unsigned int)time(NULL));
-        for (int i = 0; i < numAccesses; i++) {
-            randomAddresses[i] = (rand() % (ADDRESS_SPACE / WORD_SIZE)) * WORD_SIZE;
-             // Random addresses
-        }
-        compareWithPattern(randomAddresses, numAccesses, "Random");
-        free(randomAddresses);
-    } else {
-        fprintf(stderr, "Memory allocation failed for random addresses!\n");
-    }
-
     // 3. Repeated access pattern (tests temporal locality)
-    unsigned int *repeatedAddresses = malloc(numAccesses * sizeof(unsigned int));
-    if (repeatedAddresses) {
-        printf("\nGenerating repeated access pattern...\n");
-        int numUniqueAddresses = 20;
-        unsigned int *uniqueAddresses = malloc(numUniqueAddresses * sizeof(unsigned int));
-        if (uniqueAddresses) {
-            // Generate a small set of unique addresses
-            for (int i = 0; i < numUniqueAddresses; i++) {
-                uniqueAddresses[i] = (rand() % (ADDRESS_SPACE / WORD_SIZE)) * WORD_SIZE;
-            }
-            // Create a pattern that repeatedly accesses these addresses
-            for (int i = 0; i < numAccesses; i++) {
-                repeatedAddresses[i] = uniqueAddresses[i % numUniqueAddresses];
-            }
-            free(uniqueAddresses);
-            compareWithPattern(repeatedAddresses, numAccesses, "Repeated");
-        } else {
-            fprintf(stderr, "Memory allocation failed for unique addresses!\n");
-        }
-        free(repeatedAddresses);
-    } else {
-        fprintf(stderr, "Memory allocation failed for repeated addresses!\n");
+    static const AddressPattern patterns[] = { PATTERN_SEQUENTIAL, PATTERN_RANDOM, PATTERN_REPEATED };
+    static const char *names[] = { "Sequential", "Random", "Repeated" };
+    static const char *generating[] = { "sequential", "random", "repeated" };
+
+    unsigned int seed = interactiveSeed();
+    for (int p = 0; p < 3; p++) {
+        printf("%sGenerating %s access pattern (seed %u)...\n", p ? "\n" : "", generating[p], seed + p);
+        SyntheticTrace gen;
+        initSyntheticTrace(&gen, patterns[p], seed + p, ADDRESS_SPACE);
+        compareWithPattern(&gen, numAccesses, names[p]);
     }
 
     printf("\n===============================================\n");
@@ -1857,7 +7002,6 @@ void runCacheMappingComparison() {
     }
 
     printf("\nRunning cache comparison with %d memory accesses...\n\n", numAccesses);
-    simulateDelay();
 
     // Run the comparison
     compareAllCacheMappings(numAccesses);
@@ -1876,7 +7020,23 @@ void runCacheMappingComparison() {
 
 
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Any command line argument selects the non-interactive batch mode
+    if (argc > 1) {
+        BatchOptions opts;
+        if (parseBatchOptions(argc, argv, &opts) != 0) return 1;
+        int status = opts.benchmarkLRU ? runLRUBenchmark(&opts) : runBatchSimulation(&opts);
+        freeCacheConfigList(&opts.configs);
+        return status;
+    }
+
+    const char *seed = getenv("SIM_SEED");
+    unsigned int value;
+    if (seed != NULL && *seed != '\0' && parseSeed(seed, &value) != 0) {
+        fprintf(stderr, "Invalid SIM_SEED '%s' (an unsigned 32-bit number)\n", seed);
+        return 1;
+    }
+
     while (true) {
         clearScreen();
         int choice;